@@ -0,0 +1,110 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file Arduino.h
+ * Host stand-in for the Teensy core, just enough for src/ to build and run.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "WString.h"
+#include "Stream.h"
+#include "IntervalTimer.h"
+
+/*
+ * Time is virtual: it only moves when the firmware waits (delay(),
+ * delayMicroseconds()) or polls an idle Serial, so a test that takes
+ * minutes on the stand runs as fast as the host can consume it.
+ * IntervalTimer callbacks stand in for interrupts and fire as it moves.
+ */
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEFAULT 0
+#define RISING 2
+#define FALLING 3
+#define CHANGE 4
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+/* Callbacks never preempt, there is nothing to mask */
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/* Pin interrupts fire when sim_set_pin() makes the matching edge */
+void attachInterrupt(uint8_t pin, void (*function)(), int mode);
+void detachInterrupt(uint8_t pin);
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t type);
+void analogReadResolution(unsigned int bits);
+void analogReadAveraging(unsigned int num);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+template<class T> inline T constrain(T x, T lo, T hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+/* USB serial backed by the simulator's pty */
+class usb_serial_class : public Stream {
+public:
+    void begin(long baud) { (void) baud; }
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush() {}
+    operator bool() { return true; }
+};
+
+extern usb_serial_class Serial;
+
+void setup();
+void loop();
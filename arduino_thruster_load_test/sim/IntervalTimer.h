@@ -0,0 +1,64 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file IntervalTimer.h
+ * Host stand-in for Teensy's PIT driven IntervalTimer, on virtual time.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/*
+ * Callbacks fire from within whatever moves the virtual clock (delay(),
+ * an idle Serial poll), with micros() reading their exact due time. They
+ * run on the firmware's own thread, so like a real ISR they never overlap
+ * the code they interrupt mid-statement, just between calls.
+ */
+class IntervalTimer {
+public:
+    ~IntervalTimer() { end(); }
+    bool begin(void (*funct)(), unsigned int microseconds);
+    bool begin(void (*funct)(), int microseconds) { return begin(funct, (unsigned int) microseconds); }
+    bool begin(void (*funct)(), float microseconds) { return begin(funct, (unsigned int) (microseconds + 0.5f)); }
+    void end();
+    void priority(uint8_t n) { (void) n; }
+
+    /* Runs every callback due up to and including `until_us` */
+    static void run_until(uint64_t until_us);
+    /* When the next callback is due, UINT64_MAX with none running */
+    static uint64_t next_due_us();
+
+private:
+    void (*callback)() = nullptr;
+    uint64_t period_us = 0;
+    uint64_t next_us = 0;
+    bool active = false;
+};
@@ -0,0 +1,79 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file Stream.h
+ * Host stand-in for the Arduino Print and Stream classes.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "WString.h"
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    size_t write(const char *str) { return write((const uint8_t *) str, strlen(str)); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *) buffer, size); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(long n) { char b[24]; snprintf(b, sizeof(b), "%ld", n); return write(b); }
+    size_t print(unsigned long n) { char b[24]; snprintf(b, sizeof(b), "%lu", n); return write(b); }
+    size_t print(int n) { return print((long) n); }
+    size_t print(unsigned int n) { return print((unsigned long) n); }
+    size_t print(double n, int digits = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", digits, n); return write(b); }
+    size_t println() { return write((uint8_t) '\n'); }
+    template<typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) { timeout_ms = timeout; }
+    String readStringUntil(char terminator);
+    size_t readBytes(char *buffer, size_t length);
+
+protected:
+    unsigned long timeout_ms{1000};
+    int timedRead();
+};
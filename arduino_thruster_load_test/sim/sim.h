@@ -0,0 +1,101 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim.h
+ * Hooks between the simulator's main() and its Arduino stand-ins.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* Virtual time a loop() pass is charged */
+#define SIM_IDLE_US 100
+/* After this many passes in a row that neither read nor wrote Serial, the
+ * firmware is waiting out a dwell. Virtual time then jumps ahead instead,
+ * doubling up to SIM_IDLE_MAX_US but never past the next IntervalTimer or
+ * pin event. A millis() deadline is overshot by at most the jump */
+#define SIM_IDLE_PASSES 16
+#define SIM_IDLE_MAX_US 20000
+/* Wall time the first jump after the firmware has written waits for the
+ * host to answer, so a reply is not left a whole jump behind */
+#define SIM_REPLY_WAIT_US 500
+/* How often an idle firmware looks at the pty, in virtual time. Reading it
+ * on every poll made the syscalls most of a run's wall time */
+#define SIM_POLL_US 1000
+/* Bytes Serial.write() takes before it blocks, a Teensy 3 queues 8 USB
+ * packets */
+#define SIM_TX_BUFFER 512
+/* estop_pin in src/main.cpp, and how long --estop-at holds it low */
+#define SIM_ESTOP_PIN 3
+#define SIM_ESTOP_HOLD_US 100000
+/* load_cell's HX711 pins, and its gain: a 5 kg, 1 mV/V cell on 5 V */
+#define SIM_HX711_DOUT_PIN 5
+#define SIM_HX711_SCK_PIN 6
+#define SIM_HX711_COUNTS_PER_GRAM 419
+/* Rotor speed at full throttle, its tachometer sees one mark a turn */
+#define SIM_ROTOR_MAX_RPM 12000
+
+/* Serial talks through `master`. `slave` is held open until the host has
+ * connected, after that a hangup on the pty ends the simulation */
+void sim_attach_pty(int master, int slave);
+
+/* Keep virtual time from running ahead of the wall clock, for anything on
+ * the host that judges time by its own clock */
+void sim_set_realtime(bool realtime);
+
+uint64_t sim_time_us();
+void sim_advance_us(uint64_t us);
+/* Charges the loop() pass that just ended, see SIM_IDLE_PASSES */
+void sim_loop_done();
+
+/* What the ADC reads, in `bits` bit counts, on adc_dma's ADC_CHANNEL
+ * `channel`. analogRead() reads channel 0, the current */
+int sim_adc_read(uint8_t channel, unsigned int bits);
+
+/* Last angle written to any Servo, 90 is a stopped thruster */
+int sim_esc_angle();
+/* What the thruster pushes on the load cell right now, with some noise */
+double sim_thrust_grams();
+/* Speed the rotor settles at for the ESC's last command */
+double sim_rotor_rpm();
+
+/* Puts an HX711 on SIM_HX711_DOUT_PIN and SIM_HX711_SCK_PIN, converting
+ * sim_thrust_grams() 80 times a second */
+void sim_hx711_attach();
+
+/* Drives an input pin, running its interrupt on a matching edge */
+void sim_set_pin(uint8_t pin, uint8_t level);
+/* Same, `at_us` of virtual time after the host first writes */
+void sim_schedule_pin(uint8_t pin, uint8_t level, uint64_t at_us);
+/* Runs `hook` with the level each time the firmware writes `pin`, the way
+ * a device sees its clock input */
+void sim_on_write(uint8_t pin, void (*hook)(uint8_t level));
@@ -0,0 +1,79 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_adc_dma.cpp
+ * adc_dma's backend on virtual time, for the simulator.
+ *
+ * @author Ali AlSaibie
+ */
+#include "Arduino.h"
+#include "IntervalTimer.h"
+#include "adc_dma_backend.h"
+#include "sim.h"
+
+/* Stands in for the PDB, DMA and mux channels: each tick converts a whole
+ * sequence, so the ring fills the same way at a fraction of the callbacks */
+static IntervalTimer sequence_timer;
+static volatile uint16_t *ring = nullptr;
+static uint16_t ring_length = 0;
+static uint16_t position = 0;
+
+static void convert_sequence() {
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    ring[position++] = (uint16_t) sim_adc_read(c, 12);
+  }
+  if (position == ring_length / 2 || position == ring_length) {
+    if (position == ring_length) {
+      position = 0;
+    }
+    adc_dma_half_isr();
+  }
+}
+
+uint32_t adc_backend_start(uint32_t period_ns, uint8_t hw_average,
+                           volatile uint16_t *ring_, uint16_t length) {
+  (void) hw_average;
+  unsigned int sequence_us = (unsigned int) ((period_ns * ADC_CHANNELS + 500) / 1000);
+  if (sequence_us == 0) {
+    return 0;
+  }
+  ring = ring_;
+  ring_length = length;
+  position = 0;
+  if (!sequence_timer.begin(convert_sequence, sequence_us)) {
+    return 0;
+  }
+  return sequence_us * 1000 / ADC_CHANNELS;
+}
+
+void adc_backend_stop() {
+  sequence_timer.end();
+}
@@ -0,0 +1,538 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_arduino.cpp
+ * Virtual clock, pty backed Serial and a crude thruster model.
+ *
+ * @author Ali AlSaibie
+ */
+#include "Arduino.h"
+#include "Servo.h"
+#include "sim.h"
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+usb_serial_class Serial;
+
+static uint64_t now_us = 0;
+static int pty_master = -1;
+static int pty_slave = -1;
+static std::deque<uint8_t> rx;
+/* Serial's own transmit buffer, what availableForWrite() reports room in */
+static std::vector<uint8_t> tx;
+static int esc_angle = 90;
+static bool esc_attached = false;
+/* An ESC only drives the motor once it has seen neutral */
+static bool esc_armed = false;
+static unsigned int adc_bits = 10;
+static struct timespec wall_start;
+static bool realtime = false;
+/* Whether this loop() pass touched Serial, and the idle passes before it */
+static bool pass_busy = false;
+static unsigned int idle_passes = 0;
+static uint64_t idle_jump_us = SIM_IDLE_US;
+/* The firmware wrote last, and the host answered the last time it did */
+static bool awaiting_reply = false;
+static bool host_answers = true;
+
+static void host_connected();
+static void flush_tx(bool wait);
+
+static void report_and_exit() {
+  struct timespec wall_end;
+  clock_gettime(CLOCK_MONOTONIC, &wall_end);
+  double wall = (wall_end.tv_sec - wall_start.tv_sec) +
+                (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+  fprintf(stderr, "firmware_sim: host hung up after %.3f s virtual, %.3f s wall\n",
+          now_us / 1e6, wall);
+  exit(0);
+}
+
+/* Moves whatever the host sent into rx without ever blocking */
+static void pump() {
+  uint8_t buffer[256];
+  for (;;) {
+    ssize_t n = ::read(pty_master, buffer, sizeof(buffer));
+    if (n > 0) {
+      rx.insert(rx.end(), buffer, buffer + n);
+      awaiting_reply = false;
+      host_answers = true;
+      if (pty_slave >= 0) {
+        /* The host is there, let its hangup reach us */
+        close(pty_slave);
+        pty_slave = -1;
+        host_connected();
+      }
+      continue;
+    }
+    if (n < 0 && errno == EIO) {
+      report_and_exit();
+    }
+    return;
+  }
+}
+
+void sim_attach_pty(int master, int slave) {
+  pty_master = master;
+  pty_slave = slave;
+  clock_gettime(CLOCK_MONOTONIC, &wall_start);
+}
+
+void sim_set_realtime(bool realtime_) { realtime = realtime_; }
+
+static uint64_t wall_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) (now.tv_sec - wall_start.tv_sec) * 1000000 +
+         (now.tv_nsec - wall_start.tv_nsec) / 1000;
+}
+
+uint64_t sim_time_us() { return now_us; }
+
+#define SIM_PINS 64
+
+struct pin_state {
+    uint8_t level;
+    int mode;
+    void (*isr)();
+    void (*on_write)(uint8_t level);
+};
+
+struct pin_event {
+    uint64_t at_us;
+    uint8_t pin;
+    uint8_t level;
+};
+
+static pin_state pins[SIM_PINS];
+/* Sorted by at_us, relative to the host connecting until it does */
+static std::deque<pin_event> pin_events;
+static bool pin_events_due = false;
+
+static void host_connected() {
+  for (size_t i = 0; i < pin_events.size(); i++) {
+    pin_events[i].at_us += now_us;
+  }
+  pin_events_due = true;
+}
+
+void sim_advance_us(uint64_t us) {
+  uint64_t until = now_us + us;
+  while (pin_events_due && !pin_events.empty() && pin_events.front().at_us <= until) {
+    pin_event e = pin_events.front();
+    pin_events.pop_front();
+    IntervalTimer::run_until(e.at_us);
+    now_us = std::max(now_us, e.at_us);
+    sim_set_pin(e.pin, e.level);
+    if (e.pin == SIM_ESTOP_PIN && e.level == LOW) {
+      /* The ISR has run by now, the ESC should get no more pulses */
+      fprintf(stderr, "firmware_sim: e-stop at %.3f s, ESC %s\n", now_us / 1e6,
+              esc_attached ? "still driven" : "stopped");
+    }
+  }
+  IntervalTimer::run_until(until);
+  now_us = until;
+}
+
+/* Gives the host SIM_REPLY_WAIT_US of wall time to answer what the
+ * firmware last wrote, true if it did */
+static bool host_replied() {
+  awaiting_reply = false;
+  flush_tx(false);
+  struct pollfd pfd = {pty_master, POLLIN, 0};
+  struct timespec ts = {0, SIM_REPLY_WAIT_US * 1000};
+  if (ppoll(&pfd, 1, &ts, NULL) <= 0) {
+    /* Not waiting again until it says something */
+    host_answers = false;
+    return false;
+  }
+  pump();
+  return !rx.empty();
+}
+
+void sim_loop_done() {
+  if (realtime) {
+    /* available() has kept up with the wall clock */
+    return;
+  }
+  if (pass_busy || !rx.empty()) {
+    idle_passes = 0;
+    idle_jump_us = SIM_IDLE_US;
+    sim_advance_us(SIM_IDLE_US);
+  }
+  else if (++idle_passes <= SIM_IDLE_PASSES) {
+    sim_advance_us(SIM_IDLE_US);
+  }
+  else if (awaiting_reply && host_replied()) {
+    idle_passes = 0;
+    idle_jump_us = SIM_IDLE_US;
+    sim_advance_us(SIM_IDLE_US);
+  }
+  else {
+    uint64_t until = now_us + idle_jump_us;
+    until = std::min(until, std::max(IntervalTimer::next_due_us(), now_us + 1));
+    if (pin_events_due && !pin_events.empty()) {
+      until = std::min(until, std::max(pin_events.front().at_us, now_us + 1));
+    }
+    sim_advance_us(until - now_us);
+    idle_jump_us = std::min<uint64_t>(idle_jump_us * 2, SIM_IDLE_MAX_US);
+  }
+  pass_busy = false;
+}
+int sim_esc_angle() { return esc_angle; }
+
+void sim_set_pin(uint8_t pin, uint8_t level) {
+  if (pin >= SIM_PINS) {
+    return;
+  }
+  pin_state &p = pins[pin];
+  uint8_t was = p.level;
+  p.level = level ? HIGH : LOW;
+  if (p.isr == nullptr || was == p.level) {
+    return;
+  }
+  if (p.mode == CHANGE || (p.mode == RISING && p.level == HIGH) ||
+      (p.mode == FALLING && p.level == LOW)) {
+    p.isr();
+  }
+}
+
+void sim_schedule_pin(uint8_t pin, uint8_t level, uint64_t at_us) {
+  pin_event e = {at_us, pin, level};
+  auto it = std::upper_bound(pin_events.begin(), pin_events.end(), e,
+                             [](const pin_event &a, const pin_event &b) { return a.at_us < b.at_us; });
+  pin_events.insert(it, e);
+}
+
+void sim_on_write(uint8_t pin, void (*hook)(uint8_t level)) {
+  if (pin < SIM_PINS) {
+    pins[pin].on_write = hook;
+  }
+}
+
+void attachInterrupt(uint8_t pin, void (*function)(), int mode) {
+  if (pin < SIM_PINS) {
+    pins[pin].isr = function;
+    pins[pin].mode = mode;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < SIM_PINS) {
+    pins[pin].isr = nullptr;
+  }
+}
+
+uint32_t millis() { return (uint32_t) (now_us / 1000); }
+uint32_t micros() { return (uint32_t) now_us; }
+void delay(uint32_t ms) { sim_advance_us((uint64_t) ms * 1000); }
+void delayMicroseconds(uint32_t us) { sim_advance_us(us); }
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < SIM_PINS && mode == INPUT_PULLUP) {
+    pins[pin].level = HIGH;
+  }
+}
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < SIM_PINS) {
+    pins[pin].level = value ? HIGH : LOW;
+    if (pins[pin].on_write) {
+      pins[pin].on_write(pins[pin].level);
+    }
+  }
+}
+uint8_t digitalRead(uint8_t pin) { return pin < SIM_PINS ? pins[pin].level : LOW; }
+void analogReference(uint8_t) {}
+void analogReadResolution(unsigned int bits) { adc_bits = bits; }
+void analogReadAveraging(unsigned int) {}
+
+/* Current drawn grows with |throttle|^1.5, 30 A full scale, plus some
+ * ripple. The 4 S pack sags with it through 20 mOhm, read through a 25 V
+ * full scale divider, and the chip warms a little with it too, read off its
+ * temperature sensor (0.719 V at 25 C, -1.715 mV/C) */
+int sim_adc_read(uint8_t channel, unsigned int bits) {
+  double throttle = (esc_angle - 90) / 90.0;
+  double amps = 20.0 * pow(fabs(throttle), 1.5);
+  double ripple = ((rand() % 2001) - 1000) / 1000.0;
+  double volts;
+  if (channel == 0) {
+    volts = (amps + 0.05 * ripple) / 30.0 * 3.3;
+  }
+  else if (channel == 1) {
+    volts = (16.8 - 0.02 * amps + 0.01 * ripple) / 25.0 * 3.3;
+  }
+  else {
+    volts = 0.719 - 0.001715 * (0.2 * amps + 0.1 * ripple);
+  }
+  long full_scale = (1L << bits) - 1;
+  return (int) constrain((long) (volts / 3.3 * full_scale), 0L, full_scale);
+}
+
+/* Thrust grows with throttle^2 either way, 1.5 kg full scale, with the
+ * vibration a running thruster puts on the stand */
+double sim_thrust_grams() {
+  double throttle = esc_armed ? (esc_angle - 90) / 90.0 : 0.0;
+  double vibration = ((rand() % 2001) - 1000) / 1000.0;
+  return 1500.0 * throttle * fabs(throttle) + 2.0 * vibration;
+}
+
+double sim_rotor_rpm() {
+  double throttle = esc_armed ? (esc_angle - 90) / 90.0 : 0.0;
+  /* Thrust goes with the square of speed */
+  return SIM_ROTOR_MAX_RPM * fabs(throttle);
+}
+
+int analogRead(uint8_t) {
+  return sim_adc_read(0, adc_bits);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+uint8_t Servo::attach(int pin) {
+  this->pin = pin;
+  esc_attached = true;
+  return 1;
+}
+
+void Servo::detach() {
+  pin = -1;
+  esc_attached = false;
+  esc_armed = false;
+}
+
+void Servo::write(int value) {
+  if (value > 200) {
+    writeMicroseconds(value);
+    return;
+  }
+  angle = constrain(value, 0, 180);
+  esc_angle = angle;
+  esc_armed = esc_armed || (esc_attached && abs(angle - 90) <= 2);
+}
+
+void Servo::writeMicroseconds(int value) {
+  write((int) map(constrain(value, 1000, 2000), 1000, 2000, 0, 180));
+}
+
+/* Lets the firmware's clock run while it waits on the host */
+static void pass_time() {
+  if (realtime) {
+    uint64_t wall = wall_us();
+    if (wall > now_us) {
+      sim_advance_us(wall - now_us);
+    }
+  }
+  else {
+    sim_advance_us(SIM_IDLE_US);
+  }
+}
+
+/* Hands tx to the pty. With `wait` it blocks, time passing, until at least
+ * some of it went, the way a full USB buffer holds up Serial.write() */
+static void flush_tx(bool wait) {
+  while (!tx.empty()) {
+    ssize_t n = ::write(pty_master, tx.data(), tx.size());
+    if (n > 0) {
+      tx.erase(tx.begin(), tx.begin() + n);
+      wait = false;
+      continue;
+    }
+    if (n < 0 && errno == EIO) {
+      report_and_exit();
+    }
+    if (!wait) {
+      return;
+    }
+    struct pollfd pfd = {pty_master, POLLOUT, 0};
+    poll(&pfd, 1, 10);
+    pass_time();
+  }
+}
+
+int usb_serial_class::available() {
+  static uint64_t polled_us = 0;
+  if (realtime || !rx.empty() || now_us - polled_us >= SIM_POLL_US) {
+    pump();
+    polled_us = now_us;
+  }
+  flush_tx(false);
+  if (rx.empty() && realtime) {
+    /* Nothing from the host, wait for the wall clock to catch up */
+    uint64_t wall = wall_us();
+    if (wall <= now_us) {
+      usleep(SIM_IDLE_US);
+      wall = wall_us();
+    }
+    if (wall > now_us) {
+      sim_advance_us(wall - now_us);
+    }
+  }
+  return (int) rx.size();
+}
+
+int usb_serial_class::read() {
+  if (rx.empty() && available() == 0) {
+    return -1;
+  }
+  int c = rx.front();
+  rx.pop_front();
+  pass_busy = true;
+  return c;
+}
+
+int usb_serial_class::peek() {
+  if (rx.empty() && available() == 0) {
+    return -1;
+  }
+  return rx.front();
+}
+
+int usb_serial_class::availableForWrite() {
+  flush_tx(false);
+  if (tx.size() == SIM_TX_BUFFER) {
+    /* Polling a full buffer, as loop() does while the host stalls */
+    pass_time();
+  }
+  return (int) (SIM_TX_BUFFER - tx.size());
+}
+
+size_t usb_serial_class::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  pass_busy = pass_busy || size > 0;
+  awaiting_reply = awaiting_reply || (size > 0 && host_answers);
+  while (written < size) {
+    if (tx.size() == SIM_TX_BUFFER) {
+      flush_tx(true);
+    }
+    size_t n = std::min(size - written, (size_t) SIM_TX_BUFFER - tx.size());
+    tx.insert(tx.end(), buffer + written, buffer + written + n);
+    written += n;
+  }
+  flush_tx(false);
+  return written;
+}
+
+static std::vector<IntervalTimer*> timers;
+
+bool IntervalTimer::begin(void (*funct)(), unsigned int microseconds) {
+  if (funct == nullptr || microseconds == 0) {
+    return false;
+  }
+  callback = funct;
+  period_us = microseconds;
+  next_us = now_us + microseconds;
+  if (!active) {
+    timers.push_back(this);
+    active = true;
+  }
+  return true;
+}
+
+void IntervalTimer::end() {
+  if (!active) {
+    return;
+  }
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i] == this) {
+      timers.erase(timers.begin() + i);
+      break;
+    }
+  }
+  active = false;
+}
+
+uint64_t IntervalTimer::next_due_us() {
+  uint64_t due = UINT64_MAX;
+  for (size_t i = 0; i < timers.size(); i++) {
+    due = std::min(due, timers[i]->next_us);
+  }
+  return due;
+}
+
+void IntervalTimer::run_until(uint64_t until_us) {
+  for (;;) {
+    IntervalTimer* due = nullptr;
+    for (size_t i = 0; i < timers.size(); i++) {
+      if (timers[i]->next_us <= until_us && (due == nullptr || timers[i]->next_us < due->next_us)) {
+        due = timers[i];
+      }
+    }
+    if (due == nullptr) {
+      return;
+    }
+    now_us = due->next_us;
+    due->next_us += due->period_us;
+    due->callback();
+  }
+}
+
+int Stream::timedRead() {
+  uint64_t start = now_us;
+  do {
+    if (available() > 0) {
+      return read();
+    }
+    /* Nothing yet, let the clock run while we wait */
+    sim_advance_us(SIM_IDLE_US);
+  } while (now_us - start < timeout_ms * 1000);
+  return -1;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String ret;
+  int c = timedRead();
+  while (c >= 0 && c != terminator) {
+    ret += (char) c;
+    c = timedRead();
+  }
+  return ret;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timedRead();
+    if (c < 0) break;
+    buffer[count++] = (char) c;
+  }
+  return count;
+}
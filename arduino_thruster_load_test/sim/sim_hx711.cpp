@@ -0,0 +1,103 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_hx711.cpp
+ * An HX711 on virtual time, for load_cell's driver to read in the simulator.
+ *
+ * @author Ali AlSaibie
+ */
+#include "Arduino.h"
+#include "IntervalTimer.h"
+#include "sim.h"
+#include <stdio.h>
+
+/* Conversions a second with RATE high, and the bridge's zero offset */
+#define HX711_PERIOD_US 12500
+#define HX711_OFFSET 8000
+/* PD_SCK held high this long powers the chip down */
+#define HX711_POWER_DOWN_US 60
+
+static IntervalTimer conversion_timer;
+/* The conversion DOUT shifts out, and the pulses clocked so far */
+static int32_t latched = 0;
+static uint8_t shifted = 0;
+static bool ready = false;
+static uint8_t clock_level = LOW;
+static uint64_t clock_rise_us = 0;
+
+static void convert() {
+  if (shifted > 0) {
+    /* Mid read, the data register is left alone */
+    return;
+  }
+  long counts = HX711_OFFSET + lround(sim_thrust_grams() * SIM_HX711_COUNTS_PER_GRAM);
+  latched = (int32_t) constrain(counts, -0x800000L, 0x7FFFFFL);
+  ready = true;
+  /* Falls only if the last one was read, which is the driver's cue */
+  sim_set_pin(SIM_HX711_DOUT_PIN, LOW);
+}
+
+/* Each rising edge shifts out the next bit, MSB first. The 25th sets DOUT
+ * high until the next conversion and keeps channel A at gain 128 */
+static void on_clock(uint8_t level) {
+  if (level == clock_level) {
+    return;
+  }
+  clock_level = level;
+  if (level == HIGH) {
+    clock_rise_us = sim_time_us();
+    if (!ready) {
+      return;
+    }
+    if (shifted < 24) {
+      sim_set_pin(SIM_HX711_DOUT_PIN, (latched >> (23 - shifted)) & 1);
+      shifted++;
+      return;
+    }
+    sim_set_pin(SIM_HX711_DOUT_PIN, HIGH);
+    shifted = 0;
+    ready = false;
+    return;
+  }
+  if (sim_time_us() - clock_rise_us >= HX711_POWER_DOWN_US) {
+    fprintf(stderr, "firmware_sim: HX711 clock held high %llu us, powered down\n",
+            (unsigned long long) (sim_time_us() - clock_rise_us));
+    sim_set_pin(SIM_HX711_DOUT_PIN, HIGH);
+    shifted = 0;
+    ready = false;
+  }
+}
+
+void sim_hx711_attach() {
+  sim_set_pin(SIM_HX711_DOUT_PIN, HIGH);
+  sim_on_write(SIM_HX711_SCK_PIN, on_clock);
+  conversion_timer.begin(convert, HX711_PERIOD_US);
+}
@@ -0,0 +1,130 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_main.cpp
+ * Runs the firmware on the host against a pty.
+ *
+ * @author Ali AlSaibie
+ */
+#include "Arduino.h"
+#include "sim.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+/*
+ * Usage: firmware_sim [--estop-at ms] [--realtime] [link]
+ *
+ * Prints the pty the firmware listens on, optionally symlinked to `link`,
+ * then runs setup() and loop() like the Teensy core would. Point the host
+ * at it with `thruster_load_test <pty>`. Exits when the host hangs up.
+ * An existing `link` is only replaced when it is a symlink itself.
+ * --estop-at presses the e-stop button `ms` of virtual time after the host
+ * connects, the host's --stop-bound-ms then checks the StopAck it gets.
+ * --realtime paces virtual time to the wall clock, for the host's adaptive
+ * dwell which times settling on its own clock.
+ */
+static int usage() {
+  fprintf(stderr, "Usage: firmware_sim [--estop-at ms] [--realtime] [link]\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  const char *link = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--estop-at") == 0 && i + 1 < argc) {
+      uint64_t at_us = strtoull(argv[++i], NULL, 10) * 1000;
+      sim_schedule_pin(SIM_ESTOP_PIN, LOW, at_us);
+      sim_schedule_pin(SIM_ESTOP_PIN, HIGH, at_us + SIM_ESTOP_HOLD_US);
+    }
+    else if (strcmp(argv[i], "--realtime") == 0) {
+      sim_set_realtime(true);
+    }
+    else if (argv[i][0] == '-' || link != nullptr) {
+      return usage();
+    }
+    else {
+      link = argv[i];
+    }
+  }
+  /* Only ever replaces a link we could have left behind */
+  struct stat st;
+  if (link != nullptr && lstat(link, &st) == 0 && !S_ISLNK(st.st_mode)) {
+    fprintf(stderr, "firmware_sim: %s exists and is not a symlink\n", link);
+    return 1;
+  }
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("firmware_sim: posix_openpt");
+    return 1;
+  }
+  const char *name = ptsname(master);
+
+  /* Raw on our end too, the firmware's bytes must arrive untouched */
+  int slave = open(name, O_RDWR | O_NOCTTY);
+  struct termios options;
+  tcgetattr(slave, &options);
+  cfmakeraw(&options);
+  tcsetattr(slave, TCSANOW, &options);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  if (link != nullptr) {
+    if (unlink(link) < 0 && errno != ENOENT) {
+      perror("firmware_sim: unlink");
+      return 1;
+    }
+    if (symlink(name, link) < 0) {
+      perror("firmware_sim: symlink");
+      return 1;
+    }
+    printf("%s -> %s\n", link, name);
+  }
+  else {
+    printf("%s\n", name);
+  }
+  fflush(stdout);
+
+  sim_attach_pty(master, slave);
+  sim_hx711_attach();
+  setup();
+  for (;;) {
+    loop();
+    yield();
+    sim_loop_done();
+  }
+  return 0;
+}
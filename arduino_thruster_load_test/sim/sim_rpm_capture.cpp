@@ -0,0 +1,81 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_rpm_capture.cpp
+ * rpm_capture's backend on virtual time, for the simulator.
+ *
+ * @author Ali AlSaibie
+ */
+#include "Arduino.h"
+#include "IntervalTimer.h"
+#include "rpm_capture_backend.h"
+#include "sim.h"
+
+/* Stands in for FTM1 counting microseconds. Each tick moves the rotor on
+ * and reports the marks it passed at the time it passed them, so edges
+ * land between ticks as they would on the pin */
+#define SIM_RPM_TICK_US 100
+/* The rotor's lag behind the ESC's command */
+#define SIM_ROTOR_TAU_US 80000.0
+
+static IntervalTimer rotor_timer;
+static double rotor_rpm = 0.0;
+/* Turns since the start, and the count of the last tick */
+static double turns = 0.0;
+static uint32_t tick_count = 0;
+
+static void rotor_tick() {
+  rotor_rpm += (sim_rotor_rpm() - rotor_rpm) * SIM_RPM_TICK_US / SIM_ROTOR_TAU_US;
+  double step = rotor_rpm / 60.0 * SIM_RPM_TICK_US / 1e6;
+  double next_mark = floor(turns) + 1.0;
+  while (step > 0.0 && turns + step >= next_mark) {
+    double at = (next_mark - turns) / step * SIM_RPM_TICK_US;
+    rpm_capture_edge_isr(tick_count + (uint32_t) lround(at));
+    next_mark += 1.0;
+  }
+  turns += step;
+  tick_count += SIM_RPM_TICK_US;
+  rpm_capture_tick_isr(tick_count);
+}
+
+uint32_t rpm_backend_start() {
+  rotor_rpm = sim_rotor_rpm();
+  turns = 0.0;
+  tick_count = 0;
+  if (!rotor_timer.begin(rotor_tick, SIM_RPM_TICK_US)) {
+    return 0;
+  }
+  return 1000000UL;
+}
+
+void rpm_backend_stop() {
+  rotor_timer.end();
+}
@@ -0,0 +1,260 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file stop_check.cpp
+ * Runs firmware_sim as a bare host would and checks that a Stop, sent from
+ * the host or the e-stop pin, is acted on within STOP_BOUND_US.
+ *
+ * @author Ali AlSaibie
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+/* What the firmware promises, in microseconds of its own clock */
+#define STOP_BOUND_US 5000
+/* Wall clock for the whole run, the sim runs well ahead of it */
+#define CHECK_TIMEOUT_MS 20000
+/* The pin is pressed this far into the run, after the ESC has armed */
+#define CHECK_ESTOP_AT_MS "3000"
+#define CHECK_STOP_ID 7
+
+static int64_t wall_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t deadline_ms = 0;
+static std::string rx;
+
+static bool send_line(int fd, const std::string &line) {
+  std::string out = line + "\n";
+  size_t written = 0;
+  while (written < out.size()) {
+    ssize_t n = write(fd, out.data() + written, out.size() - written);
+    if (n > 0) {
+      written += n;
+    }
+    else {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, 100) < 0 || wall_ms() > deadline_ms) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Next line from the firmware, false after `timeout_ms` or the deadline */
+static bool read_line(int fd, std::string &line, int timeout_ms) {
+  int64_t until = wall_ms() + timeout_ms;
+  if (until > deadline_ms) {
+    until = deadline_ms;
+  }
+  for (;;) {
+    size_t end = rx.find('\n');
+    if (end != std::string::npos) {
+      line = rx.substr(0, end);
+      rx.erase(0, end + 1);
+      return true;
+    }
+    int64_t remaining = until - wall_ms();
+    if (remaining <= 0) {
+      return false;
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, (int) remaining) > 0) {
+      char buffer[512];
+      ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        rx.append(buffer, n);
+      }
+    }
+  }
+}
+
+/* The number after "key": in a JSON line, -1 when it is not there */
+static long json_number(const std::string &line, const char *key) {
+  std::string needle = std::string("\"") + key + "\":";
+  size_t at = line.find(needle);
+  return at == std::string::npos ? -1 : strtol(line.c_str() + at + needle.size(), NULL, 10);
+}
+
+static std::string setpoints_line() {
+  std::string line = "{\"Event\":\"Setpoints\",\"V\":[";
+  for (int i = 0; i < 32; i++) {
+    line += i ? ",160" : "160";
+  }
+  return line + "]}";
+}
+
+static int open_link(const char *link) {
+  int fd = -1;
+  while (fd < 0 && wall_ms() < deadline_ms) {
+    fd = open(link, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+      usleep(10000);
+    }
+  }
+  if (fd >= 0) {
+    struct termios options;
+    tcgetattr(fd, &options);
+    cfmakeraw(&options);
+    tcsetattr(fd, TCSANOW, &options);
+  }
+  return fd;
+}
+
+/*
+ * Streams setpoints so the Stop has to get past a backlog of them, then
+ * waits for the StopAck and the final report.
+ */
+static int run_check(int fd, bool pin) {
+  std::string line;
+  bool acked = false;
+  for (int64_t resend = 0; !acked;) {
+    if (wall_ms() >= resend) {
+      send_line(fd, "{\"Event\":\"Handshake\",\"Framing\":\"JSON\"}");
+      resend = wall_ms() + 100;
+    }
+    if (!read_line(fd, line, 100)) {
+      if (wall_ms() >= deadline_ms) {
+        fprintf(stderr, "stop_check: no HandshakeAck\n");
+        return 1;
+      }
+      continue;
+    }
+    acked = line.find("HandshakeAck") != std::string::npos;
+  }
+
+  send_line(fd, "{\"Event\":\"Command\",\"StartCommand\":83,\"Type\":\"Stream\","
+                "\"Rate\":1000,\"SNo\":100000,\"ReportEvery\":20}");
+  for (int i = 0; i < 4; i++) {
+    send_line(fd, setpoints_line());
+  }
+
+  bool stop_sent = false;
+  long latency_us = -1;
+  while (read_line(fd, line, 5000)) {
+    if (!stop_sent && !pin && json_number(line, "SampleNo") > 0) {
+      /* Behind a backlog, in one write, the way a busy host sends it */
+      std::string burst;
+      for (int i = 0; i < 8; i++) {
+        burst += setpoints_line() + "\n";
+      }
+      burst += "{\"Event\":\"Stop\",\"Id\":" + std::to_string(CHECK_STOP_ID) + "}";
+      stop_sent = send_line(fd, burst);
+    }
+    if (line.find("\"StopAck\"") != std::string::npos) {
+      const char *source = pin ? "\"Pin\"" : "\"Serial\"";
+      long id = json_number(line, "Id");
+      latency_us = json_number(line, "LatencyUs");
+      printf("stop_check: %s\n", line.c_str());
+      if (line.find(source) == std::string::npos || id != (pin ? 0 : CHECK_STOP_ID)) {
+        fprintf(stderr, "stop_check: unexpected ack\n");
+        return 1;
+      }
+    }
+    if (latency_us >= 0 && line.find("\"TestFinished\":true") != std::string::npos) {
+      break;
+    }
+  }
+  if (latency_us < 0) {
+    fprintf(stderr, "stop_check: no StopAck\n");
+    return 1;
+  }
+  if (latency_us > STOP_BOUND_US) {
+    fprintf(stderr, "stop_check: stop took %ld us, the bound is %d us\n", latency_us,
+            STOP_BOUND_US);
+    return 1;
+  }
+  if (line.find("\"TestFinished\":true") == std::string::npos) {
+    fprintf(stderr, "stop_check: no final report after the StopAck\n");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Usage: stop_check <firmware_sim> serial|pin
+ */
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: stop_check <firmware_sim> serial|pin\n");
+    return 2;
+  }
+  bool pin = strcmp(argv[2], "pin") == 0;
+  deadline_ms = wall_ms() + CHECK_TIMEOUT_MS;
+
+  char dir[] = "/tmp/stop_check.XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("stop_check: mkdtemp");
+    return 1;
+  }
+  std::string link = std::string(dir) + "/tty";
+
+  pid_t sim = fork();
+  if (sim == 0) {
+    if (pin) {
+      execl(argv[1], argv[1], "--estop-at", CHECK_ESTOP_AT_MS, link.c_str(), (char *) NULL);
+    }
+    else {
+      execl(argv[1], argv[1], link.c_str(), (char *) NULL);
+    }
+    perror("stop_check: exec");
+    _exit(127);
+  }
+
+  int result = 1;
+  int fd = open_link(link.c_str());
+  if (fd < 0) {
+    fprintf(stderr, "stop_check: %s never came up\n", link.c_str());
+  }
+  else {
+    result = run_check(fd, pin);
+    close(fd);
+  }
+  kill(sim, SIGTERM);
+  waitpid(sim, NULL, 0);
+  unlink(link.c_str());
+  rmdir(dir);
+  return result;
+}
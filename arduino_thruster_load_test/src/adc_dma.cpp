@@ -0,0 +1,157 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file adc_dma.cpp
+ * Timer triggered ADC conversions, moved by DMA and decimated in loop().
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include "adc_dma.h"
+#include "adc_dma_backend.h"
+
+static volatile uint16_t ring[ADC_RING_SIZE];
+/* Both in conversions, whole sequences of `decimation` */
+static uint16_t half_len = 0;
+static uint16_t group_len = ADC_CHANNELS;
+static uint8_t decimation = 1;
+/* Halves the DMA has filled, counted by its interrupt */
+static volatile uint32_t halves = 0;
+/* Conversions adc_dma_next() has been through since the start, where
+ * that is in the ring, and the readings they made */
+static uint32_t read_pos = 0;
+static uint16_t ring_pos = 0;
+static uint32_t readings = 0;
+static uint32_t start_us = 0;
+static uint32_t reading_ns = 0;
+static uint32_t overruns = 0;
+static bool running = false;
+
+void adc_dma_half_isr() {
+  halves = halves + 1;
+}
+
+bool adc_dma_start(const adc_config &config) {
+  adc_dma_stop();
+  if (config.rate_hz == 0 || config.decimation == 0 ||
+      config.decimation > ADC_DECIMATION_MAX) {
+    return false;
+  }
+  uint8_t hw_average = config.hw_average > 1 ? config.hw_average : 1;
+  uint32_t conversions_hz = config.rate_hz * config.decimation * ADC_CHANNELS;
+  if ((uint64_t) conversions_hz * hw_average > ADC_MAX_RAW_HZ) {
+    return false;
+  }
+  decimation = config.decimation;
+  group_len = (uint16_t) (decimation * ADC_CHANNELS);
+  /* About ADC_HALF_US worth, but at least one reading and at most half the
+   * ring, so a reading never straddles the wrap */
+  uint32_t half = (uint32_t) ((uint64_t) conversions_hz * ADC_HALF_US / 1000000);
+  half = half / group_len * group_len;
+  uint32_t half_max = ADC_RING_SIZE / 2 / group_len * group_len;
+  half_len = (uint16_t) (half < group_len ? group_len : (half > half_max ? half_max : half));
+
+  halves = 0;
+  read_pos = 0;
+  ring_pos = 0;
+  readings = 0;
+  overruns = 0;
+  start_us = micros();
+  uint32_t period_ns = adc_backend_start(1000000000UL / conversions_hz, hw_average,
+                                         ring, (uint16_t) (2 * half_len));
+  if (period_ns == 0) {
+    return false;
+  }
+  reading_ns = period_ns * group_len;
+  running = true;
+  return true;
+}
+
+void adc_dma_stop() {
+  if (running) {
+    adc_backend_stop();
+    running = false;
+  }
+}
+
+static void next_group() {
+  read_pos += group_len;
+  ring_pos += group_len;
+  if (ring_pos == 2 * half_len) {
+    ring_pos = 0;
+  }
+  readings++;
+}
+
+bool adc_dma_next(adc_reading &reading) {
+  if (!running) {
+    return false;
+  }
+  uint32_t ready = halves * half_len;
+  /* The DMA is writing over what came a half before the last one it did */
+  if (ready - read_pos > half_len) {
+    uint32_t skip = ready - half_len - read_pos;
+    overruns += skip / group_len;
+    readings += skip / group_len;
+    read_pos += skip;
+    ring_pos = (uint16_t) ((ring_pos + skip) % (2 * half_len));
+  }
+  if (ready - read_pos < group_len) {
+    return false;
+  }
+  const volatile uint16_t *p = &ring[ring_pos];
+  uint32_t sum[ADC_CHANNELS] = {0};
+  for (uint8_t d = 0; d < decimation; d++) {
+    for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+      sum[c] += *p++;
+    }
+  }
+  if (halves * half_len - read_pos > half_len) {
+    /* Lapped while we were reading it */
+    overruns++;
+    next_group();
+    return false;
+  }
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    reading.value[c] = (uint16_t) ((sum[c] + decimation / 2) / decimation);
+  }
+  next_group();
+  reading.at_us = start_us + (uint32_t) ((uint64_t) readings * reading_ns / 1000);
+  return true;
+}
+
+uint32_t adc_dma_interval_ns() {
+  return reading_ns;
+}
+
+uint32_t adc_dma_overruns() {
+  return overruns;
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file adc_dma.h
+ * Timer triggered ADC conversions, moved by DMA and decimated in loop().
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* Conversions the DMA ring holds, in two halves */
+#define ADC_RING_SIZE 4096
+/* A half is handed over about this often, bounds how late a reading is */
+#define ADC_HALF_US 20000
+#define ADC_DECIMATION_MAX 64
+/* Conversions per second times hardware averaging, what ADC0 keeps up
+ * with at 12 bits */
+#define ADC_MAX_RAW_HZ 400000
+
+/* What each conversion of a sequence measures, in this order */
+enum ADC_CHANNEL {
+    ADC_CURRENT = 0,
+    ADC_VOLTAGE,
+    ADC_TEMPERATURE,
+    ADC_CHANNELS
+};
+
+struct adc_config {
+    /* Readings per second, after decimation */
+    uint32_t rate_hz;
+    /* Conversions the ADC averages in hardware: 1 (off), 4, 8, 16 or 32 */
+    uint8_t hw_average;
+    /* Sequences averaged into each reading */
+    uint8_t decimation;
+};
+
+struct adc_reading {
+    /* micros() at the reading's last conversion */
+    uint32_t at_us;
+    /* 12 bit counts */
+    uint16_t value[ADC_CHANNELS];
+};
+
+/*
+ * A hardware timer (FTM2) triggers ADC0 at rate_hz * decimation *
+ * ADC_CHANNELS conversions a second. One DMA channel moves each result
+ * into a ring and a second, linked to it, points the ADC at the next
+ * channel, so no conversion costs the CPU anything. The only interrupt is
+ * the DMA's, twice per lap of the ring.
+ *
+ * adc_dma_next(), from loop(), averages `decimation` sequences out of the
+ * halves the DMA has finished into one reading per channel. If loop() falls
+ * a whole half behind, the readings the DMA overwrote are skipped and
+ * counted; the ones after keep their times.
+ */
+bool adc_dma_start(const adc_config &config);
+void adc_dma_stop();
+bool adc_dma_next(adc_reading &reading);
+/* Time between readings, as near as the timer gets to 1 / rate_hz */
+uint32_t adc_dma_interval_ns();
+/* Readings lost to loop() falling behind, since the start */
+uint32_t adc_dma_overruns();
@@ -0,0 +1,52 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file adc_dma_backend.h
+ * What adc_dma needs from the hardware, or from the simulator.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include "adc_dma.h"
+
+/*
+ * Converts the ADC_CHANNELS channels in turn, one conversion every
+ * `period_ns` as near as the timer gets, averaging `hw_average` in
+ * hardware. Results go to ring[0], ring[1], ... wrapping at `length`, and
+ * adc_dma_half_isr() runs each time a half of it fills. Returns the period
+ * it got, 0 if it cannot run that fast or slow.
+ */
+uint32_t adc_backend_start(uint32_t period_ns, uint8_t hw_average,
+                           volatile uint16_t *ring, uint16_t length);
+void adc_backend_stop();
+
+/* Called by the backend, from its interrupt */
+void adc_dma_half_isr();
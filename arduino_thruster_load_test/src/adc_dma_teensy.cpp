@@ -0,0 +1,118 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file adc_dma_teensy.cpp
+ * adc_dma on a Teensy 3.1: FTM2 triggers ADC0, DMA moves the results.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include "adc_dma_backend.h"
+
+/* ADC0 inputs in ADC_CHANNEL order: the current sense amplifier on A0, the
+ * supply divider on A1 and the chip's own temperature sensor */
+static const uint32_t adc_inputs[ADC_CHANNELS] = {
+    ADC_SC1_ADCH(5), ADC_SC1_ADCH(14), ADC_SC1_ADCH(26)
+};
+/* What the mux channel writes after each conversion: the input after it */
+static uint32_t next_input[ADC_CHANNELS];
+
+static DMAChannel result_dma;
+static DMAChannel mux_dma;
+
+static void result_isr() {
+  result_dma.clearInterrupt();
+  adc_dma_half_isr();
+}
+
+uint32_t adc_backend_start(uint32_t period_ns, uint8_t hw_average,
+                           volatile uint16_t *ring, uint16_t length) {
+  /* FTM2 counts of F_BUS, prescaled to fit its 16 bit modulus. Not the
+   * PDB, Teensy's Servo library times the ESC pulses with it */
+  uint64_t cycles = (uint64_t) period_ns * F_BUS / 1000000000UL;
+  uint8_t prescale = 0;
+  while ((cycles >> prescale) > 65536 && prescale < 7) {
+    prescale++;
+  }
+  uint32_t mod = (uint32_t) ((cycles + ((1UL << prescale) >> 1)) >> prescale);
+  if (mod == 0 || mod > 65536) {
+    return 0;
+  }
+
+  /* The core sets up and calibrates ADC0, then it is ours */
+  analogReadResolution(12);
+  analogReadAveraging(hw_average);
+  analogRead(A0);
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    next_input[c] = adc_inputs[(c + 1) % ADC_CHANNELS];
+  }
+
+  result_dma.source((volatile uint16_t &) ADC0_RA);
+  result_dma.destinationBuffer(ring, length * sizeof(uint16_t));
+  result_dma.interruptAtHalf();
+  result_dma.interruptAtCompletion();
+  result_dma.attachInterrupt(result_isr);
+  result_dma.triggerAtHardwareEvent(DMAMUX_SOURCE_ADC0);
+
+  /* Each result moved has the ADC switch inputs before the next trigger */
+  mux_dma.sourceBuffer(next_input, sizeof(next_input));
+  mux_dma.destination(ADC0_SC1A);
+  mux_dma.triggerAtTransfersOf(result_dma);
+  mux_dma.triggerAtCompletionOf(result_dma);
+
+  ADC0_SC1A = adc_inputs[0];
+  ADC0_SC2 |= ADC_SC2_ADTRG | ADC_SC2_DMAEN;
+  /* ADC0 takes its trigger from FTM2 instead of the PDB */
+  SIM_SOPT7 = SIM_SOPT7_ADC0ALTTRGEN | SIM_SOPT7_ADC0TRGSEL(10);
+  mux_dma.enable();
+  result_dma.enable();
+
+  /* The core set FTM2 up for analogWrite() on pins 25 and 32, neither
+   * uses it. Every reload of the counter is a trigger */
+  FTM2_SC = 0;
+  FTM2_CNTIN = 0;
+  FTM2_CNT = 0;
+  FTM2_MOD = mod - 1;
+  FTM2_EXTTRIG = FTM_EXTTRIG_INITTRIGEN;
+  FTM2_SC = FTM_SC_CLKS(1) | FTM_SC_PS(prescale);
+  return (uint32_t) (((uint64_t) mod << prescale) * 1000000000UL / F_BUS);
+}
+
+void adc_backend_stop() {
+  FTM2_SC = 0;
+  FTM2_EXTTRIG = 0;
+  result_dma.disable();
+  mux_dma.disable();
+  /* Back to software triggers, analogRead() works again */
+  ADC0_SC2 &= ~(ADC_SC2_ADTRG | ADC_SC2_DMAEN);
+  SIM_SOPT7 = 0;
+}
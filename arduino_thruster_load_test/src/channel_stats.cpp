@@ -0,0 +1,70 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file channel_stats.cpp
+ * Running statistics of an ADC channel, in fixed point.
+ *
+ * @author Ali AlSaibie
+ */
+#include <math.h>
+#include "channel_stats.h"
+
+#define SUMMARY_SHIFT (CHANNEL_STATS_FRACTION - CHANNEL_SUMMARY_FRACTION)
+
+void channel_stats_reset(channel_stats &s) {
+  s.n = 0;
+  s.mean = 0;
+  s.m2 = 0;
+  s.min = 0;
+  s.max = 0;
+}
+
+channel_summary channel_stats_summary(const channel_stats &s) {
+  channel_summary out;
+  out.n = s.n;
+  out.min = s.min;
+  out.max = s.max;
+  if (s.n == 0) {
+    out.mean = out.rms = 0;
+    out.variance = 0;
+    return out;
+  }
+  uint64_t variance = s.m2 / s.n;
+  int32_t mean = s.mean > 0 ? s.mean : 0;
+  out.mean = (uint16_t) ((mean + (1 << (SUMMARY_SHIFT - 1))) >> SUMMARY_SHIFT);
+  out.variance = (uint32_t) ((variance + (1 << (SUMMARY_SHIFT - 1))) >> SUMMARY_SHIFT);
+  /* Once a step, so a double is fine here: mean square is mean^2 + variance */
+  double scale = 1.0 / (1 << CHANNEL_STATS_FRACTION);
+  double mean_counts = mean * scale;
+  double rms = sqrt(mean_counts * mean_counts + variance * scale);
+  out.rms = (uint16_t) lround(rms * (1 << CHANNEL_SUMMARY_FRACTION));
+  return out;
+}
@@ -0,0 +1,91 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file channel_stats.h
+ * Running mean, min, max, variance and RMS of an ADC channel, in fixed
+ * point.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* Fractional bits of the running mean and M2, and of what is sent */
+#define CHANNEL_STATS_FRACTION 16
+#define CHANNEL_SUMMARY_FRACTION 4
+
+/*
+ * Welford's update on 12 bit counts: the mean is Q16 in an int32, M2 (the
+ * sum of squared deviations) Q16 in a uint64. A reading costs one 32 bit
+ * divide and one 32x32 multiply, nothing that needs the FPU the Teensy
+ * does not have. The divide rounds, so the mean's error is a random walk
+ * rather than a drift towards zero. M2 stays in range for well over a
+ * million full scale readings.
+ */
+struct channel_stats {
+    uint32_t n;
+    int32_t mean;
+    uint64_t m2;
+    uint16_t min;
+    uint16_t max;
+};
+
+/* A window's statistics, in counts with CHANNEL_SUMMARY_FRACTION bits */
+struct channel_summary {
+    uint32_t n;
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t rms;
+    uint32_t variance;
+};
+
+void channel_stats_reset(channel_stats &s);
+/* Population variance, over the readings since the reset */
+channel_summary channel_stats_summary(const channel_stats &s);
+
+inline void channel_stats_add(channel_stats &s, uint16_t counts) {
+  int32_t x = (int32_t) counts << CHANNEL_STATS_FRACTION;
+  if (s.n == 0) {
+    s.min = s.max = counts;
+  }
+  else if (counts < s.min) {
+    s.min = counts;
+  }
+  else if (counts > s.max) {
+    s.max = counts;
+  }
+  s.n++;
+  int32_t n = (int32_t) s.n;
+  int32_t delta = x - s.mean;
+  s.mean += (delta + (delta < 0 ? -n / 2 : n / 2)) / n;
+  /* Same sign as delta, or 0, the mean never steps past x */
+  s.m2 += (uint64_t) (((int64_t) delta * (x - s.mean)) >> CHANNEL_STATS_FRACTION);
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file cobs_frame.cpp
+ * COBS delimited, CRC16 checked binary frames shared with the host.
+ *
+ * @author Ali AlSaibie
+ */
+#include "cobs_frame.h"
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t length, uint16_t crc) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t encode_frame(uint8_t type, const uint8_t *payload, size_t length,
+                    uint8_t *out, size_t out_size) {
+  if (length > FRAME_MAX_PAYLOAD || out_size < length + 5) {
+    return 0;
+  }
+  uint8_t raw[1 + FRAME_MAX_PAYLOAD + 2];
+  raw[0] = type;
+  for (size_t i = 0; i < length; i++) {
+    raw[1 + i] = payload[i];
+  }
+  put_u16(&raw[1 + length], crc16_ccitt(raw, 1 + length));
+  size_t n = length + 3;
+
+  /* COBS, payloads are far below 254 bytes so no block splitting */
+  size_t code_index = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < n; i++) {
+    if (raw[i] == 0) {
+      out[code_index] = code;
+      code = 1;
+      code_index = o++;
+    }
+    else {
+      out[o++] = raw[i];
+      code++;
+    }
+  }
+  out[code_index] = code;
+  out[o++] = FRAME_DELIMITER;
+  return o;
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file cobs_frame.h
+ * COBS delimited, CRC16 checked binary frames shared with the host.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On the wire a frame is COBS(type, payload, crc16) followed by a 0x00
+ * delimiter. The CRC is CRC-16/CCITT-FALSE over type and payload, stored
+ * little-endian, as are all payload fields. Keep in sync with the host's
+ * cobs_frame.h.
+ */
+enum FRAMING {
+    FRAMING_JSON = 0,
+    FRAMING_COBS
+};
+
+enum FRAME_TYPE {
+    FRAME_TELEMETRY = 0x01,
+    FRAME_CURRENT_BATCH = 0x02,
+    FRAME_STOP_ACK = 0x03,
+    FRAME_BUFFER_STATUS = 0x04,
+    FRAME_TX_STATS = 0x05,
+    FRAME_ANALOG = 0x06,
+    FRAME_SUMMARY = 0x07,
+    FRAME_LOAD = 0x08
+};
+
+#define FRAME_DELIMITER 0x00
+#define FRAME_MAX_PAYLOAD 80
+#define FRAME_MAX_ENCODED (1 + FRAME_MAX_PAYLOAD + 2 + 2)
+
+/* FRAME_TELEMETRY payload: u16 SampleNo, u16 PWM, u16 Current, u8 flags,
+ * then u16 RPM when the flags say so */
+#define TELEMETRY_PAYLOAD_SIZE 7
+#define TELEMETRY_RPM_PAYLOAD_SIZE 9
+#define TELEMETRY_FLAG_FINISHED 0x01
+#define TELEMETRY_FLAG_RPM 0x02
+
+/* FRAME_CURRENT_BATCH payload: u32 T0 (micros() of the first sample),
+ * u16 Dt (us between samples), u16 Seq, u8 Lost (batches dropped right
+ * before this one), u8 N, then N u16 ADC counts */
+#define CURRENT_BATCH_HEADER_SIZE 10
+
+/* FRAME_STOP_ACK payload: u16 Id (0 for the e-stop pin), u8 Source,
+ * u32 LatencyUs (stop request to this ack), u32 LoopMaxUs (longest pass
+ * of loop() so far) */
+#define STOP_ACK_PAYLOAD_SIZE 11
+
+/* FRAME_BUFFER_STATUS payload: u32 Consumed (setpoints played out), u16
+ * Level, u16 Size, u16 Underruns, u16 Overflows */
+#define BUFFER_STATUS_PAYLOAD_SIZE 12
+
+/* FRAME_TX_STATS payload: u32 Dropped (messages), u32 DroppedBytes, u16 Peak
+ * (most bytes queued), u32 BlockedUs (time spent waiting for Serial) */
+#define TX_STATS_PAYLOAD_SIZE 14
+
+/* FRAME_ANALOG payload: u32 T0 (micros() of the first reading), u16 N
+ * (readings averaged), u16 Voltage, u16 Temp (mean ADC counts) */
+#define ANALOG_PAYLOAD_SIZE 10
+
+/* FRAME_SUMMARY payload, one channel over one step: u16 SampleNo, u8 Ch
+ * (0 current, 1 voltage, 2 temperature), u32 N (readings), u16 Min, u16 Max
+ * (counts), u16 Mean, u32 Var, u16 Rms (counts, counts^2, counts, all
+ * sixteenths) */
+#define SUMMARY_PAYLOAD_SIZE 19
+
+/* FRAME_LOAD payload: u32 T (micros() when the HX711 had the conversion
+ * ready), i32 Counts (signed 24 bit) */
+#define LOAD_PAYLOAD_SIZE 8
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+
+/* Encodes type, payload and crc into out, delimiter included. Returns the
+ * number of bytes to send, 0 if the payload is too big */
+size_t encode_frame(uint8_t type, const uint8_t *payload, size_t length,
+                    uint8_t *out, size_t out_size);
+
+inline void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t) v;
+  p[1] = (uint8_t) (v >> 8);
+}
+
+inline void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, (uint16_t) v);
+  put_u16(p + 2, (uint16_t) (v >> 16));
+}
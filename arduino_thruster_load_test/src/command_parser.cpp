@@ -0,0 +1,315 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file command_parser.cpp
+ * Host commands, tokenized a byte at a time as they come off Serial.
+ *
+ * @author Ali AlSaibie
+ */
+#include <string.h>
+#include <Arduino.h>
+#include "command_parser.h"
+
+/* Not fields: "V", whose numbers go to values, and keys we skip */
+#define FIELD_VALUES CMD_FIELD_COUNT
+#define FIELD_SKIP (CMD_FIELD_COUNT + 1)
+/* Saturates there, no field needs more */
+#define NUMBER_MAX 1000000000L
+
+enum PARSE_STATE {
+    P_START = 0,
+    P_KEY_OR_END,
+    P_KEY_START,
+    P_KEY,
+    P_COLON,
+    P_VALUE,
+    P_STRING,
+    P_NUMBER,
+    P_FRACTION,
+    P_LITERAL,
+    P_ARRAY_VALUE,
+    P_ARRAY_NUMBER,
+    P_ARRAY_NEXT,
+    P_NEXT,
+    P_DONE,
+    P_ERROR
+};
+
+static uint8_t ring[RX_RING_SIZE];
+static uint32_t ring_head = 0;
+static uint32_t ring_tail = 0;
+
+/* micros() of each read into the ring and where its bytes end, so a line
+ * is timed from when its first byte left Serial, not from when it parsed */
+static uint32_t stamp_end[RX_STAMPS];
+static uint32_t stamp_us[RX_STAMPS];
+static uint32_t stamp_head = 0;
+static uint32_t stamp_tail = 0;
+static bool line_started = false;
+static uint32_t line_us = 0;
+
+static PARSE_STATE state = P_START;
+static command cmd;
+static uint8_t key = FIELD_SKIP;
+static uint32_t hash = 0;
+static int32_t number = 0;
+static bool negative = false;
+
+static uint8_t field_of(uint32_t key_hash) {
+  switch (key_hash) {
+    case command_hash("Event"): return CMD_EVENT;
+    case command_hash("Id"): return CMD_ID;
+    case command_hash("Step"): return CMD_STEP;
+    case command_hash("Framing"): return CMD_FRAMING;
+    case command_hash("Offset"): return CMD_OFFSET;
+    case command_hash("Length"): return CMD_LENGTH;
+    case command_hash("End"): return CMD_END;
+    case command_hash("StartCommand"): return CMD_START_COMMAND;
+    case command_hash("Type"): return CMD_TYPE;
+    case command_hash("SNo"): return CMD_SNO;
+    case command_hash("MaxDwell"): return CMD_MAX_DWELL;
+    case command_hash("MinDwell"): return CMD_MIN_DWELL;
+    case command_hash("CurrentRate"): return CMD_CURRENT_RATE;
+    case command_hash("CurrentBatch"): return CMD_CURRENT_BATCH;
+    case command_hash("Amp"): return CMD_AMP;
+    case command_hash("Cycles"): return CMD_CYCLES;
+    case command_hash("CyclesEnd"): return CMD_CYCLES_END;
+    case command_hash("Levels"): return CMD_LEVELS;
+    case command_hash("Rate"): return CMD_RATE;
+    case command_hash("ReportEvery"): return CMD_REPORT_EVERY;
+    case command_hash("Policy"): return CMD_POLICY;
+    case command_hash("Oversample"): return CMD_OVERSAMPLE;
+    case command_hash("Decimate"): return CMD_DECIMATE;
+    case command_hash("CurrentMode"): return CMD_CURRENT_MODE;
+    case command_hash("LoadCell"): return CMD_LOAD_CELL;
+    case command_hash("RpmPulses"): return CMD_RPM_PULSES;
+    case command_hash("V"): return FIELD_VALUES;
+    default: return FIELD_SKIP;
+  }
+}
+
+static inline bool is_space(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(uint8_t c) {
+  return c >= '0' && c <= '9';
+}
+
+static inline void hash_step(uint8_t c) {
+  hash = (hash ^ c) * 16777619u;
+}
+
+static inline void set_field(uint32_t value) {
+  if (key < CMD_FIELD_COUNT) {
+    cmd.field[key] = value;
+  }
+}
+
+static void start_number(uint8_t c) {
+  negative = c == '-';
+  number = negative ? 0 : c - '0';
+}
+
+static void add_digit(uint8_t c) {
+  if (number < NUMBER_MAX) {
+    number = number * 10 + (c - '0');
+  }
+}
+
+static inline int32_t number_value() {
+  return negative ? -number : number;
+}
+
+/* A scalar ended on c, which is whatever came after it */
+static PARSE_STATE end_scalar(uint8_t c, uint32_t value) {
+  set_field(value);
+  if (is_space(c)) return P_NEXT;
+  if (c == ',') return P_KEY_START;
+  if (c == '}') return P_DONE;
+  return P_ERROR;
+}
+
+static bool push_value() {
+  if (key != FIELD_VALUES) {
+    /* Only "V" is kept, any other array is skipped */
+    return true;
+  }
+  if (cmd.count == COMMAND_ARRAY_MAX) {
+    return false;
+  }
+  cmd.values[cmd.count++] = (int16_t) number_value();
+  return true;
+}
+
+static PARSE_STATE feed(uint8_t c) {
+  switch (state) {
+    case P_START:
+      if (is_space(c)) return P_START;
+      if (c != '{') return P_ERROR;
+      memset(&cmd, 0, sizeof(cmd));
+      return P_KEY_OR_END;
+    case P_KEY_OR_END:
+      if (c == '}') return P_DONE;
+      /* fall through */
+    case P_KEY_START:
+      if (is_space(c)) return state;
+      if (c != '"') return P_ERROR;
+      hash = command_hash("");
+      return P_KEY;
+    case P_KEY:
+      if (c == '\\') return P_ERROR;
+      if (c != '"') {
+        hash_step(c);
+        return P_KEY;
+      }
+      key = field_of(hash);
+      return P_COLON;
+    case P_COLON:
+      if (is_space(c)) return P_COLON;
+      return c == ':' ? P_VALUE : P_ERROR;
+    case P_VALUE:
+      if (is_space(c)) return P_VALUE;
+      if (c == '"') {
+        hash = command_hash("");
+        return P_STRING;
+      }
+      if (c == '-' || is_digit(c)) {
+        start_number(c);
+        return P_NUMBER;
+      }
+      if (c == 't' || c == 'f' || c == 'n') {
+        number = c == 't';
+        return P_LITERAL;
+      }
+      return c == '[' ? P_ARRAY_VALUE : P_ERROR;
+    case P_STRING:
+      if (c == '\\') return P_ERROR;
+      if (c == '"') {
+        set_field(hash);
+        return P_NEXT;
+      }
+      hash_step(c);
+      return P_STRING;
+    case P_NUMBER:
+      if (is_digit(c)) {
+        add_digit(c);
+        return P_NUMBER;
+      }
+      if (c == '.') return P_FRACTION;
+      return end_scalar(c, (uint32_t) number_value());
+    case P_FRACTION:
+      if (is_digit(c)) return P_FRACTION;
+      return end_scalar(c, (uint32_t) number_value());
+    case P_LITERAL:
+      if (c >= 'a' && c <= 'z') return P_LITERAL;
+      return end_scalar(c, (uint32_t) number);
+    case P_ARRAY_VALUE:
+      if (is_space(c)) return P_ARRAY_VALUE;
+      if (c == ']') return P_NEXT;
+      if (c == '-' || is_digit(c)) {
+        start_number(c);
+        return P_ARRAY_NUMBER;
+      }
+      return P_ERROR;
+    case P_ARRAY_NUMBER:
+      if (is_digit(c)) {
+        add_digit(c);
+        return P_ARRAY_NUMBER;
+      }
+      if (!push_value()) return P_ERROR;
+      if (c == ',') return P_ARRAY_VALUE;
+      if (c == ']') return P_NEXT;
+      return is_space(c) ? P_ARRAY_NEXT : P_ERROR;
+    case P_ARRAY_NEXT:
+      if (is_space(c)) return P_ARRAY_NEXT;
+      if (c == ',') return P_ARRAY_VALUE;
+      return c == ']' ? P_NEXT : P_ERROR;
+    case P_NEXT:
+      if (is_space(c)) return P_NEXT;
+      if (c == ',') return P_KEY_START;
+      return c == '}' ? P_DONE : P_ERROR;
+    case P_DONE:
+      return is_space(c) ? P_DONE : P_ERROR;
+    default:
+      return P_ERROR;
+  }
+}
+
+bool command_parser_poll(Stream &serial, unsigned int budget) {
+  /* Contiguous free space only, the rest waits for the next poll */
+  uint32_t space = RX_RING_SIZE - (ring_head - ring_tail);
+  uint32_t to_end = RX_RING_SIZE - ring_head % RX_RING_SIZE;
+  int available = serial.available();
+  if (available > 0 && space > 0 && stamp_head - stamp_tail < RX_STAMPS) {
+    uint32_t n = (uint32_t) available;
+    n = n < space ? n : space;
+    n = n < to_end ? n : to_end;
+    uint32_t now = micros();
+    n = serial.readBytes((char *) &ring[ring_head % RX_RING_SIZE], n);
+    if (n > 0) {
+      ring_head += n;
+      stamp_end[stamp_head % RX_STAMPS] = ring_head;
+      stamp_us[stamp_head % RX_STAMPS] = now;
+      stamp_head++;
+    }
+  }
+
+  while (ring_tail != ring_head && budget-- > 0) {
+    while ((int32_t) (stamp_end[stamp_tail % RX_STAMPS] - ring_tail) <= 0) {
+      stamp_tail++;
+    }
+    if (!line_started) {
+      line_us = stamp_us[stamp_tail % RX_STAMPS];
+      line_started = true;
+    }
+    uint8_t c = ring[ring_tail++ % RX_RING_SIZE];
+    if (c == '\n') {
+      bool complete = state == P_DONE;
+      state = P_START;
+      line_started = false;
+      if (complete) {
+        return true;
+      }
+      continue;
+    }
+    state = feed(c);
+  }
+  return false;
+}
+
+const command &command_parser_command() {
+  return cmd;
+}
+
+uint32_t command_parser_line_us() {
+  return line_us;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file command_parser.h
+ * Host commands, tokenized a byte at a time as they come off Serial.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <Stream.h>
+
+/* Bytes held between Serial and the parser, a power of two */
+#define RX_RING_SIZE 256
+/* Reads from Serial the ring can hold at once, each one is timestamped */
+#define RX_STAMPS 16
+/* Longest array value, the Table and Setpoints chunks */
+#define COMMAND_ARRAY_MAX 32
+
+/* The members the firmware knows, anything else is skipped */
+enum COMMAND_FIELD {
+    CMD_EVENT = 0,
+    CMD_ID,
+    CMD_STEP,
+    CMD_FRAMING,
+    CMD_OFFSET,
+    CMD_LENGTH,
+    CMD_END,
+    CMD_START_COMMAND,
+    CMD_TYPE,
+    CMD_SNO,
+    CMD_MAX_DWELL,
+    CMD_MIN_DWELL,
+    CMD_CURRENT_RATE,
+    CMD_CURRENT_BATCH,
+    CMD_AMP,
+    CMD_CYCLES,
+    CMD_CYCLES_END,
+    CMD_LEVELS,
+    CMD_RATE,
+    CMD_REPORT_EVERY,
+    CMD_POLICY,
+    CMD_OVERSAMPLE,
+    CMD_DECIMATE,
+    CMD_CURRENT_MODE,
+    CMD_LOAD_CELL,
+    CMD_RPM_PULSES,
+    CMD_FIELD_COUNT
+};
+
+/* FNV-1a, what string values are kept as. Compare against it with
+ * command.field[CMD_EVENT] == command_hash("Stop") */
+constexpr uint32_t command_hash(const char *s, uint32_t h = 2166136261u) {
+  return *s ? command_hash(s + 1, (h ^ (uint8_t) *s) * 16777619u) : h;
+}
+
+/*
+ * One flat JSON object, as the host sends it. Numbers are integers, any
+ * fraction is dropped, true is 1, and strings are their command_hash().
+ * Members that were not there read 0, like ArduinoJson's did.
+ */
+struct command {
+    uint32_t field[CMD_FIELD_COUNT];
+    /* The "V" array */
+    int16_t values[COMMAND_ARRAY_MAX];
+    uint8_t count;
+};
+
+/*
+ * Moves what Serial has into the ring with one readBytes(), then feeds at
+ * most `budget` bytes of it to the tokenizer. Every byte costs a constant
+ * few dozen cycles: a state switch plus a hash step, a digit or, at the end
+ * of a key, one switch over the known keys; nothing allocates and nothing
+ * waits. Returns true as soon as a line completes a valid command, which
+ * stays in command_parser_command() until the next poll. Malformed lines,
+ * nesting, escapes and arrays over COMMAND_ARRAY_MAX are dropped whole at
+ * their '\n'.
+ */
+bool command_parser_poll(Stream &serial, unsigned int budget);
+const command &command_parser_command();
+/* micros() when the first byte of that command's line was read from
+ * Serial, at most one poll after it arrived */
+uint32_t command_parser_line_us();
@@ -0,0 +1,291 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file current_stream.cpp
+ * Timer driven current sampling, sent to the host in batches.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include "current_stream.h"
+#include "telemetry_writer.h"
+#include "tx_buffer.h"
+
+struct current_batch {
+    uint32_t start_us;
+    uint16_t seq;
+    uint8_t lost;
+    uint8_t count;
+    uint16_t samples[CURRENT_BATCH_MAX];
+};
+
+static current_batch batches[CURRENT_BATCHES];
+/* collect() fills batches[head], the loop sends batches[tail] */
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static uint8_t lost = 0;
+static uint16_t next_seq = 0;
+static uint8_t batch_len = CURRENT_BATCH_MAX;
+static uint16_t interval_us = 0;
+static uint32_t adc_overruns = 0;
+static uint16_t latest = 0;
+/* Voltage and temperature, summed until the next Analog report */
+static uint32_t analog_sum[ADC_CHANNELS];
+static uint16_t analog_count = 0;
+static uint32_t analog_since_us = 0;
+static uint8_t mode = CURRENT_RAW;
+/* Since current_stream_window(), with CURRENT_SUMMARY */
+static channel_stats window[ADC_CHANNELS];
+static bool running = false;
+
+static void count_lost(uint32_t batches) {
+  lost = (uint8_t) (lost + batches < 255 ? lost + batches : 255);
+}
+
+/* Moves the readings adc_dma has ready into batches and the statistics
+ * window. Once the batches are all full the rest wait in adc_dma's ring,
+ * which holds more */
+static void collect() {
+  bool raw = mode & CURRENT_RAW;
+  bool summary = mode & CURRENT_SUMMARY;
+  adc_reading r;
+  while ((!raw || head - tail < CURRENT_BATCHES - 1) && adc_dma_next(r)) {
+    latest = r.value[ADC_CURRENT];
+    if (summary) {
+      for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+        channel_stats_add(window[c], r.value[c]);
+      }
+    }
+    if (!raw) {
+      continue;
+    }
+    current_batch &b = batches[head % CURRENT_BATCHES];
+    if (adc_dma_overruns() != adc_overruns) {
+      /* Readings went missing, the batch they were in would lie about
+       * its times */
+      uint32_t missed = adc_dma_overruns() - adc_overruns;
+      adc_overruns = adc_dma_overruns();
+      count_lost((b.count ? 1 : 0) + missed / batch_len);
+      b.count = 0;
+    }
+    if (analog_count == 0) {
+      analog_since_us = r.at_us;
+    }
+    for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+      analog_sum[c] += r.value[c];
+    }
+    if (analog_count < 65535) {
+      analog_count++;
+    }
+
+    if (b.count == 0) {
+      b.start_us = r.at_us;
+    }
+    b.samples[b.count++] = r.value[ADC_CURRENT];
+    if (b.count < batch_len) {
+      continue;
+    }
+    b.seq = next_seq++;
+    b.lost = lost;
+    lost = 0;
+    head = head + 1;
+    batches[head % CURRENT_BATCHES].count = 0;
+  }
+}
+
+bool current_stream_start(const adc_config &adc, uint8_t batch_size, CURRENT_MODE mode_) {
+  current_stream_stop();
+  if (batch_size == 0) {
+    return false;
+  }
+  batch_len = batch_size < CURRENT_BATCH_MAX ? batch_size : CURRENT_BATCH_MAX;
+  head = tail = 0;
+  lost = 0;
+  next_seq = 0;
+  batches[0].count = 0;
+  adc_overruns = 0;
+  latest = 0;
+  memset(analog_sum, 0, sizeof(analog_sum));
+  analog_count = 0;
+  mode = mode_;
+  current_stream_window();
+  running = adc_dma_start(adc);
+  interval_us = (uint16_t) ((adc_dma_interval_ns() + 500) / 1000);
+  return running;
+}
+
+void current_stream_stop() {
+  if (running) {
+    adc_dma_stop();
+    running = false;
+  }
+}
+
+bool current_stream_running() {
+  return running;
+}
+
+uint16_t current_stream_latest() {
+  return latest;
+}
+
+void current_stream_window() {
+  if (running) {
+    /* What came before the step is not part of it */
+    collect();
+  }
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    channel_stats_reset(window[c]);
+  }
+}
+
+bool current_stream_summary(channel_summary summary[ADC_CHANNELS]) {
+  if (!(mode & CURRENT_SUMMARY)) {
+    return false;
+  }
+  if (running) {
+    collect();
+  }
+  if (window[ADC_CURRENT].n == 0) {
+    return false;
+  }
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    summary[c] = channel_stats_summary(window[c]);
+  }
+  return true;
+}
+
+TELEMETRY_EVENT(e_analog, "Analog");
+TELEMETRY_FIELD(f_t0, "T0", uint32_t);
+TELEMETRY_FIELD(f_n, "N", uint32_t);
+TELEMETRY_FIELD(f_voltage, "Voltage", uint32_t);
+TELEMETRY_FIELD(f_temp, "Temp", uint32_t);
+typedef telemetry_schema<e_analog, f_t0, f_n, f_voltage, f_temp> analog_line;
+
+/* Means of the other channels since the last one, if there is room */
+static void send_analog(FRAMING framing) {
+  uint16_t voltage = (uint16_t) (analog_sum[ADC_VOLTAGE] / analog_count);
+  uint16_t temp = (uint16_t) (analog_sum[ADC_TEMPERATURE] / analog_count);
+  if (framing == FRAMING_COBS) {
+    uint8_t payload[ANALOG_PAYLOAD_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    put_u32(&payload[0], analog_since_us);
+    put_u16(&payload[4], analog_count);
+    put_u16(&payload[6], voltage);
+    put_u16(&payload[8], temp);
+    size_t n = encode_frame(FRAME_ANALOG, payload, sizeof(payload), frame, sizeof(frame));
+    if (tx_room() < n) {
+      return;
+    }
+    tx_send(frame, n);
+  }
+  else {
+    char line[analog_line::max_size];
+    size_t n = analog_line::write(line, analog_since_us, analog_count, voltage, temp);
+    if (tx_room() < n) {
+      return;
+    }
+    tx_send((const uint8_t *) line, n);
+  }
+  memset(analog_sum, 0, sizeof(analog_sum));
+  analog_count = 0;
+}
+
+static int send_batches(FRAMING framing, int max_batches, bool wait) {
+  int sent = 0;
+  while (tail != head && sent < max_batches) {
+    const current_batch &b = batches[tail % CURRENT_BATCHES];
+    if (framing == FRAMING_COBS) {
+      uint8_t payload[CURRENT_BATCH_HEADER_SIZE + 2 * CURRENT_BATCH_MAX];
+      uint8_t frame[FRAME_MAX_ENCODED];
+      put_u32(&payload[0], b.start_us);
+      put_u16(&payload[4], interval_us);
+      put_u16(&payload[6], b.seq);
+      payload[8] = b.lost;
+      payload[9] = b.count;
+      for (uint8_t i = 0; i < b.count; i++) {
+        put_u16(&payload[CURRENT_BATCH_HEADER_SIZE + 2 * i], b.samples[i]);
+      }
+      size_t n = encode_frame(FRAME_CURRENT_BATCH, payload,
+                              CURRENT_BATCH_HEADER_SIZE + 2 * b.count, frame, sizeof(frame));
+      if (!wait && tx_room() < n) {
+        break;
+      }
+      tx_send(frame, n, wait);
+    }
+    else {
+      /* Printed by hand, a JsonArray of 32 would not fit the JSON buffers */
+      char line[256];
+      size_t n = put_str(line, "{\"Event\":\"Current\",\"T0\":");
+      n += put_uint(line + n, b.start_us);
+      n += put_str(line + n, ",\"Dt\":");
+      n += put_uint(line + n, interval_us);
+      n += put_str(line + n, ",\"Seq\":");
+      n += put_uint(line + n, b.seq);
+      n += put_str(line + n, ",\"Lost\":");
+      n += put_uint(line + n, b.lost);
+      n += put_str(line + n, ",\"Current\":[");
+      for (uint8_t i = 0; i < b.count; i++) {
+        if (i) {
+          line[n++] = ',';
+        }
+        n += put_uint(line + n, b.samples[i]);
+      }
+      n += put_str(line + n, "]}\n");
+      if (!wait && tx_room() < n) {
+        break;
+      }
+      tx_send((const uint8_t *) line, n, wait);
+    }
+    tail = tail + 1;
+    sent++;
+  }
+  return sent;
+}
+
+int current_stream_send(FRAMING framing, int max_batches) {
+  if (running) {
+    collect();
+  }
+  if (analog_count && micros() - analog_since_us >= CURRENT_ANALOG_US) {
+    send_analog(framing);
+  }
+  return send_batches(framing, max_batches, false);
+}
+
+void current_stream_flush(FRAMING framing) {
+  /* Until adc_dma has nothing more to hand over */
+  do {
+    if (running) {
+      collect();
+    }
+  } while (send_batches(framing, CURRENT_BATCHES, true) > 0);
+  current_stream_stop();
+}
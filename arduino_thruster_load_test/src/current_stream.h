@@ -0,0 +1,93 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file current_stream.h
+ * High rate current readings off adc_dma, sent to the host in batches.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include "cobs_frame.h"
+#include "adc_dma.h"
+#include "channel_stats.h"
+
+/* Samples per batch, sized so a JSON batch stays within the host's 256
+ * byte line and a binary one within FRAME_MAX_PAYLOAD */
+#define CURRENT_BATCH_MAX 32
+/* Batches that can wait for current_stream_send(), a power of two */
+#define CURRENT_BATCHES 8
+/* How often the voltage and temperature means go out */
+#define CURRENT_ANALOG_US 100000
+
+/* What goes to the host: every current reading in batches plus the Analog
+ * means, per step statistics of every channel, or both */
+enum CURRENT_MODE {
+    CURRENT_RAW = 1,
+    CURRENT_SUMMARY = 2,
+    CURRENT_BOTH = CURRENT_RAW | CURRENT_SUMMARY
+};
+
+/*
+ * adc_dma converts current, voltage and temperature at `adc.rate_hz`
+ * readings a second. current_stream_send(), from the main loop, sorts the
+ * current readings into batches and sends whatever batches are complete.
+ * Readings wait in adc_dma's ring while the batches are full. If the loop
+ * falls so far behind that the DMA laps them, the batches they would have
+ * made are counted and reported with the next batch that does go out.
+ * Voltage and temperature change slowly, their means go out in an Analog
+ * message every CURRENT_ANALOG_US.
+ *
+ * With CURRENT_SUMMARY every reading also goes into channel_stats, over a
+ * window the test starts with each step. A step's summary is a few dozen
+ * bytes per channel however many thousand readings it took, which is what
+ * lets the ADC run faster than Serial could ever carry it raw. The window
+ * only sees readings adc_dma has handed over, so its edges trail the
+ * step's by up to ADC_HALF_US.
+ */
+bool current_stream_start(const adc_config &adc, uint8_t batch_size,
+                          CURRENT_MODE mode = CURRENT_RAW);
+void current_stream_stop();
+bool current_stream_running();
+/* The last current reading, 0 before the first */
+uint16_t current_stream_latest();
+/* Starts a new statistics window, at the start of a step */
+void current_stream_window();
+/* The window's statistics so far, per ADC_CHANNEL. False when summaries
+ * are off or the window has no readings */
+bool current_stream_summary(channel_summary summary[ADC_CHANNELS]);
+/* Queues up to `max_batches` complete batches for transmit, returns how
+ * many. Capping it keeps a pass of loop() short when the stream has fallen
+ * behind. A batch the transmit buffer has no room for waits in the ring, so
+ * a stalled host shows up as Lost rather than as a slow loop() */
+int current_stream_send(FRAMING framing, int max_batches = CURRENT_BATCHES);
+/* Sends every batch left, waiting for transmit room if it has to, then
+ * stops. For the end of a test */
+void current_stream_flush(FRAMING framing);
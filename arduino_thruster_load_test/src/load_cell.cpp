@@ -0,0 +1,143 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file load_cell.cpp
+ * HX711 load cell amplifier, read by a bit-banged driver in interrupts.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include <IntervalTimer.h>
+#include "load_cell.h"
+
+static IntervalTimer clock_timer;
+static volatile bool reading = false;
+static volatile bool clock_high = false;
+static volatile uint8_t pulses = 0;
+static volatile uint32_t bits = 0;
+static volatile uint32_t ready_us = 0;
+
+static load_cell_reading queue[LOAD_CELL_QUEUE];
+/* The clock interrupt pushes at head, loop() takes from tail */
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t overruns = 0;
+static bool running = false;
+
+static void push(uint32_t at_us, int32_t counts) {
+  if (head - tail >= LOAD_CELL_QUEUE) {
+    overruns++;
+    return;
+  }
+  queue[head % LOAD_CELL_QUEUE].at_us = at_us;
+  queue[head % LOAD_CELL_QUEUE].counts = counts;
+  head = head + 1;
+}
+
+static void clock_edge() {
+  if (!clock_high) {
+    /* The HX711 puts the next bit on DOUT */
+    digitalWrite(LOAD_CELL_SCK_PIN, HIGH);
+    clock_high = true;
+    return;
+  }
+  if (pulses < 24) {
+    bits = (bits << 1) | (digitalRead(LOAD_CELL_DOUT_PIN) == HIGH ? 1 : 0);
+  }
+  digitalWrite(LOAD_CELL_SCK_PIN, LOW);
+  clock_high = false;
+  pulses = pulses + 1;
+  if (pulses < LOAD_CELL_PULSES) {
+    return;
+  }
+  clock_timer.end();
+  /* Two's complement in 24 bits */
+  push(ready_us, (int32_t) (bits << 8) >> 8);
+  reading = false;
+}
+
+static void data_ready_isr() {
+  if (reading || digitalRead(LOAD_CELL_DOUT_PIN) == HIGH) {
+    return;
+  }
+  ready_us = micros();
+  reading = true;
+  pulses = 0;
+  bits = 0;
+  clock_timer.begin(clock_edge, LOAD_CELL_EDGE_US);
+}
+
+void load_cell_start() {
+  load_cell_stop();
+  head = tail = 0;
+  overruns = 0;
+  pinMode(LOAD_CELL_SCK_PIN, OUTPUT);
+  /* Held low the HX711 stays powered up */
+  digitalWrite(LOAD_CELL_SCK_PIN, LOW);
+  pinMode(LOAD_CELL_DOUT_PIN, INPUT);
+  /* Ahead of USB and the pin interrupts, so nothing stretches a pulse */
+  clock_timer.priority(64);
+  attachInterrupt(digitalPinToInterrupt(LOAD_CELL_DOUT_PIN), data_ready_isr, FALLING);
+  running = true;
+  /* A conversion that was already waiting has no edge left to fire */
+  noInterrupts();
+  data_ready_isr();
+  interrupts();
+}
+
+void load_cell_stop() {
+  if (!running) {
+    return;
+  }
+  detachInterrupt(digitalPinToInterrupt(LOAD_CELL_DOUT_PIN));
+  clock_timer.end();
+  reading = false;
+  clock_high = false;
+  digitalWrite(LOAD_CELL_SCK_PIN, LOW);
+  running = false;
+}
+
+bool load_cell_running() {
+  return running;
+}
+
+bool load_cell_next(load_cell_reading &r) {
+  if (tail == head) {
+    return false;
+  }
+  r = queue[tail % LOAD_CELL_QUEUE];
+  tail = tail + 1;
+  return true;
+}
+
+uint32_t load_cell_overruns() {
+  return overruns;
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file load_cell.h
+ * HX711 load cell amplifier, read by a bit-banged driver in interrupts.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* HX711 data out and clock in, channel A at gain 128 */
+#define LOAD_CELL_DOUT_PIN 5
+#define LOAD_CELL_SCK_PIN 6
+/* RATE tied high, 80 conversions a second */
+#define LOAD_CELL_PERIOD_US 12500
+/* 24 data bits, the 25th pulse picks channel A at gain 128 for the next */
+#define LOAD_CELL_PULSES 25
+/* Each PD_SCK edge is its own timer interrupt this far after the last. A
+ * pulse held high 60 us powers the HX711 down */
+#define LOAD_CELL_EDGE_US 5
+/* Readings waiting for loop(), a power of two */
+#define LOAD_CELL_QUEUE 8
+
+struct load_cell_reading {
+    /* micros() when DOUT fell, the end of the conversion */
+    uint32_t at_us;
+    /* Signed 24 bit counts, tare and scale are the host's */
+    int32_t counts;
+};
+
+/*
+ * DOUT falling means a conversion is ready. Its interrupt stamps micros()
+ * and starts a timer that clocks the 25 pulses out one edge per interrupt,
+ * reading each bit before the pulse falls. No interrupt does more than a
+ * pin write or two, and a whole read takes about 250 us of the 12.5 ms
+ * between conversions. DOUT also falls as the bits shift out, those edges
+ * are ignored while a read is in progress.
+ */
+void load_cell_start();
+void load_cell_stop();
+bool load_cell_running();
+/* The oldest reading not yet taken, false if there is none */
+bool load_cell_next(load_cell_reading &reading);
+/* Readings dropped because the queue was full, since the start */
+uint32_t load_cell_overruns();
@@ -35,8 +35,16 @@
  * @author Ali AlSaibie
  */
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <Servo.h>
+#include "cobs_frame.h"
+#include "current_stream.h"
+#include "load_cell.h"
+#include "rpm_capture.h"
+#include "waveform.h"
+#include "setpoint_stream.h"
+#include "command_parser.h"
+#include "telemetry_writer.h"
+#include "tx_buffer.h"
 #define BAUD 115200
 
 #include <stdint.h>
@@ -47,127 +55,617 @@ enum COMMANDS {
     STOP
 };
 
+/*
+ * The test runs as a state machine driven from loop(), nothing in it ever
+ * waits. Every pass of loop() takes whatever Serial has, sends finished
+ * current batches and moves the test along once its deadline is up, so a
+ * command is handled within one pass no matter where the test is.
+ * Sending does not wait on the host either, everything goes through
+ * tx_buffer and out as fast as Serial takes it.
+ *
+ * Stopping does not even wait for that: the e-stop pin's interrupt puts the
+ * ESC in neutral and cuts its pulses straight away, and a serial Stop is
+ * acted on first thing in the pass that completes its line. Either way the
+ * host gets a StopAck with how long the stop took and the longest pass of
+ * loop() seen so far, which bounds how long a serial Stop can wait.
+ *
+ *   IDLE --start--> ARMING --ARM_MS--> DWELL --max dwell, or Advance--> (sample, report)
+ *                                        ^                                   |
+ *                                        \------------ next step ------------/
+ *
+ * A start with "Type":"Stream" plays the host's setpoints instead, from
+ * ARMING into STREAM until the host ends the stream and it has run dry.
+ */
+enum TEST_STATE {
+    TEST_IDLE = 0,
+    TEST_ARMING,
+    TEST_DWELL,
+    TEST_STREAM
+};
+
+/* ESC arming, once per test */
+#define ARM_MS 2000
+/* Wait for speed to climb and current to stabilize. Also gives the lazy slow
+ * cheap scale a chance to give a measurement on the PC side. The host can
+ * change it with MaxDwell, and cut a step short with Advance once it sees
+ * thrust and current settle, but never before MinDwell */
+#define DWELL_MS 3500
+/* Command bytes tokenized per pass of loop(), bounds the pass */
+#define RX_BYTES_PER_LOOP 64
+/* Current batches queued per pass of loop(), the rest wait for the next one */
+#define CURRENT_SEND_PER_LOOP 2
+/* Load cell readings queued per pass, it makes one every 12.5 ms */
+#define LOAD_SEND_PER_LOOP 2
+/* ADC averaging when the host does not say: in hardware, then sequences
+ * per reading */
+#define ADC_HW_AVERAGE 4
+#define ADC_DECIMATION 4
+
+enum STOP_SOURCE {
+    STOP_SERIAL = 0,
+    STOP_PIN
+};
+
+/* Current, voltage and temperature inputs are adc_dma's, A0 and A1. The
+ * HX711 on pins 5 and 6 is load_cell's, the tachometer on pin 4
+ * rpm_capture's */
+static const unsigned int pwm1_pin = 2;
+/* Pulled up, a normally open stop button shorts it to ground */
+static const uint8_t estop_pin = 3;
+
+static Servo esc1;
+/* JSON until the host asks for binary frames */
+static FRAMING tx_framing = FRAMING_JSON;
+
+static TEST_STATE state = TEST_IDLE;
+static unsigned long state_since = 0;
+static unsigned int test_counter = 0;
+static unsigned int samples_len = 60;
+static unsigned int pwm_out = 255 / 2;
+static unsigned int curr_in = 0;
+static unsigned long dwell_min_ms = 0;
+static unsigned long dwell_max_ms = DWELL_MS;
+/* Step the host says has settled, 0 for none */
+static unsigned int advance_step = 0;
+/* Host streamed setpoints instead of a waveform, a report every so many */
+static bool streaming = false;
+static unsigned int stream_report_every = 1;
+static unsigned long stream_status_since = 0;
+
+static volatile bool estop_pending = false;
+static volatile uint32_t estop_since_us = 0;
+static uint32_t loop_max_us = 0;
+
 void arm_esc(Servo & servo){
+  if (!servo.attached()) {
+    servo.attach(pwm1_pin);
+  }
   int throttle = map(50, 0, 100, 0, 179);
   servo.write(throttle);
-  delay(2000);
 }
 
 void disarm_esc(Servo & servo){
   int throttle = map(0, 0, 100, 0, 179);
   servo.write(throttle);
-  delay(500);
 }
-/* Generate a ramp between -100 and 100: 0 to 100, 100 to -100, -100 to 0 */
-int gen_ramp_value(unsigned int sample, unsigned int no_samples){
-  if(sample <= no_samples / 4) {
-    // Mid to Max
-    return (100 *sample) / (no_samples / 4);
-  }
-  else if(sample > no_samples / 4 && sample <= 3 * no_samples / 4){
-    // Max to Min
-    return 100 - 200 * (sample - no_samples /4) / (no_samples / 2);
 
-  }
-  else if (sample > 3 * no_samples / 4){
-    // Min to Mid
-    return 100 *(sample - 3 * no_samples / 4) / (no_samples / 4) - 100;
+/* Neutral, then no pulses at all so the ESC disarms. Safe from an ISR */
+static void stop_esc(Servo & servo){
+  servo.write(map(50, 0, 100, 0, 179));
+  servo.detach();
+}
+
+static void estop_isr() {
+  stop_esc(esc1);
+  if (!estop_pending) {
+    estop_since_us = micros();
+    estop_pending = true;
   }
 }
 
-unsigned int gen_pwm_ramp(unsigned int sample, unsigned int no_samples){
-  return (255 / 2  * gen_ramp_value(sample, no_samples)) / 100 + 255 / 2;
+static void enter(TEST_STATE next, unsigned long now) {
+  state = next;
+  state_since = now;
 }
 
-void setup() {
-  unsigned int pwm_out = 255 / 2;
-  unsigned int curr_in = 0;
-  unsigned int test_counter = 0;
-  unsigned int samples_len = 60;
-  int current_pin = 0;
-  unsigned int pwm1_pin = 2;
-  bool test_finished = false;
-  /* Set pins */
-//  analogReference(DEFAULT);
-//  analogReadResolution(12);
-//  analogReadAveraging(32);
-  Servo esc1;
-  esc1.attach(pwm1_pin);
-  esc1.write(0);
-  /*JSON Setup */
-  StaticJsonBuffer<200> jsonOutgoingBuffer;
-  StaticJsonBuffer<200> jsonIncomingBuffer;
+static void emergency_stop(STOP_SOURCE source, uint16_t id, uint32_t since_us);
+static void send_stop_ack(STOP_SOURCE source, uint16_t id, uint32_t latency_us);
+static void send_handshake_ack(uint16_t id);
+static void send_buffer_status();
+static void send_tx_stats();
+static void send_load(int max_readings);
+static void report(bool test_finished);
+
+static TX_POLICY tx_policy_of(uint32_t policy) {
+  switch (policy) {
+    case command_hash("DropOldest"): return TX_DROP_OLDEST;
+    case command_hash("Block"): return TX_BLOCK;
+    /* "DropNewest" */
+    default: return TX_DROP_NEWEST;
+  }
+}
 
-  JsonObject &rootOutgoing = jsonOutgoingBuffer.createObject();
+static CURRENT_MODE current_mode_of(uint32_t mode) {
+  switch (mode) {
+    case command_hash("Summary"): return CURRENT_SUMMARY;
+    case command_hash("Both"): return CURRENT_BOTH;
+    /* "Raw", and what an older host that never asks gets */
+    default: return CURRENT_RAW;
+  }
+}
 
-  /* Serial Start */
-  Serial.begin(BAUD);
-  while (!Serial) {}
-  Serial.setTimeout(10);
-  char start_command = 'P';
-
-  /* Generate PWM Function */
-
-
-  while (1) {
-
-    if (Serial.available() > 0) {
-      String incomingString = Serial.readStringUntil('\n');
-      if (incomingString != "") {
-        jsonIncomingBuffer.clear();
-        JsonObject &rootIncoming = jsonIncomingBuffer.parseObject(incomingString);
-        if (rootIncoming["Event"] == "Command") {
-          start_command = (char) rootIncoming["StartCommand"];
-          if (start_command == 'S') {
-            test_finished = false;
-            test_counter = 0;
-          }
-          samples_len = rootIncoming["SNo"];
+static WAVEFORM_TYPE waveform_of(uint32_t type) {
+  switch (type) {
+    case command_hash("Step"): return WAVE_STEP;
+    case command_hash("Staircase"): return WAVE_STAIRCASE;
+    case command_hash("Sine"): return WAVE_SINE;
+    case command_hash("Chirp"): return WAVE_CHIRP;
+    case command_hash("Table"): return WAVE_TABLE;
+    /* "Ramp", and whatever an older host sends */
+    default: return WAVE_RAMP;
+  }
+}
+
+static void handle_command(const command &cmd, unsigned long now, uint32_t line_us) {
+  const uint32_t *field = cmd.field;
+  if (field[CMD_EVENT] == command_hash("Stop")) {
+    emergency_stop(STOP_SERIAL, (uint16_t) field[CMD_ID], line_us);
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("Advance")) {
+    /* Only for the step we are on, a late one must not cut the next short */
+    unsigned int step = field[CMD_STEP];
+    if (state == TEST_DWELL && step == test_counter) {
+      advance_step = step;
+    }
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("Table")) {
+    /* A chunk of the host's lookup table, for a start with "Type":"Table" */
+    waveform_load_table((uint16_t) field[CMD_OFFSET], cmd.values, cmd.count,
+                        (uint16_t) field[CMD_LENGTH]);
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("Setpoints")) {
+    uint8_t pwm[SETPOINT_CHUNK];
+    uint16_t count = 0;
+    for (uint8_t i = 0; i < cmd.count && count < SETPOINT_CHUNK; i++) {
+      int16_t v = cmd.values[i];
+      pwm[count++] = (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    setpoint_stream_push(pwm, count, field[CMD_END] != 0);
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("Handshake")) {
+    tx_framing = field[CMD_FRAMING] == command_hash("COBS") ? FRAMING_COBS : FRAMING_JSON;
+    send_handshake_ack((uint16_t) field[CMD_ID]);
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("TxPolicy")) {
+    tx_set_policy(tx_policy_of(field[CMD_POLICY]));
+    return;
+  }
+  if (field[CMD_EVENT] == command_hash("Command")) {
+    char start_command = (char) field[CMD_START_COMMAND];
+    if (start_command == 'S') {
+      if (digitalRead(estop_pin) == LOW) {
+        /* Still held, stay stopped and end the host's test right away */
+        send_stop_ack(STOP_PIN, 0, 0);
+        test_counter = 0;
+        report(true);
+        return;
+      }
+      test_counter = 0;
+      tx_reset_stats();
+      samples_len = field[CMD_SNO];
+      streaming = field[CMD_TYPE] == command_hash("Stream");
+      if (streaming) {
+        unsigned int report_every = field[CMD_REPORT_EVERY];
+        stream_report_every = report_every > 0 ? report_every : 1;
+        if (!setpoint_stream_start(field[CMD_RATE])) {
+          report(true);
+          return;
         }
+        /* Tells the host how much it can send ahead, it may fill the queue
+         * while the ESC arms */
+        send_buffer_status();
+      }
+      waveform_config wave;
+      wave.type = waveform_of(field[CMD_TYPE]);
+      wave.ticks = (uint16_t) samples_len;
+      unsigned int amplitude = field[CMD_AMP];
+      wave.amplitude = (uint8_t) (amplitude > 0 && amplitude <= 100 ? amplitude : 100);
+      wave.cycles = (uint16_t) field[CMD_CYCLES];
+      wave.cycles_end = (uint16_t) field[CMD_CYCLES_END];
+      wave.levels = (uint8_t) field[CMD_LEVELS];
+      if (!streaming && !waveform_start(wave)) {
+        /* Nothing to run, say a table that never came or more cycles than
+         * the samples can carry, end the host's test */
+        report(true);
+        return;
+      }
+      unsigned long max_dwell = field[CMD_MAX_DWELL];
+      dwell_max_ms = max_dwell > 0 ? max_dwell : DWELL_MS;
+      dwell_min_ms = field[CMD_MIN_DWELL];
+      /* Optional high rate current stream for the length of the test */
+      unsigned long current_rate = field[CMD_CURRENT_RATE];
+      unsigned int current_batch = field[CMD_CURRENT_BATCH];
+      if (current_batch == 0 || current_batch > CURRENT_BATCH_MAX) {
+        current_batch = CURRENT_BATCH_MAX;
+      }
+      if (current_rate > 0) {
+        adc_config adc;
+        adc.rate_hz = current_rate;
+        unsigned int oversample = field[CMD_OVERSAMPLE];
+        unsigned int decimate = field[CMD_DECIMATE];
+        adc.hw_average = (uint8_t) (oversample > 0 && oversample <= 32 ? oversample : ADC_HW_AVERAGE);
+        adc.decimation = (uint8_t) (decimate > 0 && decimate <= ADC_DECIMATION_MAX
+                                    ? decimate : ADC_DECIMATION);
+        current_stream_start(adc, current_batch, current_mode_of(field[CMD_CURRENT_MODE]));
       }
+      /* Thrust off the load cell, for the length of the test */
+      if (field[CMD_LOAD_CELL]) {
+        load_cell_start();
+      }
+      /* Rotor speed in every report, with this many pulses a turn */
+      unsigned long rpm_pulses = field[CMD_RPM_PULSES];
+      if (rpm_pulses > 0) {
+        rpm_capture_start((uint8_t) (rpm_pulses < 255 ? rpm_pulses : 255));
+      }
+      arm_esc(esc1);
+      enter(streaming || samples_len > 0 ? TEST_ARMING : TEST_IDLE, now);
+    }
+    else if (start_command == 'P') {
+      current_stream_stop();
+      load_cell_stop();
+      rpm_capture_stop();
+      enter(TEST_IDLE, now);
     }
+  }
+}
+
+/* The JSON lines, in the order the host has always seen their keys */
+TELEMETRY_FIELD(f_sample_no, "SampleNo", uint32_t);
+TELEMETRY_FIELD(f_current, "Current", uint32_t);
+TELEMETRY_FIELD(f_pwm, "PWM", uint32_t);
+TELEMETRY_FIELD(f_test_finished, "TestFinished", bool);
+typedef telemetry_schema<telemetry_no_event,
+                         f_sample_no, f_current, f_pwm, f_test_finished> step_line;
+/* The same with the rotor's speed, while rpm_capture runs */
+TELEMETRY_FIELD(f_rpm, "RPM", uint32_t);
+typedef telemetry_schema<telemetry_no_event,
+                         f_sample_no, f_current, f_pwm, f_rpm, f_test_finished> step_rpm_line;
 
-    /*Make sure output is disabled if not running test */
+TELEMETRY_EVENT(e_stop_ack, "StopAck");
+TELEMETRY_FIELD(f_id, "Id", uint32_t);
+TELEMETRY_FIELD(f_source, "Source", json_label);
+TELEMETRY_FIELD(f_latency_us, "LatencyUs", uint32_t);
+TELEMETRY_FIELD(f_loop_max_us, "LoopMaxUs", uint32_t);
+typedef telemetry_schema<e_stop_ack, f_id, f_source, f_latency_us, f_loop_max_us> stop_ack_line;
 
-    if (start_command == 'P') {
+TELEMETRY_EVENT(e_handshake_ack, "HandshakeAck");
+TELEMETRY_FIELD(f_framing, "Framing", json_label);
+typedef telemetry_schema<e_handshake_ack, f_framing, f_id> handshake_ack_line;
 
+TELEMETRY_EVENT(e_buffer, "Buffer");
+TELEMETRY_FIELD(f_consumed, "Consumed", uint32_t);
+TELEMETRY_FIELD(f_level, "Level", uint32_t);
+TELEMETRY_FIELD(f_size, "Size", uint32_t);
+TELEMETRY_FIELD(f_underruns, "Underruns", uint32_t);
+TELEMETRY_FIELD(f_overflows, "Overflows", uint32_t);
+typedef telemetry_schema<e_buffer, f_consumed, f_level, f_size, f_underruns, f_overflows>
+    buffer_line;
+
+TELEMETRY_EVENT(e_tx_stats, "TxStats");
+TELEMETRY_FIELD(f_dropped, "Dropped", uint32_t);
+TELEMETRY_FIELD(f_dropped_bytes, "DroppedBytes", uint32_t);
+TELEMETRY_FIELD(f_peak, "Peak", uint32_t);
+TELEMETRY_FIELD(f_blocked_us, "BlockedUs", uint32_t);
+typedef telemetry_schema<e_tx_stats, f_dropped, f_dropped_bytes, f_peak, f_blocked_us>
+    tx_stats_line;
+
+TELEMETRY_EVENT(e_summary, "Summary");
+TELEMETRY_FIELD(f_channel, "Ch", json_label);
+TELEMETRY_FIELD(f_n, "N", uint32_t);
+TELEMETRY_FIELD(f_min, "Min", uint32_t);
+TELEMETRY_FIELD(f_max, "Max", uint32_t);
+TELEMETRY_FIELD(f_mean, "Mean", json_q4);
+TELEMETRY_FIELD(f_var, "Var", json_q4);
+TELEMETRY_FIELD(f_rms, "Rms", json_q4);
+typedef telemetry_schema<e_summary, f_sample_no, f_channel, f_n, f_min, f_max,
+                         f_mean, f_var, f_rms> summary_line;
+
+TELEMETRY_EVENT(e_load, "Load");
+TELEMETRY_FIELD(f_t, "T", uint32_t);
+TELEMETRY_FIELD(f_counts, "Counts", int32_t);
+typedef telemetry_schema<e_load, f_t, f_counts> load_line;
+
+static const char *const channel_names[ADC_CHANNELS] = {"Current", "Voltage", "Temp"};
+
+/* One line or frame per channel, ahead of the step's report */
+static void send_summary(const channel_summary summary[ADC_CHANNELS], tx_port &port) {
+  for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+    const channel_summary &s = summary[c];
+    if (tx_framing == FRAMING_COBS) {
+      uint8_t payload[SUMMARY_PAYLOAD_SIZE];
+      uint8_t frame[FRAME_MAX_ENCODED];
+      put_u16(&payload[0], test_counter);
+      payload[2] = c;
+      put_u32(&payload[3], s.n);
+      put_u16(&payload[7], s.min);
+      put_u16(&payload[9], s.max);
+      put_u16(&payload[11], s.mean);
+      put_u32(&payload[13], s.variance);
+      put_u16(&payload[17], s.rms);
+      size_t n = encode_frame(FRAME_SUMMARY, payload, sizeof(payload),
+                              frame, sizeof(frame));
+      port.write(frame, n);
     }
-    if (start_command == 'S' && test_counter < samples_len) {
-      arm_esc(esc1);
-      test_counter++;
-      /*  Loop through PWM outputs */
-      pwm_out = gen_pwm_ramp(test_counter, samples_len);
-      if (pwm_out > 255) {
-        pwm_out = 255 / 2; } // Mid is zero in our test }
-        int throttle = map(throttle, 0, 255, 0, 179);
-       // esc1.write(throttle);
-
-        /* Wait for speed to climb and current to stabilize */
-        /* Also Delay, giving a chance for the lazy slow cheap scale to give a measurement on the PC side */
-        delay(3500);
-
-        /* Read current TODO: scale accordingly */
-        //curr_in = analogRead(current_pin);
-
-        /* and report current and p   wm */
-        rootOutgoing["SampleNo"] = test_counter;
-        rootOutgoing["Current"] = curr_in;
-        rootOutgoing["PWM"] = pwm_out;
-        if (test_counter == samples_len) {
-          start_command = 'P';
-          test_counter = 0;
-          test_finished = true;
-        }
-        rootOutgoing["TestFinished"] = test_finished;
-        rootOutgoing.printTo(Serial);
-        Serial.write('\n');
+    else {
+      json_label channel = {channel_names[c]};
+      json_q4 mean = {s.mean};
+      json_q4 variance = {s.variance};
+      json_q4 rms = {s.rms};
+      summary_line::send(port, test_counter, channel, s.n, s.min, s.max, mean, variance, rms);
+    }
+  }
+}
+
+/* A test's final report is never dropped, a step's is if the host is behind */
+static void report(bool test_finished) {
+  tx_port port = {test_finished};
+  /* Current in counts, the step's mean when there is a summary, else the
+   * latest reading. TODO: scale accordingly */
+  channel_summary summary[ADC_CHANNELS];
+  bool summarized = current_stream_summary(summary);
+  curr_in = summarized ? (summary[ADC_CURRENT].mean + 8) >> CHANNEL_SUMMARY_FRACTION
+                       : current_stream_latest();
+  bool with_rpm = rpm_capture_running();
+  uint32_t rpm = rpm_capture_rpm();
+  if (test_finished) {
+    /* The readings the test took, before the host stops listening */
+    rpm_capture_stop();
+    load_cell_stop();
+    send_load(LOAD_CELL_QUEUE);
+    send_tx_stats();
+  }
+  if (summarized) {
+    send_summary(summary, port);
+    /* A streamed test's next window starts here, a step's at next_step() */
+    current_stream_window();
+  }
+  if (tx_framing == FRAMING_COBS) {
+    /* 12 or so bytes instead of ~70 */
+    uint8_t payload[TELEMETRY_RPM_PAYLOAD_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    put_u16(&payload[0], test_counter);
+    put_u16(&payload[2], pwm_out);
+    put_u16(&payload[4], curr_in);
+    payload[6] = test_finished ? TELEMETRY_FLAG_FINISHED : 0;
+    if (with_rpm) {
+      payload[6] |= TELEMETRY_FLAG_RPM;
+      put_u16(&payload[7], (uint16_t) (rpm < 0xFFFF ? rpm : 0xFFFF));
+    }
+    size_t n = encode_frame(FRAME_TELEMETRY, payload,
+                            with_rpm ? TELEMETRY_RPM_PAYLOAD_SIZE : TELEMETRY_PAYLOAD_SIZE,
+                            frame, sizeof(frame));
+    port.write(frame, n);
+  }
+  else if (with_rpm) {
+    step_rpm_line::send(port, test_counter, curr_in, pwm_out, rpm, test_finished);
+  }
+  else {
+    step_line::send(port, test_counter, curr_in, pwm_out, test_finished);
+  }
+}
+
+static void send_stop_ack(STOP_SOURCE source, uint16_t id, uint32_t latency_us) {
+  tx_port port = {true};
+  if (tx_framing == FRAMING_COBS) {
+    uint8_t payload[STOP_ACK_PAYLOAD_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    put_u16(&payload[0], id);
+    payload[2] = (uint8_t) source;
+    put_u32(&payload[3], latency_us);
+    put_u32(&payload[7], loop_max_us);
+    size_t n = encode_frame(FRAME_STOP_ACK, payload, sizeof(payload),
+                            frame, sizeof(frame));
+    port.write(frame, n);
+  }
+  else {
+    json_label source_label = {source == STOP_PIN ? "Pin" : "Serial"};
+    stop_ack_line::send(port, id, source_label, latency_us, loop_max_us);
+  }
+}
 
+/* Always a JSON line, old hosts can read it. The Id echoes the handshake's
+ * so the host can tell the answer to its last resend from earlier ones */
+static void send_handshake_ack(uint16_t id) {
+  tx_port port = {true};
+  json_label framing = {tx_framing == FRAMING_COBS ? "COBS" : "JSON"};
+  handshake_ack_line::send(port, framing, id);
+}
+
+static void send_buffer_status() {
+  setpoint_status status = setpoint_stream_status();
+  tx_port port = {false};
+  if (tx_framing == FRAMING_COBS) {
+    uint8_t payload[BUFFER_STATUS_PAYLOAD_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    put_u32(&payload[0], status.consumed);
+    put_u16(&payload[4], status.level);
+    put_u16(&payload[6], status.size);
+    put_u16(&payload[8], status.underruns);
+    put_u16(&payload[10], status.overflows);
+    size_t n = encode_frame(FRAME_BUFFER_STATUS, payload, sizeof(payload),
+                            frame, sizeof(frame));
+    port.write(frame, n);
+  }
+  else {
+    buffer_line::send(port, status.consumed, status.level, status.size,
+                      status.underruns, status.overflows);
+  }
+}
+
+/* Load cell readings as the driver has them, a few at a time. One that
+ * does not fit waits in the driver's queue, like a current batch */
+static void send_load(int max_readings) {
+  tx_port port = {false};
+  load_cell_reading r;
+  for (int i = 0; i < max_readings; i++) {
+    if (tx_framing == FRAMING_COBS) {
+      /* FRAME_MAX_ENCODED's sum for this payload */
+      if (tx_room() < 1 + LOAD_PAYLOAD_SIZE + 2 + 2 || !load_cell_next(r)) {
+        return;
+      }
+      uint8_t payload[LOAD_PAYLOAD_SIZE];
+      uint8_t frame[FRAME_MAX_ENCODED];
+      put_u32(&payload[0], r.at_us);
+      put_u32(&payload[4], (uint32_t) r.counts);
+      size_t n = encode_frame(FRAME_LOAD, payload, sizeof(payload), frame, sizeof(frame));
+      port.write(frame, n);
+    }
+    else {
+      if (tx_room() < load_line::max_size || !load_cell_next(r)) {
+        return;
       }
+      load_line::send(port, r.at_us, r.counts);
+    }
+  }
+}
 
+/* What the transmit buffers cost this test, ahead of its final report */
+static void send_tx_stats() {
+  tx_stats stats = tx_get_stats();
+  tx_port port = {true};
+  if (tx_framing == FRAMING_COBS) {
+    uint8_t payload[TX_STATS_PAYLOAD_SIZE];
+    uint8_t frame[FRAME_MAX_ENCODED];
+    put_u32(&payload[0], stats.dropped);
+    put_u32(&payload[4], stats.dropped_bytes);
+    put_u16(&payload[8], stats.peak);
+    put_u32(&payload[10], stats.blocked_us);
+    size_t n = encode_frame(FRAME_TX_STATS, payload, sizeof(payload),
+                            frame, sizeof(frame));
+    port.write(frame, n);
+  }
+  else {
+    tx_stats_line::send(port, stats.dropped, stats.dropped_bytes, stats.peak,
+                        stats.blocked_us);
+  }
+}
+
+/* The ESC is already stopped when this comes from the pin. The ack goes out
+ * before anything else, then a running test ends with its final report */
+static void emergency_stop(STOP_SOURCE source, uint16_t id, uint32_t since_us) {
+  stop_esc(esc1);
+  current_stream_stop();
+  load_cell_stop();
+  send_stop_ack(source, id, micros() - since_us);
+  if (state != TEST_IDLE) {
+    /* With the speed the rotor had, then its capture stops */
+    report(true);
+    test_counter = 0;
+  }
+  rpm_capture_stop();
+  enter(TEST_IDLE, millis());
+}
+
+/* Sets up the next step's output and starts its dwell */
+static void next_step(unsigned long now) {
+  test_counter++;
+  /*  Loop through PWM outputs, mid is zero in our test */
+  pwm_out = waveform_pwm(waveform_next());
+  // esc1.write(map(pwm_out, 0, 255, 0, 179));
+  advance_step = 0;
+  current_stream_window();
+  enter(TEST_DWELL, now);
+}
+
+static void run_test(unsigned long now) {
+  switch (state) {
+    case TEST_IDLE:
+      break;
+    case TEST_ARMING:
+      if (now - state_since >= ARM_MS) {
+        if (streaming) {
+          stream_status_since = now;
+          current_stream_window();
+          enter(TEST_STREAM, now);
+        }
+        else {
+          next_step(now);
+        }
+      }
+      break;
+    case TEST_STREAM: {
+      unsigned int before = test_counter;
+      test_counter += setpoint_stream_poll(micros(), pwm_out);
+      if (now - stream_status_since >= SETPOINT_STATUS_MS) {
+        send_buffer_status();
+        stream_status_since = now;
+      }
+      if (setpoint_stream_finished()) {
+        send_buffer_status();
+        current_stream_flush(tx_framing);
+        report(true);
+        test_counter = 0;
+        enter(TEST_IDLE, now);
+      }
+      else if (test_counter / stream_report_every != before / stream_report_every) {
+        report(false);
+      }
+      break;
     }
+    case TEST_DWELL:
+      if (now - state_since < dwell_max_ms &&
+          (advance_step != test_counter || now - state_since < dwell_min_ms)) {
+        break;
+      }
+      /* and report current and pwm */
+      if (test_counter == samples_len) {
+        /* Whatever is left goes out ahead of the final sample */
+        current_stream_flush(tx_framing);
+        report(true);
+        test_counter = 0;
+        enter(TEST_IDLE, now);
+      }
+      else {
+        report(false);
+        next_step(now);
+      }
+      break;
   }
+}
 
+void setup() {
+  /* Set pins, the ADC is set up by adc_dma for each test */
+  esc1.attach(pwm1_pin);
+  esc1.write(0);
+  pinMode(estop_pin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(estop_pin), estop_isr, FALLING);
+
+  /* Serial Start */
+  Serial.begin(BAUD);
+  while (!Serial) {}
+}
 
 void loop() {
-  /* Not Used */
-}
\ No newline at end of file
+  uint32_t pass_start = micros();
+  if (estop_pending) {
+    emergency_stop(STOP_PIN, 0, estop_since_us);
+    estop_pending = false;
+  }
+  if (command_parser_poll(Serial, RX_BYTES_PER_LOOP)) {
+    handle_command(command_parser_command(), millis(), command_parser_line_us());
+  }
+  current_stream_send(tx_framing, CURRENT_SEND_PER_LOOP);
+  send_load(LOAD_SEND_PER_LOOP);
+  run_test(millis());
+  /* Only what Serial takes without waiting */
+  tx_drain();
+  uint32_t pass_us = micros() - pass_start;
+  if (pass_us > loop_max_us) {
+    loop_max_us = pass_us;
+  }
+}
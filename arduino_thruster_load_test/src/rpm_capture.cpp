@@ -0,0 +1,116 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file rpm_capture.cpp
+ * Period averaging and timeout for rpm_capture, whichever backend captures.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include "rpm_capture.h"
+#include "rpm_capture_backend.h"
+
+static bool running = false;
+static uint8_t pulses = 1;
+static uint32_t count_hz = 0;
+static uint32_t timeout_counts = 0;
+
+/* Written by the interrupts only, while running */
+static volatile uint32_t last_edge = 0;
+static volatile bool have_edge = false;
+static volatile uint32_t periods[RPM_AVERAGE_PERIODS];
+static volatile uint32_t period_sum = 0;
+static volatile uint8_t period_count = 0;
+static volatile uint8_t period_next = 0;
+
+static void clear_periods() {
+  for (uint8_t i = 0; i < RPM_AVERAGE_PERIODS; i++) {
+    periods[i] = 0;
+  }
+  period_sum = 0;
+  period_count = 0;
+  period_next = 0;
+  have_edge = false;
+}
+
+void rpm_capture_edge_isr(uint32_t count) {
+  if (have_edge) {
+    uint32_t period = count - last_edge;
+    period_sum += period - periods[period_next];
+    periods[period_next] = period;
+    period_next = (uint8_t) ((period_next + 1) & (RPM_AVERAGE_PERIODS - 1));
+    if (period_count < RPM_AVERAGE_PERIODS) {
+      period_count++;
+    }
+  }
+  last_edge = count;
+  have_edge = true;
+}
+
+void rpm_capture_tick_isr(uint32_t count) {
+  if (have_edge && count - last_edge > timeout_counts) {
+    /* Stopped, the next edge starts the average over */
+    clear_periods();
+  }
+}
+
+void rpm_capture_start(uint8_t pulses_per_rev) {
+  rpm_capture_stop();
+  pulses = pulses_per_rev > 0 ? pulses_per_rev : 1;
+  clear_periods();
+  count_hz = rpm_backend_start();
+  timeout_counts = (uint32_t) ((uint64_t) count_hz * RPM_TIMEOUT_US / 1000000UL);
+  running = count_hz > 0;
+}
+
+void rpm_capture_stop() {
+  if (running) {
+    rpm_backend_stop();
+  }
+  running = false;
+}
+
+bool rpm_capture_running() {
+  return running;
+}
+
+uint32_t rpm_capture_rpm() {
+  noInterrupts();
+  uint32_t sum = period_sum;
+  uint8_t n = period_count;
+  interrupts();
+  if (!running || n == 0 || sum == 0) {
+    return 0;
+  }
+  /* n periods took sum counts, each a 1/pulses of a turn */
+  return (uint32_t) ((60ULL * count_hz * n + (uint64_t) sum * pulses / 2) /
+                     ((uint64_t) sum * pulses));
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file rpm_capture.h
+ * Rotor speed off a tachometer: an optical sensor on the prop, or the ESC's
+ * commutation telemetry.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* FTM1 channel 1 captures rising edges on it */
+#define RPM_CAPTURE_PIN 4
+/* Periods the speed is averaged over, a power of two */
+#define RPM_AVERAGE_PERIODS 8
+/* No edge for this long reads 0 rpm, 240 rpm at one pulse a turn */
+#define RPM_TIMEOUT_US 250000
+
+/*
+ * The capture interrupt does no more than a subtraction and a running sum
+ * over the last RPM_AVERAGE_PERIODS periods, and the timer's overflow
+ * interrupt zeroes them once the rotor stops. Either costs well under a
+ * microsecond, at a lower priority than the Servo and ADC interrupts.
+ * `pulses_per_rev` is 1 for a single mark on the prop, the motor's pole
+ * pairs for ESC telemetry.
+ */
+void rpm_capture_start(uint8_t pulses_per_rev);
+void rpm_capture_stop();
+bool rpm_capture_running();
+/* Averaged over the last periods, 0 while stopped or before two edges */
+uint32_t rpm_capture_rpm();
@@ -0,0 +1,94 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file rpm_capture_teensy.cpp
+ * rpm_capture on a Teensy 3.1: FTM1 input capture on pin 4.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include "rpm_capture.h"
+#include "rpm_capture_backend.h"
+
+/* F_BUS / 8, 4.5 MHz at 72 MHz, wrapping every 14.6 ms */
+#define RPM_FTM_PRESCALE 3
+#define RPM_FTM_SC (FTM_SC_CLKS(1) | FTM_SC_PS(RPM_FTM_PRESCALE) | FTM_SC_TOIE)
+/* Rising edges, with the capture interrupt */
+#define RPM_FTM_CSC (FTM_CSC_ELSA | FTM_CSC_CHIE)
+/* Below the Servo's PDB and the ADC's DMA interrupts */
+#define RPM_IRQ_PRIORITY 192
+
+/* Upper half of the count, the timer has the lower */
+static volatile uint32_t overflows = 0;
+
+void ftm1_isr() {
+  bool wrapped = false;
+  if (FTM1_SC & FTM_SC_TOF) {
+    /* Read with TOF set, then written without it, clears it */
+    FTM1_SC = RPM_FTM_SC;
+    overflows++;
+    wrapped = true;
+  }
+  if (FTM1_C1SC & FTM_CSC_CHF) {
+    uint32_t capture = FTM1_C1V;
+    FTM1_C1SC = RPM_FTM_CSC;
+    /* Captured just before the wrap it is being handled with */
+    uint32_t high = wrapped && capture > 0xE000 ? overflows - 1 : overflows;
+    rpm_capture_edge_isr(high << 16 | capture);
+  }
+  if (wrapped) {
+    rpm_capture_tick_isr(overflows << 16);
+  }
+}
+
+uint32_t rpm_backend_start() {
+  /* The core sets FTM1 up for analogWrite() on pins 3 and 4, neither uses it */
+  FTM1_SC = 0;
+  FTM1_CNT = 0;
+  FTM1_MOD = 0xFFFF;
+  FTM1_CNTIN = 0;
+  /* Pulses shorter than 60 system clocks are glitches */
+  FTM1_FILTER = FTM_FILTER_CH1FVAL(15);
+  FTM1_C1SC = RPM_FTM_CSC;
+  overflows = 0;
+  CORE_PIN4_CONFIG = PORT_PCR_MUX(3) | PORT_PCR_PE | PORT_PCR_PS;
+  FTM1_SC = RPM_FTM_SC;
+  NVIC_SET_PRIORITY(IRQ_FTM1, RPM_IRQ_PRIORITY);
+  NVIC_ENABLE_IRQ(IRQ_FTM1);
+  return F_BUS >> RPM_FTM_PRESCALE;
+}
+
+void rpm_backend_stop() {
+  NVIC_DISABLE_IRQ(IRQ_FTM1);
+  FTM1_SC = 0;
+  FTM1_C1SC = 0;
+  CORE_PIN4_CONFIG = PORT_PCR_MUX(1);
+}
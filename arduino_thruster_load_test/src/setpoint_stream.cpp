@@ -0,0 +1,112 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file setpoint_stream.cpp
+ * Setpoints streamed from the host, played out at a fixed rate.
+ *
+ * @author Ali AlSaibie
+ */
+#include "setpoint_stream.h"
+
+static uint8_t queue[SETPOINT_QUEUE_SIZE];
+/* Commands push at head, loop() plays out from tail */
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static bool end_seen = false;
+static bool started = false;
+static uint32_t period_us = 0;
+static uint32_t next_due_us = 0;
+static setpoint_status status;
+
+bool setpoint_stream_start(uint32_t rate_hz) {
+  if (rate_hz == 0 || rate_hz > 10000) {
+    return false;
+  }
+  period_us = 1000000UL / rate_hz;
+  head = tail = 0;
+  end_seen = false;
+  started = false;
+  status.consumed = 0;
+  status.level = 0;
+  status.size = SETPOINT_QUEUE_SIZE;
+  status.underruns = 0;
+  status.overflows = 0;
+  return true;
+}
+
+uint16_t setpoint_stream_push(const uint8_t *pwm, uint16_t count, bool end) {
+  uint16_t taken = 0;
+  while (taken < count && head - tail < SETPOINT_QUEUE_SIZE) {
+    queue[head % SETPOINT_QUEUE_SIZE] = pwm[taken++];
+    head++;
+  }
+  /* Count every setpoint dropped, saturating */
+  uint32_t dropped = (uint32_t) status.overflows + (count - taken);
+  status.overflows = dropped > 0xFFFF ? 0xFFFF : (uint16_t) dropped;
+  end_seen = end_seen || end;
+  return taken;
+}
+
+uint16_t setpoint_stream_poll(uint32_t now_us, unsigned int &pwm) {
+  if (!started) {
+    /* The first setpoint goes out right away */
+    started = true;
+    next_due_us = now_us;
+  }
+  uint16_t periods = 0;
+  while ((int32_t) (now_us - next_due_us) >= 0 && !setpoint_stream_finished()) {
+    if (periods == SETPOINT_QUEUE_SIZE) {
+      /* Stalled for longer than the queue lasts, start the timeline afresh */
+      next_due_us = now_us + period_us;
+      break;
+    }
+    next_due_us += period_us;
+    periods++;
+    if (tail != head) {
+      pwm = queue[tail % SETPOINT_QUEUE_SIZE];
+      tail++;
+      status.consumed++;
+    }
+    else if (status.underruns < 0xFFFF) {
+      status.underruns++;
+    }
+  }
+  return periods;
+}
+
+bool setpoint_stream_finished() {
+  return end_seen && tail == head;
+}
+
+setpoint_status setpoint_stream_status() {
+  status.level = (uint16_t) (head - tail);
+  return status;
+}
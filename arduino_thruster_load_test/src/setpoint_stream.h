@@ -0,0 +1,76 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file setpoint_stream.h
+ * Setpoints streamed from the host, played out at a fixed rate.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+/* Lookahead, a power of two */
+#define SETPOINT_QUEUE_SIZE 128
+/* Setpoints per Setpoints command, sized so the line stays within RX_LINE_MAX */
+#define SETPOINT_CHUNK 32
+/* Buffer status goes out this often while streaming */
+#define SETPOINT_STATUS_MS 20
+
+struct setpoint_status {
+    /* Setpoints played out since the start, the host's credit is
+     * SETPOINT_QUEUE_SIZE less what it sent and this has not caught up to */
+    uint32_t consumed;
+    uint16_t level;
+    uint16_t size;
+    /* Periods that found the queue empty, and setpoints that did not fit,
+     * both saturate at 0xFFFF */
+    uint16_t underruns;
+    uint16_t overflows;
+};
+
+/*
+ * The host sends PWM setpoints ahead of time and only as many as it has
+ * credit for, the queue never holds more than SETPOINT_QUEUE_SIZE. Every
+ * period from the first poll one setpoint is taken off; an empty queue
+ * holds the last one and counts an underrun, the timeline keeps going.
+ * The stream ends once the host has said so and the queue has run dry.
+ *
+ * Everything runs from loop(), the worst pass plays out SETPOINT_QUEUE_SIZE
+ * setpoints and then gives up on catching up.
+ */
+bool setpoint_stream_start(uint32_t rate_hz);
+/* Queues what fits, `end` marks the last of the stream. Returns how many
+ * were taken, each one left over adds to overflows */
+uint16_t setpoint_stream_push(const uint8_t *pwm, uint16_t count, bool end);
+/* Plays out whatever is due by now_us into pwm. Returns the periods that
+ * went by, underruns included */
+uint16_t setpoint_stream_poll(uint32_t now_us, unsigned int &pwm);
+bool setpoint_stream_finished();
+setpoint_status setpoint_stream_status();
@@ -0,0 +1,200 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file telemetry_writer.h
+ * JSON telemetry lines with their field names and order fixed at compile
+ * time.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Decimal digits of v into p, returns how many */
+inline size_t put_uint(char *p, uint32_t v) {
+  char digits[10];
+  size_t n = 0;
+  do {
+    digits[n++] = (char) ('0' + v % 10);
+    v /= 10;
+  } while (v);
+  for (size_t i = 0; i < n; i++) {
+    p[i] = digits[n - 1 - i];
+  }
+  return n;
+}
+
+inline size_t put_str(char *p, const char *s) {
+  size_t n = strlen(s);
+  memcpy(p, s, n);
+  return n;
+}
+
+/* A short string value from a fixed set, e.g. a stop's source */
+struct json_label {
+    const char *text;
+};
+#define JSON_LABEL_MAX 14
+
+/* How each value type prints, and the most characters it can take */
+template <typename T> struct json_value;
+
+template <> struct json_value<uint32_t> {
+    static constexpr size_t max_size = 10;
+    static size_t put(char *p, uint32_t v) { return put_uint(p, v); }
+};
+
+template <> struct json_value<int32_t> {
+    static constexpr size_t max_size = 11;
+    static size_t put(char *p, int32_t v) {
+      if (v >= 0) {
+        return put_uint(p, (uint32_t) v);
+      }
+      p[0] = '-';
+      return 1 + put_uint(p + 1, (uint32_t) -(int64_t) v);
+    }
+};
+
+template <> struct json_value<bool> {
+    static constexpr size_t max_size = 5;
+    static size_t put(char *p, bool v) {
+      memcpy(p, v ? "true" : "false", v ? 4 : 5);
+      return v ? 4 : 5;
+    }
+};
+
+template <> struct json_value<json_label> {
+    static constexpr size_t max_size = JSON_LABEL_MAX + 2;
+    static size_t put(char *p, json_label v) {
+      size_t n = strlen(v.text);
+      n = n < JSON_LABEL_MAX ? n : JSON_LABEL_MAX;
+      p[0] = '"';
+      memcpy(p + 1, v.text, n);
+      p[n + 1] = '"';
+      return n + 2;
+    }
+};
+
+/* Fixed point with 4 fractional bits, e.g. a mean in counts. Sixteenths
+ * print exactly in four decimals */
+struct json_q4 {
+    uint32_t raw;
+};
+
+template <> struct json_value<json_q4> {
+    static constexpr size_t max_size = 9 + 1 + 4;
+    static size_t put(char *p, json_q4 v) {
+      size_t n = put_uint(p, v.raw >> 4);
+      uint32_t fraction = (v.raw & 15) * 625;
+      p[n++] = '.';
+      for (uint32_t place = 1000; place > 0; place /= 10) {
+        p[n++] = (char) ('0' + fraction / place % 10);
+      }
+      return n;
+    }
+};
+
+/* A field: its quoted key and colon are one literal with a known length */
+#define TELEMETRY_FIELD(name, json_name, value_type) \
+  struct name { \
+      typedef value_type type; \
+      static const char *key() { return "\"" json_name "\":"; } \
+      enum { key_size = sizeof("\"" json_name "\":") - 1 }; \
+  }
+
+/* What a line starts with, the brace and an optional constant Event */
+#define TELEMETRY_EVENT(name, event) \
+  struct name { \
+      static const char *text() { return "{\"Event\":\"" event "\","; } \
+      enum { size = sizeof("{\"Event\":\"" event "\",") - 1 }; \
+  }
+
+struct telemetry_no_event {
+    static const char *text() { return "{"; }
+    enum { size = 1 };
+};
+
+template <typename... Fields> struct telemetry_fields;
+
+template <> struct telemetry_fields<> {
+    static constexpr size_t max_size = 0;
+    static size_t put(char *) { return 0; }
+};
+
+template <typename Field, typename... Rest> struct telemetry_fields<Field, Rest...> {
+    typedef typename Field::type type;
+    static constexpr size_t max_size =
+        Field::key_size + json_value<type>::max_size + 1 + telemetry_fields<Rest...>::max_size;
+
+    static size_t put(char *p, const type &value, const typename Rest::type &... rest) {
+      /* Constant length, the compiler turns it into a few stores */
+      memcpy(p, Field::key(), Field::key_size);
+      size_t n = Field::key_size;
+      n += json_value<type>::put(p + n, value);
+      if (sizeof...(Rest) > 0) {
+        p[n++] = ',';
+      }
+      return n + telemetry_fields<Rest...>::put(p + n, rest...);
+    }
+};
+
+/*
+ * One kind of telemetry line. Keys, their order and the longest the line
+ * can get are all known at compile time, so sending one is a few stores
+ * for the keys, digit loops for the values, and a single write() of a
+ * buffer on the stack:
+ *
+ *   TELEMETRY_FIELD(f_pwm, "PWM", uint32_t);
+ *   typedef telemetry_schema<telemetry_no_event, f_pwm> pwm_line;
+ *   pwm_line::send(Serial, 140);        // {"PWM":140}\n
+ */
+template <typename Event, typename... Fields> struct telemetry_schema {
+    /* Event, fields, closing brace and newline */
+    static constexpr size_t max_size = Event::size + telemetry_fields<Fields...>::max_size + 2;
+
+    static size_t write(char *out, const typename Fields::type &... values) {
+      memcpy(out, Event::text(), Event::size);
+      size_t n = Event::size;
+      n += telemetry_fields<Fields...>::put(out + n, values...);
+      out[n++] = '}';
+      out[n++] = '\n';
+      return n;
+    }
+
+    template <typename Port>
+    static size_t send(Port &port, const typename Fields::type &... values) {
+      char line[max_size];
+      size_t n = write(line, values...);
+      port.write((const uint8_t *) line, n);
+      return n;
+    }
+};
@@ -0,0 +1,166 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file tx_buffer.cpp
+ * Double buffered transmit, drained only as fast as Serial takes it.
+ *
+ * @author Ali AlSaibie
+ */
+#include <Arduino.h>
+#include "tx_buffer.h"
+
+struct tx_half {
+    uint8_t data[TX_BUFFER_SIZE];
+    size_t length;
+    /* Messages in it, for the drop counters */
+    uint16_t messages;
+    /* Holds one that must not be dropped, TX_DROP_OLDEST leaves it be */
+    bool critical;
+};
+
+static tx_half halves[2];
+/* halves[fill] takes new messages, the other drains from drain_pos */
+static uint8_t fill = 0;
+static size_t drain_pos = 0;
+static TX_POLICY policy = TX_DROP_NEWEST;
+static tx_stats stats;
+
+void tx_set_policy(TX_POLICY policy_) {
+  policy = policy_;
+}
+
+static tx_half &draining() {
+  return halves[fill ^ 1];
+}
+
+size_t tx_room() {
+  return TX_BUFFER_SIZE - halves[fill].length;
+}
+
+static void note_peak() {
+  size_t queued = halves[fill].length + draining().length - drain_pos;
+  if (queued > stats.peak) {
+    stats.peak = (uint16_t) queued;
+  }
+}
+
+/* One step of draining, true if anything moved */
+static bool drain_step() {
+  tx_half &out = draining();
+  if (drain_pos == out.length) {
+    if (halves[fill].length == 0) {
+      return false;
+    }
+    out.length = 0;
+    out.messages = 0;
+    out.critical = false;
+    drain_pos = 0;
+    fill ^= 1;
+  }
+  tx_half &next = draining();
+  int room = Serial.availableForWrite();
+  if (room <= 0) {
+    return false;
+  }
+  size_t n = next.length - drain_pos;
+  n = n < (size_t) room ? n : (size_t) room;
+  Serial.write(&next.data[drain_pos], n);
+  drain_pos += n;
+  return true;
+}
+
+void tx_drain() {
+  /* Twice, so a buffer that just emptied makes way for the other */
+  if (drain_step()) {
+    drain_step();
+  }
+}
+
+/* Waits for room the way a plain Serial.write() would, but gives up after
+ * TX_WAIT_MAX_US. False if there is still no room */
+static bool wait_for_room(size_t length) {
+  uint32_t start = micros();
+  while (tx_room() < length) {
+    if (micros() - start >= TX_WAIT_MAX_US) {
+      stats.blocked_us += micros() - start;
+      return false;
+    }
+    if (!drain_step()) {
+      yield();
+    }
+  }
+  stats.blocked_us += micros() - start;
+  return true;
+}
+
+bool tx_send(const uint8_t *data, size_t length, bool critical) {
+  if (length > TX_BUFFER_SIZE) {
+    /* Never fits, nothing sent is that long */
+    stats.dropped++;
+    stats.dropped_bytes += length;
+    return false;
+  }
+  if (tx_room() < length) {
+    if (critical || policy == TX_BLOCK) {
+      if (!wait_for_room(length)) {
+        stats.dropped++;
+        stats.dropped_bytes += length;
+        return false;
+      }
+    }
+    else if (policy == TX_DROP_OLDEST && !halves[fill].critical) {
+      stats.dropped += halves[fill].messages;
+      stats.dropped_bytes += halves[fill].length;
+      halves[fill].length = 0;
+      halves[fill].messages = 0;
+    }
+    else {
+      stats.dropped++;
+      stats.dropped_bytes += length;
+      return false;
+    }
+  }
+  tx_half &in = halves[fill];
+  memcpy(&in.data[in.length], data, length);
+  in.length += length;
+  in.messages++;
+  in.critical = in.critical || critical;
+  note_peak();
+  return true;
+}
+
+tx_stats tx_get_stats() {
+  return stats;
+}
+
+void tx_reset_stats() {
+  memset(&stats, 0, sizeof(stats));
+}
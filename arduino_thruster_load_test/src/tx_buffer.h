@@ -0,0 +1,90 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file tx_buffer.h
+ * Double buffered transmit, drained only as fast as Serial takes it.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes in each of the two buffers */
+#define TX_BUFFER_SIZE 512
+/* Longest a message waits for room, a host that stopped reading costs
+ * it instead of hanging loop() */
+#define TX_WAIT_MAX_US 20000
+
+/* What happens to a message the fill buffer has no room for */
+enum TX_POLICY {
+    /* Drop it, what is already queued goes out */
+    TX_DROP_NEWEST = 0,
+    /* Drop everything queued behind what is draining, then take it */
+    TX_DROP_OLDEST,
+    /* Wait for room like a plain Serial.write(), timing suffers */
+    TX_BLOCK
+};
+
+struct tx_stats {
+    uint32_t dropped;
+    uint32_t dropped_bytes;
+    /* Most bytes queued at once, both buffers */
+    uint16_t peak;
+    /* Time spent waiting for room, by TX_BLOCK or critical messages */
+    uint32_t blocked_us;
+};
+
+/*
+ * Messages are composed into the fill buffer while the other one drains.
+ * tx_drain(), once per pass of loop(), writes no more than
+ * Serial.availableForWrite() says fits, so it never blocks, and swaps the
+ * buffers when the draining one is empty. A stalled host fills the buffers
+ * and then costs messages, per the policy, instead of loop() time.
+ *
+ * Messages go in whole or not at all. Critical ones, stop acks and the
+ * final report, are not dropped by the policy. They wait for room instead,
+ * for up to TX_WAIT_MAX_US, and only a host that is not reading loses them.
+ */
+void tx_set_policy(TX_POLICY policy);
+bool tx_send(const uint8_t *data, size_t length, bool critical = false);
+/* Bytes tx_send() would take right now without dropping or waiting */
+size_t tx_room();
+void tx_drain();
+tx_stats tx_get_stats();
+void tx_reset_stats();
+
+/* Lets telemetry_schema::send() and encode_frame() callers write to it */
+struct tx_port {
+    bool critical;
+    size_t write(const uint8_t *data, size_t length) {
+      return tx_send(data, length, critical) ? length : 0;
+    }
+};
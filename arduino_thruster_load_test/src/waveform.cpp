@@ -0,0 +1,175 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file waveform.cpp
+ * Test profiles: ramp, step, staircase, sine, chirp or a host table.
+ *
+ * @author Ali AlSaibie
+ */
+#include <string.h>
+#include "waveform.h"
+
+/* sin() from 0 to 90 degrees in Q14, a quarter of a WAVE_TABLE_SIZE period */
+static const int16_t quarter_sine[WAVE_TABLE_SIZE / 4 + 1] = {
+  0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590,
+  3981, 4370, 4756, 5139, 5520, 5897, 6270, 6639, 7005, 7366,
+  7723, 8076, 8423, 8765, 9102, 9434, 9760, 10080, 10394, 10702,
+  11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+  13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286,
+  15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261,
+  16305, 16340, 16364, 16379, 16384
+};
+
+static int16_t table[WAVE_TABLE_SIZE];
+static uint16_t table_len = WAVE_TABLE_SIZE;
+static bool interpolate = true;
+/* The host's table as it was uploaded, copied into table on start */
+static int16_t host_table[WAVE_TABLE_SIZE];
+static uint16_t host_table_len = 0;
+
+static uint32_t phase = 0;
+static uint32_t increment = 0;
+static int32_t chirp_rate = 0;
+
+bool waveform_load_table(uint16_t offset, const int16_t *percent, uint16_t count,
+                         uint16_t length) {
+  if (length == 0 || length > WAVE_TABLE_SIZE || offset + count > length) {
+    return false;
+  }
+  host_table_len = length;
+  for (uint16_t i = 0; i < count; i++) {
+    int32_t p = percent[i];
+    p = p > 100 ? 100 : (p < -100 ? -100 : p);
+    host_table[offset + i] = (int16_t) (p * WAVE_FULL_SCALE / 100);
+  }
+  return true;
+}
+
+/* 0 to full, full to -full, -full to 0 over the table */
+static int32_t triangle(uint16_t i) {
+  const int32_t quarter = WAVE_TABLE_SIZE / 4;
+  if (i <= quarter) {
+    return WAVE_FULL_SCALE * (int32_t) i / quarter;
+  }
+  if (i <= 3 * quarter) {
+    return WAVE_FULL_SCALE - 2 * WAVE_FULL_SCALE * ((int32_t) i - quarter) / (2 * quarter);
+  }
+  return WAVE_FULL_SCALE * ((int32_t) i - 3 * quarter) / quarter - WAVE_FULL_SCALE;
+}
+
+static int32_t sine(uint16_t i) {
+  const uint16_t quarter = WAVE_TABLE_SIZE / 4;
+  uint16_t q = i % quarter;
+  switch (i / quarter) {
+    case 0: return quarter_sine[q];
+    case 1: return quarter_sine[quarter - q];
+    case 2: return -quarter_sine[q];
+    default: return -quarter_sine[quarter - q];
+  }
+}
+
+/* Periods over `ticks` as a phase step, rounded up so that whole fractions
+ * of the test land exactly on the table's corners */
+static uint64_t phase_step(uint16_t cycles, uint16_t ticks) {
+  return (((uint64_t) cycles << 32) + ticks - 1) / ticks;
+}
+
+bool waveform_start(const waveform_config &config) {
+  if (config.ticks == 0) {
+    return false;
+  }
+  uint8_t levels = config.levels > 0 ? config.levels : 1;
+  if (config.type == WAVE_TABLE) {
+    if (host_table_len == 0) {
+      return false;
+    }
+    table_len = host_table_len;
+    memcpy(table, host_table, sizeof(table[0]) * table_len);
+  }
+  else {
+    table_len = WAVE_TABLE_SIZE;
+    for (uint16_t i = 0; i < WAVE_TABLE_SIZE; i++) {
+      int32_t v;
+      switch (config.type) {
+        case WAVE_STEP:
+          v = i < WAVE_TABLE_SIZE / 2 ? 0 : WAVE_FULL_SCALE;
+          break;
+        case WAVE_STAIRCASE:
+          /* The ramp, cut down to whole levels */
+          v = triangle(i) * levels / WAVE_FULL_SCALE * WAVE_FULL_SCALE / levels;
+          break;
+        case WAVE_SINE:
+        case WAVE_CHIRP:
+          v = sine(i);
+          break;
+        default:
+          v = triangle(i);
+          break;
+      }
+      table[i] = (int16_t) v;
+    }
+  }
+  for (uint16_t i = 0; i < table_len; i++) {
+    table[i] = (int16_t) ((int32_t) table[i] * config.amplitude / 100);
+  }
+  interpolate = config.type == WAVE_RAMP || config.type == WAVE_SINE ||
+                config.type == WAVE_CHIRP;
+
+  uint16_t cycles = config.cycles > 0 ? config.cycles : 1;
+  uint16_t cycles_end = config.type == WAVE_CHIRP && config.cycles_end > 0
+                        ? config.cycles_end : cycles;
+  /* Past a period every two ticks the shape aliases, and a period a tick
+   * does not fit the 32 bit increment at all */
+  if (2 * (uint32_t) cycles > config.ticks || 2 * (uint32_t) cycles_end > config.ticks) {
+    return false;
+  }
+  uint64_t first = phase_step(cycles, config.ticks);
+  uint64_t last = phase_step(cycles_end, config.ticks);
+  phase = 0;
+  increment = (uint32_t) first;
+  /* A linear sweep of the rate, and so of the frequency, tick by tick */
+  chirp_rate = (int32_t) (((int64_t) last - (int64_t) first) / config.ticks);
+  return true;
+}
+
+int16_t waveform_next() {
+  phase += increment;
+  increment += chirp_rate;
+  /* 16.16 position in the table, constant time for any table length */
+  uint32_t pos = (uint32_t) (((uint64_t) phase * table_len) >> 16);
+  uint16_t index = (uint16_t) (pos >> 16);
+  int16_t a = table[index];
+  if (!interpolate) {
+    return a;
+  }
+  int16_t b = table[index + 1 < table_len ? index + 1 : 0];
+  return (int16_t) (a + (((int32_t) (b - a) * (int32_t) (pos & 0xFFFF)) >> 16));
+}
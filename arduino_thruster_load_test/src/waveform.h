@@ -0,0 +1,92 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file waveform.h
+ * Test profiles: ramp, step, staircase, sine, chirp or a host table.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+
+enum WAVEFORM_TYPE {
+    WAVE_RAMP = 0,
+    WAVE_STEP,
+    WAVE_STAIRCASE,
+    WAVE_SINE,
+    WAVE_CHIRP,
+    WAVE_TABLE
+};
+
+/* Entries in one period of the built in shapes, and the longest host table */
+#define WAVE_TABLE_SIZE 256
+/* Levels are Q14, +-WAVE_FULL_SCALE is +-100% throttle */
+#define WAVE_FULL_SCALE 16384
+/* Values per Table command, sized so the line stays within RX_LINE_MAX */
+#define WAVE_TABLE_CHUNK 32
+
+struct waveform_config {
+    WAVEFORM_TYPE type;
+    /* Ticks in the whole test, one per step */
+    uint16_t ticks;
+    /* Percent of full throttle */
+    uint8_t amplitude;
+    /* Periods over the test, a chirp sweeps from cycles to cycles_end */
+    uint16_t cycles;
+    uint16_t cycles_end;
+    /* Staircase levels between zero and the peak */
+    uint8_t levels;
+};
+
+/*
+ * waveform_start() fills one period of the shape, amplitude included, into
+ * a Q14 table and works out a 32 bit phase increment per tick. After that
+ * waveform_next() is an add, a multiply and a table lookup whatever the
+ * shape, so it is cheap enough for a timer ISR. Ramp, sine and chirp
+ * interpolate between entries, step, staircase and host tables hold.
+ *
+ * The ramp is the original profile: 0 to 100, 100 to -100, -100 to 0.
+ * Step sits at zero for the first half of each period and at the
+ * amplitude for the second.
+ */
+/* Stores `count` percent values from `offset` of a host table `length`
+ * long, false if they do not fit */
+bool waveform_load_table(uint16_t offset, const int16_t *percent, uint16_t count,
+                         uint16_t length);
+/* False if the config cannot run, e.g. a table that was never loaded or
+ * more cycles than half the ticks */
+bool waveform_start(const waveform_config &config);
+/* Moves one tick on and returns the level there */
+int16_t waveform_next();
+
+/* -100% to 100% onto the 0 to 255 PWM range, mid is zero */
+inline unsigned int waveform_pwm(int16_t level) {
+  return (unsigned int) (255 / 2 + (127 * (int32_t) level) / WAVE_FULL_SCALE);
+}
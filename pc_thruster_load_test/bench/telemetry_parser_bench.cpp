@@ -0,0 +1,151 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_parser_bench.cpp
+ * Times the in place telemetry parser against nlohmann::json on lines
+ * recorded from the firmware.
+ *
+ * @author Ali AlSaibie
+ */
+#include "telemetry_parser.h"
+#include "monotonic_clock.h"
+#include "json.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/* One of each kind the firmware sends during a test, off firmware_sim */
+static const char* RECORDED[] = {
+    "{\"SampleNo\":12,\"Current\":3,\"PWM\":140,\"TestFinished\":false}",
+    "{\"SampleNo\":3,\"Current\":3,\"PWM\":254,\"RPM\":11723,\"TestFinished\":false}",
+    "{\"Event\":\"Current\",\"T0\":43704499,\"Dt\":500,\"Seq\":0,\"Lost\":0,\"Current\":"
+    "[2,4,5,4,4,0,3,7,3,3,3,2,4,3,3,2,2,5,0,5,6,1,3,2,2,1,3,0,2,4,2,4]}",
+    "{\"Event\":\"Summary\",\"SampleNo\":1,\"Ch\":\"Current\",\"N\":600,\"Min\":0,"
+    "\"Max\":8,\"Mean\":3.5000,\"Var\":2.6250,\"Rms\":3.8750}",
+    "{\"Event\":\"Load\",\"T\":43712500,\"Counts\":8382}",
+    "{\"Event\":\"Analog\",\"T0\":43704499,\"N\":200,\"Voltage\":2751,\"Temp\":892}",
+};
+
+/* Keeps the compiler from dropping a parse whose result is unused */
+static volatile uint64_t sink;
+
+/* Nanoseconds per call of `parse` over every line, best of a few rounds */
+template<typename Parse>
+static double time_ns(const std::vector<std::string> &lines, long iterations, Parse parse) {
+  double best = 0;
+  for (int round = 0; round < 5; round++) {
+    int64_t start = monotonic_us();
+    for (long i = 0; i < iterations; i++) {
+      for (size_t l = 0; l < lines.size(); l++) {
+        sink += parse(lines[l]);
+      }
+    }
+    double ns = (monotonic_us() - start) * 1000.0 / ((double) iterations * lines.size());
+    if (round == 0 || ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+/* The fast path must read step reports the way nlohmann does */
+static bool agrees(const std::string &line) {
+  telemetry_sample fast;
+  if (!parse_telemetry_fast(line.data(), line.size(), fast)) {
+    return true;
+  }
+  json j = json::parse(line);
+  bool rpm = j.count("RPM") != 0;
+  return fast.sample_no == j.at("SampleNo").get<unsigned int>() &&
+         fast.pwm == j.at("PWM").get<double>() &&
+         fast.current == j.at("Current").get<double>() &&
+         fast.test_finished == j.at("TestFinished").get<bool>() &&
+         ((fast.fields & TELEMETRY_RPM) != 0) == rpm &&
+         (!rpm || fast.rpm == j.at("RPM").get<double>());
+}
+
+/*
+ * telemetry_parser_bench [iterations] [lines_file]
+ *
+ * lines_file holds one telemetry line per line, say a capture of the tty,
+ * the recorded set above is used without one. nlohmann's time is its
+ * json::parse alone, reading the fields out costs it more on top.
+ */
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+  std::vector<std::string> lines;
+  if (argc > 2) {
+    std::ifstream in(argv[2]);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (!line.empty()) {
+        lines.push_back(line);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < sizeof(RECORDED) / sizeof(RECORDED[0]); i++) {
+      lines.push_back(RECORDED[i]);
+    }
+  }
+  if (iterations <= 0 || lines.empty()) {
+    fprintf(stderr, "usage: %s [iterations] [lines_file]\n", argv[0]);
+    return 1;
+  }
+
+  for (size_t l = 0; l < lines.size(); l++) {
+    if (!agrees(lines[l])) {
+      fprintf(stderr, "fast and nlohmann disagree on %s\n", lines[l].c_str());
+      return 1;
+    }
+  }
+
+  printf("%-10s %12s %12s %8s\n", "line", "fast [ns]", "json [ns]", "speedup");
+  for (size_t l = 0; l <= lines.size(); l++) {
+    /* Each line alone, then all of them as a mix */
+    std::vector<std::string> set = l < lines.size()
+        ? std::vector<std::string>(1, lines[l]) : lines;
+    double fast = time_ns(set, iterations, [](const std::string &s) {
+      telemetry_message message;
+      return (uint64_t) parse_telemetry_line(s.data(), s.size(), message);
+    });
+    double generic = time_ns(set, iterations, [](const std::string &s) {
+      return (uint64_t) json::parse(s).size();
+    });
+    std::string name = l < lines.size() ? std::to_string(l) : "mix";
+    printf("%-10s %12.1f %12.1f %7.1fx\n", name.c_str(), fast, generic, generic / fast);
+  }
+  return 0;
+}
@@ -0,0 +1,364 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file acquisition_pipeline.h
+ * Reader, merge and logger threads joined by lock-free queues.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "arduino_interface.h"
+#include "usbscale.h"
+#include "spsc_queue.h"
+#include "sample_aligner.h"
+#include "column_log.h"
+#include "sample_store.h"
+#include "settling_detector.h"
+
+#define SERIAL_LINE_MAX 256
+#define SERIAL_QUEUE_SIZE 256
+#define LOG_QUEUE_SIZE 1024
+/* A quarter second of batches at 5 kHz and 32 samples each is ~40 */
+#define CURRENT_QUEUE_SIZE 512
+/* Three channels a step, steps are seconds apart */
+#define SUMMARY_QUEUE_SIZE 64
+/* Three seconds of load cell readings */
+#define LOAD_QUEUE_SIZE 256
+/* Load cell readings averaged for its zero, while the ESC arms */
+#define LOAD_CELL_TARE_READINGS 40
+/* Stop commands that can be in flight at once, a power of two */
+#define STOP_SLOTS 16
+/* An Advance the firmware ignored, say during arming, is repeated this often */
+#define ADVANCE_RESEND_US 250000
+/* wait() gives up on a firmware that has sent nothing for this long */
+#define PIPELINE_IDLE_TIMEOUT_MS 10000
+/* How often a full queue is retried for the test's final sample */
+#define PIPELINE_RETRY_US 100
+
+/* The streamed profile: PWM setpoint number `index`, false past its end */
+typedef std::function<bool(uint32_t index, uint8_t &pwm)> setpoint_source;
+
+/* A raw telemetry line, or COBS frame, as it came off the tty */
+struct serial_line{
+    int64_t timestamp_us;
+    uint8_t framing;
+    uint16_t length;
+    char text[SERIAL_LINE_MAX];
+};
+
+/* Columns of the sample log, in sample_record order */
+enum SAMPLE_COLUMN{
+    SAMPLE_TIMESTAMP_US = 0,
+    SAMPLE_NO,
+    SAMPLE_PWM,
+    SAMPLE_CURRENT,
+    SAMPLE_RPM,
+    SAMPLE_THRUST,
+    SAMPLE_THRUST_ERROR_US,
+    SAMPLE_TEST_FINISHED
+};
+
+std::vector<column_spec> sample_log_columns();
+
+/* A current batch with its samples placed on our clock */
+struct current_record{
+    int64_t timestamp_us;   // first sample, monotonic_us() clock
+    int64_t device_us;      // first sample, unwrapped firmware micros()
+    current_batch batch;
+    /* The latest Analog means when the batch came, 0 before the first */
+    uint16_t voltage;
+    uint16_t temperature;
+};
+
+/* Columns of the current log, one row per ADC sample */
+enum CURRENT_COLUMN{
+    CURRENT_TIMESTAMP_US = 0,
+    CURRENT_DEVICE_US,
+    CURRENT_SEQ,
+    CURRENT_COUNTS,
+    CURRENT_VOLTAGE,
+    CURRENT_TEMPERATURE
+};
+
+std::vector<column_spec> current_log_columns();
+
+/* A step summary, stamped when it came in */
+struct summary_record{
+    int64_t timestamp_us;
+    channel_summary summary;
+};
+
+/* Columns of the summary log, one row per channel per step */
+enum SUMMARY_COLUMN{
+    SUMMARY_TIMESTAMP_US = 0,
+    SUMMARY_SAMPLE_NO,
+    SUMMARY_CHANNEL,
+    SUMMARY_COUNT,
+    SUMMARY_MEAN,
+    SUMMARY_MIN,
+    SUMMARY_MAX,
+    SUMMARY_VARIANCE,
+    SUMMARY_RMS
+};
+
+std::vector<column_spec> summary_log_columns();
+
+/* Thrust off the firmware's load cell instead of the USB scale */
+struct load_cell_config{
+    double counts_per_gram{0};
+    /* The first this many readings are its zero */
+    unsigned int tare_readings{LOAD_CELL_TARE_READINGS};
+};
+
+/* A load cell reading placed on our clock */
+struct load_record{
+    int64_t timestamp_us;   // middle of the conversion, monotonic_us() clock
+    int64_t device_us;      // the same, unwrapped firmware micros()
+    int32_t counts;
+    double thrust;          // grams, NaN until the tare is in
+};
+
+/* Columns of the load log, one row per HX711 conversion */
+enum LOAD_COLUMN{
+    LOAD_TIMESTAMP_US = 0,
+    LOAD_DEVICE_US,
+    LOAD_COUNTS,
+    LOAD_THRUST
+};
+
+std::vector<column_spec> load_log_columns();
+
+struct pipeline_stats{
+    size_t serial_depth;
+    size_t scale_depth;
+    size_t log_depth;
+    size_t serial_max_depth;
+    size_t log_max_depth;
+    uint64_t serial_drops;
+    uint64_t scale_drops;
+    uint64_t log_drops;
+    uint64_t lines_received;
+    uint64_t parse_errors;
+    uint64_t samples_logged;
+    int64_t max_alignment_error_us;
+    double mean_alignment_error_us;
+    size_t store_bytes;
+    uint64_t current_batches;
+    /* Analog messages, and the last voltage and temperature counts */
+    uint64_t analog_reports;
+    uint16_t voltage_counts;
+    uint16_t temperature_counts;
+    uint64_t current_samples_logged;
+    /* Lost on the firmware side or missing from the sequence */
+    uint64_t current_batches_lost;
+    uint64_t current_drops;
+    size_t current_max_depth;
+    /* Step summaries, one per channel, and the ones the logger missed */
+    uint64_t summaries;
+    uint64_t summary_drops;
+    /* Load cell readings, gaps in their times, and the zero in counts */
+    uint64_t load_readings;
+    uint64_t load_missed;
+    double load_tare;
+    /* Emergency stops the firmware acknowledged, from serial or its pin */
+    uint64_t stop_acks;
+    uint64_t stop_acks_pin;
+    /* Stop written to its ack read, serial stops only, -1 if none */
+    int64_t stop_round_trip_max_us;
+    /* Firmware side, stop request to ack, and its longest loop() pass */
+    uint32_t stop_firmware_max_us;
+    uint32_t firmware_loop_max_us;
+    /* Advance commands sent, and the mean time between step reports */
+    uint64_t advances_sent;
+    double mean_step_us;
+    /* Streamed setpoints, and the firmware queue's lowest level, -1 if no
+     * buffer status came */
+    uint64_t setpoints_sent;
+    uint64_t buffer_reports;
+    int setpoint_min_level;
+    uint32_t setpoint_underruns;
+    uint32_t setpoint_overflows;
+    /* The firmware's transmit buffers, from its TxStats, 0 reports if it
+     * sent none */
+    uint64_t tx_stats_reports;
+    uint32_t tx_dropped;
+    uint32_t tx_dropped_bytes;
+    uint32_t tx_peak;
+    uint32_t tx_blocked_us;
+};
+
+/*
+ * serial reader --\
+ *                  merge (align) --> logger --> column log, sample store, stdout
+ * scale (libusb) -/        \---------> logger --> current, summary, load logs
+ *
+ * Each arrow is an spsc_queue plus an eventfd to wake its consumer. Only the
+ * logger touches the log and stdout, so a slow disk or terminal never holds up
+ * acquisition: when the logger falls behind its queue fills and further
+ * samples are counted as drops instead. The one exception is the sample
+ * flagged TestFinished, which ends the test: its producer retries until
+ * there is room. Current batches skip the aligner,
+ * their samples carry the firmware's own timestamps, and so do step
+ * summaries: they describe a window the firmware has already closed.
+ *
+ * With advance_when_settled() merge also watches both streams for the step
+ * the firmware is dwelling on, and tells it to take its sample as soon as
+ * they have settled instead of waiting out the dwell.
+ *
+ * With use_load_cell() thrust comes from the firmware's HX711 instead of
+ * the scale: 80 readings a second on the firmware's clock, so the samples
+ * align to within a conversion rather than to the scale's slow reports.
+ *
+ * With stream_setpoints() merge instead feeds the firmware its setpoints,
+ * never more than the firmware's queue has room for: each buffer status
+ * says how many it has played out, so the credit is the queue's size less
+ * what was sent and not yet played.
+ */
+class acquisition_pipeline{
+
+public:
+    /* `current_log`, `summary_log` and `load_log` are only written when
+     * open */
+    acquisition_pipeline(arduino_interface &arduino, USBScale &scale,
+                         column_log_writer &log, column_log_writer &current_log,
+                         column_log_writer &summary_log, column_log_writer &load_log);
+    ~acquisition_pipeline();
+    /* Call before start() */
+    void advance_when_settled(const settling_config &config);
+    /* Call before start(), for a test started with "LoadCell". The scale's
+     * readings are then ignored */
+    void use_load_cell(const load_cell_config &config);
+    /* Call before start(), for a test started with "Type":"Stream" */
+    void stream_setpoints(const setpoint_source &source);
+    int start();
+    /* Blocks until the sample flagged TestFinished has been logged, until
+     * nothing has come from the firmware for `idle_timeout_ms`, or until the
+     * serial port is lost. False if it gave up, the pipeline is stopped
+     * either way */
+    bool wait(int idle_timeout_ms = PIPELINE_IDLE_TIMEOUT_MS);
+    /* wait() for at most `timeout_ms`, false if the test is still running */
+    bool wait_for(int timeout_ms);
+    /* Sends a Stop command and times its ack, see stats(). The firmware
+     * finishes the test right after. Returns the command's id, -1 on error */
+    int request_stop();
+    void stop();
+    pipeline_stats stats() const;
+    /* Everything logged so far, compressed. Owned by the logger thread, so
+     * only query it once wait() has returned */
+    const sample_store& samples() const { return store; }
+
+private:
+    arduino_interface &arduino;
+    USBScale &scale;
+    column_log_writer &log;
+    column_log_writer &current_log;
+    column_log_writer &summary_log;
+    column_log_writer &load_log;
+    sample_store store;
+    bool load_cell{false};
+    load_cell_config load_config;
+    bool adaptive_dwell{false};
+    settling_config settling;
+    setpoint_source setpoints;
+    /* Next setpoint to send, merge thread only */
+    uint32_t setpoint_index{0};
+    bool setpoints_ended{false};
+
+    spsc_queue<serial_line, SERIAL_QUEUE_SIZE> serial_queue;
+    spsc_queue<sample_record, LOG_QUEUE_SIZE> log_queue;
+    spsc_queue<current_record, CURRENT_QUEUE_SIZE> current_queue;
+    spsc_queue<summary_record, SUMMARY_QUEUE_SIZE> summary_queue;
+    spsc_queue<load_record, LOAD_QUEUE_SIZE> load_queue;
+
+    int serial_event{-1};
+    int scale_event{-1};
+    int log_event{-1};
+    int stop_event{-1};
+    int done_event{-1};
+
+    std::thread serial_thread;
+    std::thread merge_thread;
+    std::thread logger_thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> done{false};
+    std::atomic<bool> serial_lost{false};
+
+    std::atomic<uint64_t> lines_received{0};
+    std::atomic<uint64_t> parse_errors{0};
+    std::atomic<uint64_t> samples_logged{0};
+    std::atomic<size_t> store_bytes{0};
+    std::atomic<uint64_t> current_batches{0};
+    std::atomic<uint64_t> analog_reports{0};
+    std::atomic<uint16_t> voltage_counts{0};
+    std::atomic<uint16_t> temperature_counts{0};
+    std::atomic<uint64_t> current_samples_logged{0};
+    std::atomic<uint64_t> current_batches_lost{0};
+    std::atomic<uint64_t> summaries{0};
+    std::atomic<uint64_t> load_readings{0};
+    std::atomic<uint64_t> load_missed{0};
+    std::atomic<double> load_tare{0};
+    std::atomic<int64_t> max_alignment_error{0};
+    std::atomic<double> mean_alignment_error{0};
+    std::atomic<uint64_t> stop_acks{0};
+    std::atomic<uint64_t> stop_acks_pin{0};
+    std::atomic<int64_t> stop_round_trip_max{-1};
+    std::atomic<uint32_t> stop_firmware_max{0};
+    std::atomic<uint32_t> firmware_loop_max{0};
+    /* When each Stop in flight was written, indexed by id % STOP_SLOTS */
+    std::atomic<int64_t> stop_sent_us[STOP_SLOTS];
+    uint16_t next_stop_id{1};
+    std::atomic<uint64_t> advances_sent{0};
+    std::atomic<double> mean_step{0};
+    std::atomic<uint64_t> setpoints_sent{0};
+    std::atomic<uint64_t> buffer_reports{0};
+    std::atomic<int> setpoint_min_level{-1};
+    std::atomic<uint32_t> setpoint_underruns{0};
+    std::atomic<uint32_t> setpoint_overflows{0};
+    std::atomic<uint64_t> tx_stats_reports{0};
+    std::atomic<uint32_t> tx_dropped{0};
+    std::atomic<uint32_t> tx_dropped_bytes{0};
+    std::atomic<uint32_t> tx_peak{0};
+    std::atomic<uint32_t> tx_blocked_us{0};
+
+    void serial_reader();
+    void merge();
+    void logger();
+    void log_current(const current_record &record);
+    void log_summary(const summary_record &record);
+    void log_load(const load_record &record);
+    void send_advance(uint32_t step);
+    void send_setpoints(const buffer_status &status);
+};
@@ -35,29 +35,69 @@
  * @author Ali AlSaibie
  */
 #pragma once
-#include <SerialStream.h>
 #include <iostream>
 #include <ctime>
-using namespace LibSerial;
+#include <string>
+#include <mutex>
+#include <stdint.h>
+#include "line_framer.h"
+#include "serial_port.h"
+#include "cobs_frame.h"
+
+/* Longest host table the firmware takes and the values per Table command,
+ * its WAVE_TABLE_SIZE and WAVE_TABLE_CHUNK in waveform.h */
+#define WAVE_TABLE_SIZE 256
+#define WAVE_TABLE_CHUNK 32
+/* Setpoints per Setpoints command, the firmware's SETPOINT_CHUNK */
+#define SETPOINT_CHUNK 32
+/* A Handshake nobody answered is sent again this often, while the board
+ * boots */
+#define HANDSHAKE_RETRY_US 100000
 
 class arduino_interface{
 
 public:
-    arduino_interface();
+    explicit arduino_interface(const std::string &port = "/dev/ttyACM0");
     ~arduino_interface();
     enum COMMANDS{
         P = 1,
         S
     };
+    /* Commands may be sent from any thread, each goes out whole and
+     * commands never interleave on the wire */
     int send_command(COMMANDS com);
     int send_string(std::string &string);
     int receive_data(char * data_buffer);
     int receive_string(std::string &string);
+    /* Never blocks. Hands out the next complete line, without its '\n', as a
+     * view into the receive buffer that stays valid until the next receive
+     * call. Returns 1 for a frame, 0 when no complete line is available and
+     * -1 when reading the port failed, e.g. it was unplugged */
+    int receive_frame(frame_view &frame);
+    /* Same, but waits up to timeout_us for a line. Returns -1 on timeout */
+    int read_frame(frame_view &frame, int64_t timeout_us);
+    /* Asks the firmware to send telemetry with `requested` framing and waits
+     * up to timeout_us for it to agree, asking again every
+     * HANDSHAKE_RETRY_US. Each try carries a new Id and only the ack that
+     * echoes the last one counts, acks to earlier tries are still JSON
+     * lines. Firmware that does not answer keeps talking JSON. Returns the
+     * framing now in use; frames are then COBS frames without their
+     * delimiter, or text lines for FRAMING_JSON */
+    FRAMING negotiate_framing(FRAMING requested, int64_t timeout_us);
+    FRAMING framing() const { return rx_framing; }
+    /* Descriptor that turns readable when the arduino has sent something */
+    int poll_fd() const { return serial.native_handle(); }
 
 private:
-    SerialStream serial_stream;
-    std::string readStringUntil(char terminator);
-    int timedRead();
+    serial_port serial;
+    std::string port_name;
+    FRAMING rx_framing{FRAMING_JSON};
+    line_framer framer;
+    /* Held for every write, the merge thread streams setpoints and
+     * advances while the main thread may send a Stop */
+    std::mutex write_lock;
     bool configure_serial();
+    /* Moves whatever the tty has buffered into the framer in one read */
+    int fill();
 
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file cobs_frame.h
+ * COBS delimited, CRC16 checked binary frames shared with the firmware.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry_parser.h"
+
+/*
+ * On the wire a frame is COBS(type, payload, crc16) followed by a 0x00
+ * delimiter. COBS guarantees the encoded bytes hold no 0x00, so a lost byte
+ * costs one frame and the reader resyncs on the next delimiter. The CRC is
+ * CRC-16/CCITT-FALSE over type and payload, stored little-endian, as are all
+ * payload fields. Keep in sync with the firmware's cobs_frame.h.
+ */
+enum FRAMING{
+    FRAMING_JSON = 0,
+    FRAMING_COBS
+};
+
+enum FRAME_TYPE{
+    FRAME_TELEMETRY = 0x01,
+    FRAME_CURRENT_BATCH = 0x02,
+    FRAME_STOP_ACK = 0x03,
+    FRAME_BUFFER_STATUS = 0x04,
+    FRAME_TX_STATS = 0x05,
+    FRAME_ANALOG = 0x06,
+    FRAME_SUMMARY = 0x07,
+    FRAME_LOAD = 0x08
+};
+
+#define FRAME_DELIMITER 0x00
+#define FRAME_MAX_PAYLOAD 254
+/* Worst case COBS overhead is one byte per 254 */
+#define FRAME_MAX_ENCODED (1 + FRAME_MAX_PAYLOAD + 2 + 2)
+
+/* FRAME_TELEMETRY payload: u16 SampleNo, u16 PWM, u16 Current, u8 flags,
+ * then u16 RPM when the flags say so */
+#define TELEMETRY_PAYLOAD_SIZE 7
+#define TELEMETRY_RPM_PAYLOAD_SIZE 9
+#define TELEMETRY_FLAG_FINISHED 0x01
+#define TELEMETRY_FLAG_RPM 0x02
+
+/* FRAME_CURRENT_BATCH payload: u32 T0, u16 Dt, u16 Seq, u8 Lost, u8 N,
+ * then N u16 ADC counts */
+#define CURRENT_BATCH_HEADER_SIZE 10
+
+/* FRAME_STOP_ACK payload: u16 Id, u8 Source, u32 LatencyUs, u32 LoopMaxUs */
+#define STOP_ACK_PAYLOAD_SIZE 11
+
+/* FRAME_BUFFER_STATUS payload: u32 Consumed, u16 Level, u16 Size,
+ * u16 Underruns, u16 Overflows */
+#define BUFFER_STATUS_PAYLOAD_SIZE 12
+
+/* FRAME_TX_STATS payload: u32 Dropped, u32 DroppedBytes, u16 Peak,
+ * u32 BlockedUs */
+#define TX_STATS_PAYLOAD_SIZE 14
+
+/* FRAME_ANALOG payload: u32 T0, u16 N, u16 Voltage, u16 Temp */
+#define ANALOG_PAYLOAD_SIZE 10
+
+/* FRAME_SUMMARY payload: u16 SampleNo, u8 Ch, u32 N, u16 Min, u16 Max,
+ * u16 Mean, u32 Var, u16 Rms, the last three in sixteenths */
+#define SUMMARY_PAYLOAD_SIZE 19
+
+/* FRAME_LOAD payload: u32 T, i32 Counts */
+#define LOAD_PAYLOAD_SIZE 8
+
+uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+/* Both return the output length, 0 if it does not fit */
+size_t cobs_encode(const uint8_t* in, size_t length, uint8_t* out, size_t out_size);
+size_t cobs_decode(const uint8_t* in, size_t length, uint8_t* out, size_t out_size);
+
+/* Decodes and checks a frame without its delimiter. Returns the payload
+ * length, or -1 when the frame is malformed or fails its CRC */
+int decode_frame(const uint8_t* in, size_t length, uint8_t &type,
+                 uint8_t* payload, size_t payload_size);
+
+/* False unless `in` is a well formed FRAME_TELEMETRY frame */
+bool decode_telemetry_frame(const uint8_t* in, size_t length, telemetry_sample &sample);
+
+/* Any kind of frame, TELEMETRY_INVALID unless well formed */
+TELEMETRY_KIND decode_telemetry_frame(const uint8_t* in, size_t length, telemetry_message &message);
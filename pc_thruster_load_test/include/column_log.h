@@ -0,0 +1,209 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file column_log.h
+ * Append-only columnar binary log, written in aligned chunks, read by mmap.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * File layout, all little-endian:
+ *
+ *   column_log_header                       COLUMN_LOG_HEADER_SIZE bytes
+ *   chunk 0                                 header.chunk_size bytes
+ *   chunk 1 ...
+ *
+ * A chunk holds up to header.chunk_rows rows. It starts with a
+ * column_log_chunk header, then every column as a plain array of
+ * chunk_rows values at the offset its column_desc gives, 64 byte aligned.
+ * All chunks are the same size, so chunk k sits at a fixed offset and a
+ * column is read in place with no decoding. A chunk written before the log
+ * was full says how many rows it holds, trailing garbage from a crash is a
+ * partial chunk and is ignored. Every column carries its own CRC-32, so a
+ * scan of one column only checks that column.
+ */
+#define COLUMN_LOG_MAGIC "TLOGCOL1"
+#define COLUMN_LOG_CHUNK_MAGIC 0x4B4E4843 /* "CHNK" */
+#define COLUMN_LOG_VERSION 1
+#define COLUMN_LOG_HEADER_SIZE 4096
+#define COLUMN_LOG_CHUNK_HEADER_SIZE 256
+#define COLUMN_LOG_MAX_COLUMNS 32
+#define COLUMN_LOG_ALIGN 4096
+#define COLUMN_LOG_CHUNK_ROWS 1024
+
+enum COLUMN_TYPE{
+    COLUMN_U8 = 0,
+    COLUMN_U32,
+    COLUMN_I64,
+    COLUMN_F64
+};
+
+struct column_desc{
+    char name[24];
+    uint8_t type;
+    uint8_t size;
+    uint8_t reserved[2];
+    /* From the start of the chunk */
+    uint32_t offset;
+};
+
+/* Who ran what, filled in by the caller and stored verbatim */
+struct column_log_info{
+    char rig[64];
+    char test_id[32];
+    char test_type[32];
+    char serial_port[64];
+    char scale[32];
+    uint32_t planned_samples;
+    uint8_t framing;
+    /* Tachometer pulses a turn, 0 when rpm was not captured */
+    uint8_t rpm_pulses;
+    uint8_t reserved[2];
+};
+
+struct column_log_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t chunk_size;
+    uint32_t chunk_rows;
+    uint32_t n_columns;
+    uint32_t reserved;
+    int64_t created_unix_us;
+    /* monotonic_us() at creation, row timestamps are on the same clock */
+    int64_t created_monotonic_us;
+    column_log_info info;
+    column_desc columns[COLUMN_LOG_MAX_COLUMNS];
+    /* CRC-32 of everything above */
+    uint32_t crc;
+};
+
+struct column_log_chunk{
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t index;
+    uint32_t column_crc[COLUMN_LOG_MAX_COLUMNS];
+    /* CRC-32 of everything above */
+    uint32_t crc;
+};
+
+static_assert(sizeof(column_log_header) <= COLUMN_LOG_HEADER_SIZE, "header too large");
+static_assert(sizeof(column_log_chunk) <= COLUMN_LOG_CHUNK_HEADER_SIZE, "chunk header too large");
+
+/* The zlib/PNG CRC-32 */
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+/* Name and type of one column, offsets are worked out by the writer */
+struct column_spec{
+    const char* name;
+    COLUMN_TYPE type;
+};
+
+/*
+ * Rows are filled in with **set**, one value per column, and committed with
+ * **end_row**. The current chunk lives in an aligned buffer and goes to disk
+ * in one write once it is full, or on **flush** or **close**, so the file only
+ * ever grows by whole, page aligned chunks.
+ */
+class column_log_writer{
+
+public:
+    column_log_writer();
+    ~column_log_writer();
+
+    int open(const std::string &path, const std::vector<column_spec> &columns,
+             const column_log_info &info, uint32_t chunk_rows = COLUMN_LOG_CHUNK_ROWS);
+    /* T must match the column's type */
+    template<typename T>
+    void set(int column, T value) {
+      reinterpret_cast<T*>(chunk + header.columns[column].offset)[row] = value;
+    }
+    int end_row();
+    /* Writes the rows so far as a short chunk */
+    int flush();
+    int close();
+    bool is_open() const { return fd >= 0; }
+    uint64_t rows_written() const { return rows_total; }
+
+private:
+    int fd{-1};
+    column_log_header header;
+    unsigned char* chunk{nullptr};
+    uint32_t row{0};
+    uint64_t chunk_index{0};
+    uint64_t rows_total{0};
+
+    int write_chunk();
+};
+
+/*
+ * Maps a whole log read-only. Columns are handed out as pointers straight
+ * into the mapping, valid until **close**.
+ */
+class column_log_reader{
+
+public:
+    column_log_reader();
+    ~column_log_reader();
+
+    /* Fails on a bad magic, version or header CRC */
+    int open(const std::string &path);
+    void close();
+
+    const column_log_header& info() const { return *header; }
+    /* -1 when there is no such column */
+    int find_column(const std::string &name) const;
+    size_t chunks() const { return n_chunks; }
+    uint32_t chunk_rows(size_t chunk) const;
+    uint64_t rows() const;
+
+    template<typename T>
+    const T* column(size_t chunk, int column) const {
+      return reinterpret_cast<const T*>(chunk_base(chunk) + header->columns[column].offset);
+    }
+    /* Checks the chunk header and one column, or all of them with -1 */
+    bool verify(size_t chunk, int column = -1) const;
+
+private:
+    const unsigned char* map{nullptr};
+    size_t map_size{0};
+    const column_log_header* header{nullptr};
+    size_t n_chunks{0};
+
+    const unsigned char* chunk_base(size_t chunk) const {
+      return map + header->header_size + chunk * header->chunk_size;
+    }
+};
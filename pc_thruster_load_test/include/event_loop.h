@@ -0,0 +1,65 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file event_loop.h
+ * epoll based reactor that dispatches fd readiness to callbacks.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+
+class event_loop{
+
+public:
+    typedef std::function<void(uint32_t events)> fd_callback;
+
+    event_loop();
+    ~event_loop();
+    /* Register a descriptor with an epoll event mask (EPOLLIN, EPOLLOUT..) */
+    int add_fd(int fd, uint32_t events, fd_callback callback);
+    int modify_fd(int fd, uint32_t events);
+    int remove_fd(int fd);
+    /* Wait at most timeout_ms (-1 blocks) and dispatch whatever is ready.
+     * Returns the number of dispatched events or -1 on error */
+    int run_once(int timeout_ms);
+    void stop();
+    bool is_running() const { return running; }
+
+private:
+    static const int MAX_EVENTS = 16;
+    int epoll_fd;
+    bool running;
+    std::map<int, fd_callback> callbacks;
+};
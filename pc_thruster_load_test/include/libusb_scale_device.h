@@ -0,0 +1,114 @@
+//
+// libusb_scale_device.h
+// =====================
+//
+// The USB postal scale itself, found and read through libusb. Split out of
+// USBScale so the scale can be swapped for a sim_scale_device.
+//
+#pragma once
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "scale_device.h"
+//
+// This program uses libusb-1.0 (not the older libusb-0.1) for USB
+// functionality.
+//
+#include <libusb-1.0/libusb.h>
+// To enable a bunch of extra debugging data, simply define `#define DEBUG`
+// here and recompile.
+//
+//     #define DEBUG
+
+//
+// **NSCALES** should be kept updated with the length of the list.
+//
+#define NSCALES 9
+
+//
+// Failed transfers in a row before the scale is given up on. Each failure
+// is resubmitted right away, a scale that keeps failing is not coming back.
+//
+#define SCALE_TRANSFER_RETRIES 8
+
+class libusb_scale_device : public scale_device{
+  public:
+    libusb_scale_device();
+    ~libusb_scale_device();
+
+    int open() override;
+    int read_report(unsigned char* report, int length, int* transferred,
+                    unsigned int timeout_ms) override;
+
+    //
+    // libusb's own descriptors are handed to the loop by **attach**.
+    // **start_reports** keeps `n_transfers` interrupt transfers in flight so
+    // a report is never missed while another is being handled.
+    //
+    int attach(event_loop &loop) override;
+    int start_reports(report_callback callback, int n_transfers) override;
+    void stop_reports() override;
+    int next_timeout_ms() override;
+
+  private:
+
+    libusb_device **devs{nullptr};
+    ssize_t cnt;
+    libusb_device* dev{nullptr};
+    libusb_device_handle* handle{nullptr};
+    uint8_t endpoint{0};
+    bool opened{false};
+    int r; // holds return codes
+
+    event_loop* loop{nullptr};
+    std::vector<libusb_transfer*> transfers;
+    std::vector<unsigned char> transfer_data;
+    std::atomic<int> transfers_in_flight{0};
+    std::atomic<int> transfer_errors{0};
+    std::atomic<bool> capturing{false};
+    std::thread event_thread;
+    report_callback on_report;
+
+    static void transfer_complete(libusb_transfer* transfer);
+    static void pollfd_added(int fd, short events, void* user_data);
+    static void pollfd_removed(int fd, void* user_data);
+    void handle_events(void);
+    void run_event_thread(void);
+
+    //
+    // **find_scale** takes a libusb device list and finds the first USB device
+    // that matches a device listed in scales.h.
+    //
+    libusb_device* find_scale(libusb_device**);
+
+    //
+    // take device and fetch bEndpointAddress for the first endpoint
+    //
+    uint8_t get_first_endpoint_address(libusb_device* dev);
+
+    uint16_t scales[NSCALES][2] = {\
+    // Stamps.com Model 510 5LB Scale
+          {0x1446, 0x6a73},
+          // USPS (Elane) PS311 "XM Elane Elane UParcel 30lb"
+          {0x7b7c, 0x0100},
+          // Stamps.com Stainless Steel 5 lb. Digital Scale
+          {0x2474, 0x0550},
+          // Stamps.com Stainless Steel 35 lb. Digital Scale
+          {0x2474, 0x3550},
+          // Mettler Toledo
+          {0x0eb8, 0xf000},
+          // SANFORD Dymo 10 lb USB Postal Scale
+          {0x6096, 0x0158},
+          // Fairbanks Scales SCB-R9000
+          {0x0b67, 0x555e},
+          // Dymo-CoStar Corp. M25 Digital Postal Scale
+          {0x0922, 0x8004},
+          // DYMO 1772057 Digital Postal Scale
+          {0x0922, 0x8003}
+  };
+
+};
@@ -0,0 +1,89 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file line_framer.h
+ * Splits a byte stream into terminator delimited frames without copying.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define LINE_FRAMER_CAPACITY 4096
+
+/* A frame inside the framer's buffer, valid until the next write_ptr() or
+ * write_space() call */
+struct frame_view{
+    const char* data;
+    size_t length;
+};
+
+/*
+ * Bytes are read in bulk straight into the framer's buffer (write_ptr(),
+ * write_space(), commit()), frames are found with memchr and handed out as
+ * views into the same buffer. Consumed space is reclaimed by sliding the
+ * unfinished tail back to the front, so a line is never allocated and at
+ * most one partial line is ever moved.
+ */
+class line_framer{
+
+public:
+    explicit line_framer(size_t capacity = LINE_FRAMER_CAPACITY, char terminator = '\n');
+
+    /* Makes room first, so write_space() is only 0 when a single unfinished
+     * frame fills the whole buffer */
+    char* write_ptr();
+    size_t write_space();
+    void commit(size_t n);
+
+    /* The terminator is not part of the frame. For '\n' terminated text a
+     * trailing '\r' is dropped too */
+    bool next_frame(frame_view &frame);
+    /* Takes effect on bytes not yet handed out as frames */
+    void set_terminator(char terminator_) { terminator = terminator_; scan = begin; }
+
+    size_t buffered() const { return end - begin; }
+    uint64_t overflows() const { return overflow_count; }
+    void clear() { begin = end = scan = 0; }
+
+private:
+    std::vector<char> buffer;
+    char terminator;
+    size_t begin{0};   // first unconsumed byte
+    size_t scan{0};    // bytes before this were already searched
+    size_t end{0};     // one past the last committed byte
+    uint64_t overflow_count{0};
+    bool discarding{false};
+
+    void compact();
+};
@@ -0,0 +1,122 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sample_aligner.h
+ * Streaming interpolation of scale readings onto telemetry timestamps, and
+ * the firmware's clock mapped onto ours.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+
+/* How long a telemetry sample may wait for a later scale reading */
+#define ALIGN_MAX_WAIT_US 500000
+
+/*
+ * The scale and the arduino report on unrelated clocks and rates. Every
+ * telemetry sample is held until a scale reading at or after its timestamp
+ * shows up, then the thrust is linearly interpolated between the two
+ * readings that bracket it. If none shows up within `max_wait_us` the last
+ * reading is held instead. Either way the alignment error is the distance
+ * to the nearest real reading.
+ */
+class sample_aligner{
+
+public:
+    struct aligned{
+        int64_t timestamp_us;
+        double value;
+        int64_t error_us;   // distance to the nearest actual reading, -1 if none yet
+    };
+
+    explicit sample_aligner(int64_t max_wait_us = ALIGN_MAX_WAIT_US);
+
+    /* Readings and samples must each arrive in timestamp order */
+    void add_reading(int64_t timestamp_us, double value);
+    void add_sample(int64_t timestamp_us);
+    /* Pops the oldest sample once it can be aligned, or has waited too long.
+     * Samples come out in the order they were added */
+    bool pop_aligned(int64_t now_us, aligned &out);
+    /* Milliseconds until the oldest pending sample times out, -1 if none */
+    int next_deadline_ms(int64_t now_us) const;
+
+    size_t pending_samples() const { return pending.size(); }
+    int64_t max_error_us() const { return max_error; }
+    double mean_error_us() const { return aligned_count ? (double) error_sum / aligned_count : 0; }
+
+private:
+    struct point{
+        int64_t timestamp_us;
+        double value;
+    };
+    int64_t max_wait;
+    std::deque<point> readings;
+    std::deque<int64_t> pending;
+
+    int64_t max_error{0};
+    int64_t error_sum{0};
+    uint64_t aligned_count{0};
+
+    void interpolate(int64_t t, aligned &out);
+};
+
+/* Observations before the offset estimate may move up again */
+#define DEVICE_CLOCK_WINDOW 256
+
+/*
+ * Maps the firmware's 32 bit micros() onto monotonic_us(). Every observation
+ * pairs a device time with the host time it arrived at, the transport only
+ * ever adds delay, so the smallest difference seen is the best offset. The
+ * minimum is taken over a rolling window so the estimate follows drift
+ * between the two crystals in both directions.
+ */
+class device_clock{
+
+public:
+    /* 64 bit device time. Calls need to be in device time order only to
+     * within half the 32 bit range, about 35 minutes */
+    int64_t unwrap(uint32_t device_us);
+    /* Something stamped `device_us` (unwrapped) arrived at `arrival_us` */
+    void observe(int64_t device_us, int64_t arrival_us);
+    int64_t to_host_us(int64_t unwrapped_us) const { return unwrapped_us + offset; }
+
+private:
+    bool started{false};
+    uint32_t last_raw{0};
+    int64_t unwrapped{0};
+    bool have_offset{false};
+    int64_t offset{0};
+    int64_t window_min{0};
+    unsigned int window_count{0};
+};
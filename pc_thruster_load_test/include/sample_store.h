@@ -0,0 +1,151 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file sample_store.h
+ * Compressed in-memory time series of logged samples.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/* One logged sample: the arduino's telemetry with the scale's thrust
+ * interpolated onto its arrival time */
+struct sample_record{
+    int64_t timestamp_us;
+    unsigned int sample_no;
+    double pwm;
+    double current;
+    double rpm;     // 0 unless the firmware captures rotor speed
+    double thrust;
+    int64_t thrust_error_us;
+    bool test_finished;
+};
+
+/* Samples per block, a block is the unit queries skip over */
+#define SAMPLE_STORE_BLOCK 1024
+
+/*
+ * Gorilla style compression (Pelkonen et al., VLDB 2015), adapted to
+ * microsecond stamps and this rig's channels. Every block starts with raw
+ * values, after that each sample costs:
+ *
+ *   timestamp_us     delta of delta, '0' when the rate holds, else a
+ *                    7/14/22 bit or raw value behind a '10'/'110'/'1110'/'1111' prefix
+ *   sample_no        '0' when it counts up by one, else 32 raw bits
+ *   pwm              '0' + delta as above while it is a whole number,
+ *                    otherwise '1' + the raw double
+ *   rpm              as pwm
+ *   current, thrust  XOR with the previous value, '0' when unchanged,
+ *                    else the meaningful bits inside a leading/trailing
+ *                    zero window that is reused while it fits
+ *   thrust_error_us  delta as for timestamps
+ *   test_finished    1 bit
+ *
+ * A steady ramp comes to a couple of bytes per sample. Nothing is lost,
+ * samples read back bit for bit as they were appended.
+ *
+ * Samples must be appended in timestamp order. Not thread safe: append and
+ * query from one thread, e.g. the logger, or once it is done.
+ */
+class sample_store{
+
+    struct xor_state{
+        uint64_t previous;
+        int leading;
+        int trailing;
+    };
+
+    struct block{
+        int64_t first_us;
+        int64_t last_us;
+        uint32_t count;
+        uint64_t bit_length;
+        std::vector<uint64_t> bits;
+    };
+
+public:
+    /* Reads the samples with first_us <= timestamp_us <= last_us, oldest first */
+    class cursor{
+    public:
+        bool next(sample_record &record);
+
+    private:
+        friend class sample_store;
+        cursor(const sample_store &store, int64_t first_us, int64_t last_us);
+        const uint64_t* bits;
+
+        const sample_store &store;
+        int64_t first_us;
+        int64_t last_us;
+        size_t block_index;
+        uint32_t position{0};
+        uint64_t bit_position{0};
+
+        sample_record previous;
+        int64_t previous_delta{0};
+        xor_state current_state;
+        xor_state thrust_state;
+
+        uint64_t read_bits(int n);
+        int64_t read_delta();
+        double read_xor(xor_state &state);
+        double read_whole(double previous);
+        void decode(sample_record &record);
+    };
+
+    sample_store();
+
+    void append(const sample_record &record);
+    cursor range(int64_t first_us, int64_t last_us) const;
+    cursor all() const { return range(INT64_MIN, INT64_MAX); }
+
+    uint64_t size() const { return samples; }
+    /* Heap bytes held by the compressed samples */
+    size_t bytes() const;
+    int64_t first_timestamp_us() const { return blocks.empty() ? 0 : blocks.front().first_us; }
+    int64_t last_timestamp_us() const { return blocks.empty() ? 0 : blocks.back().last_us; }
+
+private:
+    std::vector<block> blocks;
+    uint64_t samples{0};
+
+    sample_record previous;
+    int64_t previous_delta{0};
+    xor_state current_state;
+    xor_state thrust_state;
+
+    void write_bits(uint64_t value, int n);
+    void write_delta(int64_t value);
+    void write_xor(double value, xor_state &state);
+    void write_whole(double value, double previous);
+};
@@ -0,0 +1,70 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file scale_device.h
+ * Report source behind USBScale, real or simulated.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include "event_loop.h"
+
+/* Every HID POS weight report is this long */
+#define WEIGH_REPORT_SIZE 0x06
+
+/* A raw HID POS report as delivered, stamped with monotonic_us() */
+typedef std::function<void(const unsigned char* report, int length,
+                           int64_t timestamp_us)> report_callback;
+
+/*
+ * Where USBScale gets its reports from: a real scale through libusb
+ * (libusb_scale_device) or a simulated one (sim_scale_device). Return codes
+ * follow libusb, 0 is success.
+ */
+class scale_device{
+
+public:
+    virtual ~scale_device() {}
+    virtual int open() = 0;
+    /* Blocks for one report, like libusb_interrupt_transfer */
+    virtual int read_report(unsigned char* report, int length, int* transferred,
+                            unsigned int timeout_ms) = 0;
+
+    /* Continuous reports, serviced by `loop` once attached, otherwise by a
+     * thread of the device's own. `callback` runs on that thread */
+    virtual int attach(event_loop &loop) = 0;
+    virtual int start_reports(report_callback callback, int n_transfers) = 0;
+    virtual void stop_reports() = 0;
+    /* Upper bound for the loop's wait, -1 when the device needs no timeouts */
+    virtual int next_timeout_ms() = 0;
+};
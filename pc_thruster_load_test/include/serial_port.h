@@ -0,0 +1,69 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file serial_port.h
+ * Raw POSIX termios serial port with batched, non-blocking I/O.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <termios.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include <string>
+
+class serial_port{
+
+public:
+    serial_port();
+    ~serial_port();
+
+    /* Raw 8N1, no flow control, non-blocking. `baud` is a termios B* constant.
+     * VMIN/VTIME only matter to blocking readers, read() here never waits */
+    bool open(const std::string &path, speed_t baud = B115200,
+              cc_t vmin = 0, cc_t vtime = 0);
+    void close();
+    bool is_open() const { return fd >= 0; }
+    int native_handle() const { return fd; }
+
+    /* Whatever the kernel has buffered, up to n bytes. Returns 0 when there
+     * is nothing to read and -1 on error */
+    ssize_t read(char* data, size_t n);
+    /* Writes all n bytes, waiting for the kernel buffer to drain if needed */
+    ssize_t write(const char* data, size_t n);
+    /* Bytes waiting in the kernel's input queue */
+    int available() const;
+
+private:
+    int fd{-1};
+    struct termios saved_options;
+    bool restore_options{false};
+};
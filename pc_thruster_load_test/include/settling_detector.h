@@ -0,0 +1,89 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file settling_detector.h
+ * Decides when a test step's thrust and current have stopped moving.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+
+struct settling_config{
+    /* Spread is judged over the most recent window_us of each stream */
+    int64_t window_us{600000};
+    /* Never settled before this long into the step */
+    int64_t min_dwell_us{800000};
+    /* Scale readings the window needs, the scale is slow */
+    size_t min_readings{4};
+    /* Standard deviation limits, grams and ADC counts */
+    double thrust_tolerance{1.0};
+    double current_tolerance{3.0};
+};
+
+/*
+ * Two sliding windows, thrust readings and current batch means, each with a
+ * running sum and sum of squares so adding and evicting are O(1). A step has
+ * settled once it is min_dwell_us old, the thrust window is full and both
+ * standard deviations are within tolerance. Without current batches only
+ * thrust is judged.
+ */
+class settling_detector{
+
+public:
+    explicit settling_detector(const settling_config &config = settling_config());
+
+    /* A new step started at `now_us`, forget the previous one */
+    void reset(int64_t now_us);
+    void add_thrust(int64_t timestamp_us, double grams);
+    void add_current(int64_t timestamp_us, double counts);
+    bool settled(int64_t now_us);
+
+private:
+    struct window{
+        std::deque<int64_t> times;
+        std::deque<double> values;
+        double sum{0};
+        double sum_sq{0};
+
+        void add(int64_t t, double v);
+        void evict(int64_t before_us);
+        void clear();
+        double stddev() const;
+    };
+
+    settling_config config;
+    int64_t step_start{0};
+    window thrust;
+    window current;
+};
@@ -0,0 +1,105 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file sim_scale_device.h
+ * Simulated HID POS scale, so USBScale runs without a scale plugged in.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <functional>
+#include "scale_device.h"
+
+struct sim_scale_config{
+    /* Status byte of consecutive reports, cycled. 0x04 is a stable weighing */
+    std::vector<uint8_t> status_sequence{0x04};
+    /* Base ten exponent and HID POS unit code (0x02 grams) of every report */
+    int8_t exponent{-1};
+    uint8_t unit{0x02};
+    uint8_t report_id{0x03};
+    /* One report per interval, 0 reports as fast as they can be taken */
+    int64_t report_interval_us{10000};
+    /* A report carries the weight as it was this long before delivery */
+    int64_t latency_us{0};
+    /* Standard deviation of gaussian noise added to the weight, in units */
+    double noise{0};
+    /* Weight in units at a monotonic_us() time, 0 when left empty */
+    std::function<double(int64_t t_us)> weight;
+};
+
+/*
+ * Produces the same 6 byte reports as the real scale, [report id, status,
+ * unit, exponent, weight lsb, weight msb], on a monotonic schedule. Weights
+ * below zero or beyond 16 bits report Under Zero/Over Weight, like a scale.
+ */
+class sim_scale_device : public scale_device{
+
+public:
+    explicit sim_scale_device(const sim_scale_config &config = sim_scale_config());
+    ~sim_scale_device();
+
+    int open() override;
+    int read_report(unsigned char* report, int length, int* transferred,
+                    unsigned int timeout_ms) override;
+
+    /* Attached reports come off a timerfd on the loop, otherwise off a
+     * generator thread. `n_transfers` means nothing here */
+    int attach(event_loop &loop) override;
+    int start_reports(report_callback callback, int n_transfers) override;
+    void stop_reports() override;
+    int next_timeout_ms() override { return -1; }
+
+    uint64_t reports_sent() const { return reports; }
+
+private:
+    sim_scale_config config;
+    bool opened{false};
+    int64_t next_report_us{0};
+    size_t status_index{0};
+    std::atomic<uint64_t> reports{0};
+    std::mt19937 rng;
+    std::normal_distribution<double> gaussian{0.0, 1.0};
+
+    event_loop* loop{nullptr};
+    int timer_fd{-1};
+    std::atomic<bool> capturing{false};
+    std::thread generator;
+    report_callback on_report;
+
+    /* Fills `report` for a delivery at `now_us` */
+    void make_report(unsigned char* report, int64_t now_us);
+    void emit(void);
+    void run_generator(void);
+};
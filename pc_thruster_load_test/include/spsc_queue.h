@@ -0,0 +1,120 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file spsc_queue.h
+ * Bounded lock-free single producer / single consumer ring buffer.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Keeps the producer and consumer indices on separate cache lines */
+#define SPSC_CACHE_LINE 64
+
+/*
+ * Exactly one thread may push and exactly one thread may pop. Capacity must
+ * be a power of two. A full queue never blocks the producer, the element is
+ * refused and counted as a drop instead, unless it offer()s and retries.
+ */
+template<typename T, size_t Capacity>
+class spsc_queue{
+
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    spsc_queue(): head(0), tail(0), drops(0), high_water(0) {}
+
+    bool try_push(const T &item) {
+      if (!offer(item)) {
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      return true;
+    }
+
+    /* try_push() without counting a drop, for a producer that retries */
+    bool offer(const T &item) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t h = head_cache;
+      if (t - h >= Capacity) {
+        /* Refresh the cached consumer index only when we look full */
+        h = head_cache = head.load(std::memory_order_acquire);
+        if (t - h >= Capacity) {
+          return false;
+        }
+      }
+      buffer[t & (Capacity - 1)] = item;
+      tail.store(t + 1, std::memory_order_release);
+      /* The cached head only overstates the depth, look at the real one
+       * when that overstatement would set a new high */
+      size_t high = high_water.load(std::memory_order_relaxed);
+      if (t + 1 - h > high) {
+        h = head_cache = head.load(std::memory_order_acquire);
+        if (t + 1 - h > high) {
+          high_water.store(t + 1 - h, std::memory_order_relaxed);
+        }
+      }
+      return true;
+    }
+
+    bool try_pop(T &item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail_cache) {
+        tail_cache = tail.load(std::memory_order_acquire);
+        if (h == tail_cache) {
+          return false;
+        }
+      }
+      item = buffer[h & (Capacity - 1)];
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /* Approximate when called from a third thread, exact from either end */
+    size_t depth() const {
+      return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return Capacity; }
+    uint64_t dropped() const { return drops.load(std::memory_order_relaxed); }
+    size_t max_depth() const { return high_water.load(std::memory_order_relaxed); }
+
+private:
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> head;
+    size_t tail_cache{0};   // consumer's last view of tail
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail;
+    size_t head_cache{0};   // producer's last view of head
+    alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> drops;
+    std::atomic<size_t> high_water;
+    alignas(SPSC_CACHE_LINE) T buffer[Capacity];
+};
@@ -0,0 +1,202 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_parser.h
+ * Decoder for the arduino's fixed telemetry lines.
+ *
+ * @author Ali AlSaibie
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bits of telemetry_sample::fields */
+enum telemetry_field{
+    TELEMETRY_SAMPLE_NO     = 1 << 0,
+    TELEMETRY_PWM           = 1 << 1,
+    TELEMETRY_CURRENT       = 1 << 2,
+    TELEMETRY_TEST_FINISHED = 1 << 3,
+    /* Only while the firmware captures rotor speed */
+    TELEMETRY_RPM           = 1 << 4,
+    TELEMETRY_REQUIRED      = TELEMETRY_SAMPLE_NO | TELEMETRY_PWM |
+                              TELEMETRY_CURRENT | TELEMETRY_TEST_FINISHED
+};
+
+struct telemetry_sample{
+    unsigned int sample_no;
+    double pwm;
+    double current;
+    bool test_finished;
+    double rpm;
+    uint32_t fields;   // which of the above were present
+};
+
+/* Largest batch the firmware sends, its CURRENT_BATCH_MAX */
+#define CURRENT_BATCH_MAX 32
+
+/* A run of ADC counts from the firmware's current stream */
+struct current_batch{
+    uint32_t start_us;      // firmware micros() of the first sample
+    uint16_t interval_us;
+    uint16_t seq;
+    uint8_t lost;           // batches the firmware dropped right before this one
+    uint8_t count;
+    uint16_t samples[CURRENT_BATCH_MAX];
+};
+
+enum STOP_SOURCE{
+    STOP_SERIAL = 0,
+    STOP_PIN
+};
+
+/* The firmware has put the ESC in neutral */
+struct stop_ack{
+    uint16_t id;            // of the Stop command, 0 for the e-stop pin
+    uint8_t source;         // STOP_SOURCE
+    uint32_t latency_us;    // firmware side, request (line or pin edge) to ack
+    uint32_t loop_max_us;   // longest firmware loop pass so far
+};
+
+/* How far the firmware's setpoint queue is, while the host streams to it */
+struct buffer_status{
+    uint32_t consumed;      // setpoints played out since the start
+    uint16_t level;         // queued right now
+    uint16_t size;          // queue capacity
+    uint16_t underruns;     // periods that found the queue empty
+    uint16_t overflows;     // setpoints dropped for want of room
+};
+
+/* The firmware's slow ADC channels, averaged over ~100 ms of readings */
+struct analog_means{
+    uint32_t start_us;      // firmware micros() of the first reading
+    uint16_t count;         // readings averaged
+    uint16_t voltage;       // supply divider, ADC counts
+    uint16_t temperature;   // chip temperature sensor, ADC counts
+};
+
+/* What the firmware's transmit buffers cost a test, sent before its final
+ * report */
+struct tx_stats{
+    uint32_t dropped;       // messages, by the TxPolicy in force
+    uint32_t dropped_bytes;
+    uint16_t peak;          // most bytes queued at once
+    uint32_t blocked_us;    // loop() time spent waiting for the host
+};
+
+/* The firmware's HX711 converts this often, each reading averages the
+ * period before it was ready */
+#define LOAD_CELL_PERIOD_US 12500
+
+/* A load cell conversion, straight off the HX711 */
+struct load_reading{
+    uint32_t ready_us;      // firmware micros() when the conversion was ready
+    int32_t counts;         // signed 24 bit, no tare or scale
+};
+
+/* The firmware's ADC channels, in the order it numbers them */
+enum SUMMARY_CHANNEL{
+    SUMMARY_CURRENT = 0,
+    SUMMARY_VOLTAGE,
+    SUMMARY_TEMPERATURE,
+    SUMMARY_CHANNELS
+};
+
+/* One channel's statistics over one step, all in ADC counts */
+struct channel_summary{
+    uint16_t sample_no;     // the step's, as in its report
+    uint8_t channel;        // SUMMARY_CHANNEL
+    uint32_t count;         // readings in the step
+    uint16_t min;
+    uint16_t max;
+    double mean;
+    double variance;        // population, counts^2
+    double rms;
+};
+
+enum TELEMETRY_KIND{
+    TELEMETRY_INVALID = 0,
+    TELEMETRY_STEP,
+    TELEMETRY_CURRENT_BATCH,
+    TELEMETRY_STOP_ACK,
+    TELEMETRY_BUFFER_STATUS,
+    TELEMETRY_TX_STATS,
+    TELEMETRY_ANALOG,
+    TELEMETRY_SUMMARY,
+    TELEMETRY_LOAD
+};
+
+/* Whatever a line or frame turned out to be, `kind` says which member is set */
+struct telemetry_message{
+    TELEMETRY_KIND kind;
+    telemetry_sample sample;
+    current_batch batch;
+    stop_ack ack;
+    buffer_status buffer;
+    tx_stats tx;
+    analog_means analog;
+    channel_summary summary;
+    load_reading load;
+};
+
+/*
+ * The firmware always sends the same flat object,
+ *   {"SampleNo":12,"Current":0,"PWM":140,"TestFinished":false}
+ * with "RPM" after "PWM" while it captures rotor speed, so the fast path
+ * scans it in place for the known keys, in any order, and never allocates.
+ * Anything else (strings, nesting, unknown keys) makes it give up and
+ * return false.
+ */
+bool parse_telemetry_fast(const char* data, size_t length, telemetry_sample &sample);
+
+/*
+ * Fast path first, then the generic nlohmann parser for lines of an
+ * unexpected shape. Returns false when the line is not valid JSON or lacks
+ * one of the TELEMETRY_REQUIRED fields.
+ */
+bool parse_telemetry(const char* data, size_t length, telemetry_sample &sample);
+
+/*
+ * Batches come as
+ *   {"Event":"Current","T0":1234,"Dt":500,"Seq":7,"Lost":0,"Current":[512,...]}
+ * and take the same in place scan. Returns false on anything else.
+ */
+bool parse_current_batch_fast(const char* data, size_t length, current_batch &batch);
+
+/* Any kind of line, fast paths first, then nlohmann. Stop acks look like
+ *   {"Event":"StopAck","Id":7,"Source":"Serial","LatencyUs":40,"LoopMaxUs":180}
+ * buffer status like
+ *   {"Event":"Buffer","Consumed":900,"Level":96,"Size":128,"Underruns":0,"Overflows":0}
+ * step summaries like
+ *   {"Event":"Summary","SampleNo":3,"Ch":"Current","N":2500,"Min":0,"Max":9,
+ *    "Mean":3.4375,"Var":2.6250,"Rms":3.7500}
+ * and load cell readings like
+ *   {"Event":"Load","T":61234567,"Counts":8012} */
+TELEMETRY_KIND parse_telemetry_line(const char* data, size_t length, telemetry_message &message);
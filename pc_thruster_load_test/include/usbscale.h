@@ -1,59 +1,106 @@
+#pragma once
 #include <stdio.h>
 #include <sys/types.h>
 #include <stdint.h>
 #include <math.h>
 #include <iostream>
+#include <functional>
+#include "event_loop.h"
+#include "monotonic_clock.h"
+#include "spsc_queue.h"
+#include "scale_device.h"
+
+//
+// What is the number of the weighing result to show, as the first result may be incorrect (from the previous weighing)
 //
-// This program uses libusb-1.0 (not the older libusb-0.1) for USB
-// functionality.
+#define WEIGH_COUNT 2
+
 //
-#include <libusb-1.0/libusb.h>
-// To enable a bunch of extra debugging data, simply define `#define DEBUG`
-// here and recompile.
+// Number of interrupt transfers kept in flight during capture, so a report is
+// never missed while a completed one is being decoded and resubmitted.
+// Ignored by devices that have no transfers.
 //
-//     #define DEBUG
+#define CAPTURE_TRANSFERS 4
 
 //
-// **NSCALES** should be kept updated with the length of the list.
+// Captured reports waiting for **poll_measurement**, newer reports are
+// dropped beyond this. Must be a power of two.
 //
-#define NSCALES 9
+#define CAPTURE_QUEUE_SIZE 1024
 
 //
-// What is the number of the weighing result to show, as the first result may be incorrect (from the previous weighing)
+// One decoded HID POS report, stamped with `monotonic_us()` on completion.
 //
-#define WEIGH_COUNT 2
+struct scale_measurement{
+  int64_t timestamp_us;
+  double weight;
+  uint8_t status;
+  uint8_t unit;
+  bool stable() const { return status == 0x04; }
+  // zero'd, weighing or stable, i.e. the weight field means something
+  bool valid() const { return status >= 0x02 && status <= 0x04; }
+};
 
-#define WEIGH_REPORT_SIZE 0x06
+typedef std::function<void(const scale_measurement&)> measurement_callback;
 
 class USBScale{
   public:
+    //
+    // The first USB scale found through libusb.
+    //
     USBScale();
+    //
+    // Any other report source, e.g. a sim_scale_device. Takes ownership.
+    //
+    explicit USBScale(scale_device* device);
     ~USBScale();
+
     int open_scale_device(void);
     double get_measurement(void);
 
+    //
+    // Continuous capture: **start_capture** has the device deliver every
+    // report as it comes in, decodes it right there and queues it for
+    // **poll_measurement**. `callback` runs right after each report is
+    // queued, e.g. to wake the consumer. When **attach** was called first the
+    // device is serviced by the caller's loop, otherwise by a thread of its
+    // own, which is then the queue's only producer.
+    //
+    int attach(event_loop &loop);
+    int start_capture(measurement_callback callback = measurement_callback(),
+                      int n_transfers = CAPTURE_TRANSFERS);
+    void stop_capture(void);
+    //
+    // Never blocks, returns false when nothing new has been captured.
+    //
+    bool poll_measurement(scale_measurement &measurement);
+    uint64_t dropped_measurements(void) const { return measurements.dropped(); }
+    size_t queued_measurements(void) const { return measurements.depth(); }
+    //
+    // Upper bound for the loop's wait so the device can service its timeouts
+    //
+    int next_timeout_ms(void);
+
   private:
 
-    libusb_device **devs;
+    scale_device* device;
     int r; // holds return codes
-    ssize_t cnt;
-    libusb_device* dev;
-    libusb_device_handle* handle;
     int weigh_count{WEIGH_COUNT-1};
     unsigned char data[WEIGH_REPORT_SIZE];
     int len;
     int scale_result{-1};
-    //
-    // **find_scale** takes a libusb device list and finds the first USB device
-    // that matches a device listed in scales.h.
-    //
-    libusb_device* find_scale(libusb_device**);
+    uint8_t last_status{0};
+
+    measurement_callback on_measurement;
+    spsc_queue<scale_measurement, CAPTURE_QUEUE_SIZE> measurements;
 
     //
-    // take device and fetch bEndpointAddress for the first endpoint
+    // **decode_report** rips apart a 6 byte HID POS report. Returns 1 when
+    // `measurement` holds a finalized weighing, 0 while the scale is still
+    // busy and -1 on fault.
     //
-    uint8_t get_first_endpoint_address(libusb_device* dev);
-
+    int decode_report(const unsigned char* report, scale_measurement &measurement);
+    void on_report(const unsigned char* report, int length, int64_t timestamp_us);
 
     //
     // **UNITS** is an array of all the unit abbreviations as set forth by *HID
@@ -77,25 +124,4 @@ class USBScale{
           "lbs"           // pound
     };
 
-    uint16_t scales[NSCALES][2] = {\
-    // Stamps.com Model 510 5LB Scale
-          {0x1446, 0x6a73},
-          // USPS (Elane) PS311 "XM Elane Elane UParcel 30lb"
-          {0x7b7c, 0x0100},
-          // Stamps.com Stainless Steel 5 lb. Digital Scale
-          {0x2474, 0x0550},
-          // Stamps.com Stainless Steel 35 lb. Digital Scale
-          {0x2474, 0x3550},
-          // Mettler Toledo
-          {0x0eb8, 0xf000},
-          // SANFORD Dymo 10 lb USB Postal Scale
-          {0x6096, 0x0158},
-          // Fairbanks Scales SCB-R9000
-          {0x0b67, 0x555e},
-          // Dymo-CoStar Corp. M25 Digital Postal Scale
-          {0x0922, 0x8004},
-          // DYMO 1772057 Digital Postal Scale
-          {0x0922, 0x8003}
-  };
-
-};
\ No newline at end of file
+};
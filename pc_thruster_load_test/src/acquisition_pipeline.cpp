@@ -0,0 +1,725 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file acquisition_pipeline.cpp
+ * Reader, merge and logger threads joined by lock-free queues.
+ *
+ * @author Ali AlSaibie
+ */
+#include "acquisition_pipeline.h"
+#include "event_loop.h"
+#include "monotonic_clock.h"
+#include "telemetry_parser.h"
+#include "cobs_frame.h"
+#include "json.hpp"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+
+using json = nlohmann::json;
+
+static void notify(int fd) {
+  uint64_t one = 1;
+  ssize_t n = write(fd, &one, sizeof(one));
+  (void) n;
+}
+
+static void clear(int fd) {
+  uint64_t count;
+  ssize_t n = read(fd, &count, sizeof(count));
+  (void) n;
+}
+
+/* Pushes the message that ends a test, however far behind the consumer
+ * is. False only once the pipeline is stopping */
+template<typename Queue, typename T>
+static bool push_final(Queue &queue, const T &item, const std::atomic<bool> &stopping) {
+  while (!queue.offer(item)) {
+    if (stopping.load()) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_RETRY_US));
+  }
+  return true;
+}
+
+/* Whether a raw line is the report flagged TestFinished */
+static bool is_final_report(const serial_line &line) {
+  telemetry_message message;
+  TELEMETRY_KIND kind = line.framing == FRAMING_COBS
+      ? decode_telemetry_frame((const uint8_t*) line.text, line.length, message)
+      : parse_telemetry_line(line.text, line.length, message);
+  return kind == TELEMETRY_STEP && message.sample.test_finished;
+}
+
+std::vector<column_spec> sample_log_columns() {
+  std::vector<column_spec> columns;
+  columns.push_back({"timestamp_us",    COLUMN_I64});
+  columns.push_back({"sample_no",       COLUMN_U32});
+  columns.push_back({"pwm",             COLUMN_F64});
+  columns.push_back({"current",         COLUMN_F64});
+  columns.push_back({"rpm",             COLUMN_F64});
+  columns.push_back({"thrust",          COLUMN_F64});
+  columns.push_back({"thrust_error_us", COLUMN_I64});
+  columns.push_back({"test_finished",   COLUMN_U8});
+  return columns;
+}
+
+std::vector<column_spec> current_log_columns() {
+  std::vector<column_spec> columns;
+  columns.push_back({"timestamp_us", COLUMN_I64});
+  columns.push_back({"device_us",    COLUMN_I64});
+  columns.push_back({"seq",          COLUMN_U32});
+  columns.push_back({"counts",       COLUMN_U32});
+  columns.push_back({"voltage",      COLUMN_U32});
+  columns.push_back({"temperature",  COLUMN_U32});
+  return columns;
+}
+
+std::vector<column_spec> summary_log_columns() {
+  std::vector<column_spec> columns;
+  columns.push_back({"timestamp_us", COLUMN_I64});
+  columns.push_back({"sample_no",    COLUMN_U32});
+  columns.push_back({"channel",      COLUMN_U8});
+  columns.push_back({"count",        COLUMN_U32});
+  columns.push_back({"mean",         COLUMN_F64});
+  columns.push_back({"min",          COLUMN_U32});
+  columns.push_back({"max",          COLUMN_U32});
+  columns.push_back({"variance",     COLUMN_F64});
+  columns.push_back({"rms",          COLUMN_F64});
+  return columns;
+}
+
+std::vector<column_spec> load_log_columns() {
+  std::vector<column_spec> columns;
+  columns.push_back({"timestamp_us", COLUMN_I64});
+  columns.push_back({"device_us",    COLUMN_I64});
+  columns.push_back({"counts",       COLUMN_I64});
+  columns.push_back({"thrust",       COLUMN_F64});
+  return columns;
+}
+
+acquisition_pipeline::acquisition_pipeline(arduino_interface &arduino_,
+                                           USBScale &scale_,
+                                           column_log_writer &log_,
+                                           column_log_writer &current_log_,
+                                           column_log_writer &summary_log_,
+                                           column_log_writer &load_log_):
+        arduino(arduino_),
+        scale(scale_),
+        log(log_),
+        current_log(current_log_),
+        summary_log(summary_log_),
+        load_log(load_log_)
+{
+  serial_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  scale_event  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  log_event    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  stop_event   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  done_event   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  for (int i = 0; i < STOP_SLOTS; i++) {
+    stop_sent_us[i] = 0;
+  }
+}
+
+acquisition_pipeline::~acquisition_pipeline() {
+  stop();
+  close(serial_event);
+  close(scale_event);
+  close(log_event);
+  close(stop_event);
+  close(done_event);
+}
+
+void acquisition_pipeline::advance_when_settled(const settling_config &config) {
+  adaptive_dwell = true;
+  settling = config;
+}
+
+void acquisition_pipeline::use_load_cell(const load_cell_config &config) {
+  load_cell = true;
+  load_config = config;
+}
+
+void acquisition_pipeline::stream_setpoints(const setpoint_source &source) {
+  setpoints = source;
+}
+
+int acquisition_pipeline::start() {
+  if (serial_event < 0 || scale_event < 0 || log_event < 0 || stop_event < 0 ||
+      done_event < 0) {
+    std::cerr << "Error: Could not create pipeline eventfds." << std::endl;
+    return -1;
+  }
+
+  /* The scale's libusb event thread is its reader, it only needs to wake us */
+  int r = scale.start_capture([this](const scale_measurement &) {
+    notify(scale_event);
+  });
+  if (r != 0) {
+    return r;
+  }
+
+  logger_thread = std::thread(&acquisition_pipeline::logger, this);
+  merge_thread  = std::thread(&acquisition_pipeline::merge, this);
+  serial_thread = std::thread(&acquisition_pipeline::serial_reader, this);
+  return 0;
+}
+
+bool acquisition_pipeline::wait(int idle_timeout_ms) {
+  uint64_t seen = lines_received;
+  while (!stopping && !wait_for(idle_timeout_ms)) {
+    if (lines_received == seen) {
+      std::cerr << "Error: Nothing from the arduino for " << idle_timeout_ms
+                << " ms, giving up on the test." << std::endl;
+      stop();
+      return false;
+    }
+    seen = lines_received;
+  }
+  return done;
+}
+
+bool acquisition_pipeline::wait_for(int timeout_ms) {
+  struct pollfd pfd = {done_event, POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) <= 0) {
+    return false;
+  }
+  if (serial_lost) {
+    /* Nothing more is coming, the test did not finish */
+    stop();
+    return true;
+  }
+  done = true;
+  if (logger_thread.joinable()) {
+    logger_thread.join();
+  }
+  stop();
+  return true;
+}
+
+int acquisition_pipeline::request_stop() {
+  uint16_t id = next_stop_id++;
+  if (id == 0) {
+    /* 0 is the firmware's own e-stop pin */
+    id = next_stop_id++;
+  }
+  json msgJson;
+  msgJson["Event"] = "Stop";
+  msgJson["Id"] = id;
+  std::string s_out = msgJson.dump();
+  stop_sent_us[id % STOP_SLOTS] = monotonic_us();
+  if (arduino.send_string(s_out) < 0) {
+    std::cerr << "Error: Could not send Stop." << std::endl;
+    return -1;
+  }
+  return id;
+}
+
+void acquisition_pipeline::send_advance(uint32_t step) {
+  json msgJson;
+  msgJson["Event"] = "Advance";
+  msgJson["Step"] = step;
+  std::string s_out = msgJson.dump();
+  if (arduino.send_string(s_out) >= 0) {
+    advances_sent++;
+  }
+}
+
+void acquisition_pipeline::send_setpoints(const buffer_status &status) {
+  /* Sent but not played out yet, some of it may still be on the wire */
+  int64_t credit = (int64_t) status.size - (uint32_t) (setpoint_index - status.consumed);
+  while (credit > 0 && !setpoints_ended) {
+    std::vector<int> values;
+    uint8_t pwm;
+    while ((int64_t) values.size() < std::min<int64_t>(credit, SETPOINT_CHUNK)) {
+      if (!setpoints(setpoint_index, pwm)) {
+        setpoints_ended = true;
+        break;
+      }
+      values.push_back(pwm);
+      setpoint_index++;
+    }
+    json msgJson;
+    msgJson["Event"] = "Setpoints";
+    msgJson["V"] = values;
+    if (setpoints_ended) {
+      msgJson["End"] = true;
+    }
+    std::string s_out = msgJson.dump();
+    if (arduino.send_string(s_out) < 0) {
+      std::cerr << "Error: Could not send Setpoints." << std::endl;
+      return;
+    }
+    setpoints_sent += values.size();
+    credit -= values.size();
+  }
+}
+
+void acquisition_pipeline::stop() {
+  stopping = true;
+  notify(stop_event);
+  if (serial_thread.joinable()) serial_thread.join();
+  if (merge_thread.joinable())  merge_thread.join();
+  if (logger_thread.joinable()) logger_thread.join();
+  scale.stop_capture();
+}
+
+pipeline_stats acquisition_pipeline::stats() const {
+  pipeline_stats s;
+  s.serial_depth     = serial_queue.depth();
+  s.scale_depth      = scale.queued_measurements();
+  s.log_depth        = log_queue.depth();
+  s.serial_max_depth = serial_queue.max_depth();
+  s.log_max_depth    = log_queue.max_depth();
+  s.serial_drops     = serial_queue.dropped();
+  s.scale_drops      = scale.dropped_measurements();
+  s.log_drops        = log_queue.dropped();
+  s.lines_received   = lines_received;
+  s.parse_errors     = parse_errors;
+  s.samples_logged   = samples_logged;
+  s.max_alignment_error_us  = max_alignment_error;
+  s.mean_alignment_error_us = mean_alignment_error;
+  s.store_bytes             = store_bytes;
+  s.current_batches         = current_batches;
+  s.analog_reports          = analog_reports;
+  s.voltage_counts          = voltage_counts;
+  s.temperature_counts      = temperature_counts;
+  s.current_samples_logged  = current_samples_logged;
+  s.current_batches_lost    = current_batches_lost;
+  s.current_drops           = current_queue.dropped();
+  s.current_max_depth       = current_queue.max_depth();
+  s.summaries               = summaries;
+  s.summary_drops           = summary_queue.dropped();
+  s.load_readings           = load_readings;
+  s.load_missed             = load_missed;
+  s.load_tare               = load_tare;
+  s.stop_acks               = stop_acks;
+  s.stop_acks_pin           = stop_acks_pin;
+  s.stop_round_trip_max_us  = stop_round_trip_max;
+  s.stop_firmware_max_us    = stop_firmware_max;
+  s.firmware_loop_max_us    = firmware_loop_max;
+  s.advances_sent           = advances_sent;
+  s.mean_step_us            = mean_step;
+  s.setpoints_sent          = setpoints_sent;
+  s.buffer_reports          = buffer_reports;
+  s.setpoint_min_level      = setpoint_min_level;
+  s.setpoint_underruns      = setpoint_underruns;
+  s.setpoint_overflows      = setpoint_overflows;
+  s.tx_stats_reports        = tx_stats_reports;
+  s.tx_dropped              = tx_dropped;
+  s.tx_dropped_bytes        = tx_dropped_bytes;
+  s.tx_peak                 = tx_peak;
+  s.tx_blocked_us           = tx_blocked_us;
+  return s;
+}
+
+void acquisition_pipeline::serial_reader() {
+  event_loop loop;
+  loop.add_fd(stop_event, EPOLLIN, [&](uint32_t) { loop.stop(); });
+  loop.add_fd(arduino.poll_fd(), EPOLLIN, [&](uint32_t events) {
+    /* Stamp on wake up, before spending any time reading the line */
+    int64_t arrival = monotonic_us();
+    frame_view frame;
+    int received;
+    while ((received = arduino.receive_frame(frame)) == 1) {
+      if (frame.length == 0) {
+        continue;
+      }
+      serial_line line;
+      line.timestamp_us = arrival;
+      line.framing = arduino.framing();
+      line.length = (uint16_t) std::min(frame.length, (size_t) SERIAL_LINE_MAX);
+      memcpy(line.text, frame.data, line.length);
+      lines_received++;
+      bool pushed = serial_queue.offer(line) ||
+          (is_final_report(line) ? push_final(serial_queue, line, stopping)
+                                 : serial_queue.try_push(line));
+      if (pushed) {
+        notify(serial_event);
+      }
+    }
+    if (received < 0 || (events & (EPOLLHUP | EPOLLERR))) {
+      /* Unplugged, the descriptor would stay ready and spin this thread */
+      std::cerr << "Error: Lost the serial port, ending the test." << std::endl;
+      loop.remove_fd(arduino.poll_fd());
+      loop.stop();
+      serial_lost = true;
+      notify(done_event);
+    }
+  });
+  while (loop.is_running()) {
+    loop.run_once(-1);
+  }
+}
+
+void acquisition_pipeline::merge() {
+  event_loop loop;
+  sample_aligner aligner;
+  device_clock clock;
+  bool have_seq = false;
+  uint16_t next_seq = 0;
+  /* Parsed samples waiting on the aligner, in the same order */
+  std::deque<sample_record> pending;
+  /* The step the firmware is dwelling on, 1 until the first report */
+  settling_detector settle(settling);
+  uint32_t step = 1;
+  bool steps_done = false;
+  int64_t last_advance = 0;
+  int64_t last_report = 0;
+  int64_t step_sum = 0;
+  uint64_t step_count = 0;
+  /* Load cell: its zero so far, and the last reading's times */
+  int64_t tare_sum = 0;
+  unsigned int tare_count = 0;
+  int64_t last_load_device = 0;
+  int64_t last_load_us = 0;
+  settle.reset(monotonic_us());
+
+  loop.add_fd(stop_event, EPOLLIN, [&](uint32_t) { loop.stop(); });
+  loop.add_fd(scale_event, EPOLLIN, [&](uint32_t) {
+    clear(scale_event);
+    scale_measurement m;
+    while (scale.poll_measurement(m)) {
+      if (m.valid() && !load_cell) {
+        aligner.add_reading(m.timestamp_us, m.weight);
+        settle.add_thrust(m.timestamp_us, m.weight);
+      }
+    }
+  });
+  loop.add_fd(serial_event, EPOLLIN, [&](uint32_t) {
+    clear(serial_event);
+    serial_line line;
+    while (serial_queue.try_pop(line)) {
+      telemetry_message message;
+      TELEMETRY_KIND kind = line.framing == FRAMING_COBS
+          ? decode_telemetry_frame((const uint8_t*) line.text, line.length, message)
+          : parse_telemetry_line(line.text, line.length, message);
+      if (kind == TELEMETRY_STOP_ACK) {
+        const stop_ack &ack = message.ack;
+        stop_acks++;
+        if (ack.source == STOP_PIN) {
+          stop_acks_pin++;
+        }
+        else {
+          int64_t sent = stop_sent_us[ack.id % STOP_SLOTS].exchange(0);
+          if (sent > 0) {
+            stop_round_trip_max = std::max<int64_t>(stop_round_trip_max, line.timestamp_us - sent);
+          }
+        }
+        stop_firmware_max = std::max(stop_firmware_max.load(), ack.latency_us);
+        firmware_loop_max = std::max(firmware_loop_max.load(), ack.loop_max_us);
+        continue;
+      }
+      if (kind == TELEMETRY_BUFFER_STATUS) {
+        const buffer_status &buffer = message.buffer;
+        buffer_reports++;
+        /* The first one comes with the start, before anything was queued,
+         * and once the profile has ended the queue is meant to run dry */
+        if (buffer_reports > 1 && !setpoints_ended &&
+            (setpoint_min_level < 0 || buffer.level < setpoint_min_level)) {
+          setpoint_min_level = buffer.level;
+        }
+        setpoint_underruns = buffer.underruns;
+        setpoint_overflows = buffer.overflows;
+        if (setpoints) {
+          send_setpoints(buffer);
+        }
+        continue;
+      }
+      if (kind == TELEMETRY_ANALOG) {
+        analog_reports++;
+        voltage_counts     = message.analog.voltage;
+        temperature_counts = message.analog.temperature;
+        continue;
+      }
+      if (kind == TELEMETRY_TX_STATS) {
+        tx_stats_reports++;
+        tx_dropped       = message.tx.dropped;
+        tx_dropped_bytes = message.tx.dropped_bytes;
+        tx_peak          = message.tx.peak;
+        tx_blocked_us    = message.tx.blocked_us;
+        continue;
+      }
+      if (kind == TELEMETRY_LOAD) {
+        const load_reading &reading = message.load;
+        int64_t ready = clock.unwrap(reading.ready_us);
+        clock.observe(ready, line.timestamp_us);
+        if (load_readings > 0 && ready - last_load_device > LOAD_CELL_PERIOD_US * 3 / 2) {
+          load_missed += (ready - last_load_device + LOAD_CELL_PERIOD_US / 2) /
+                         LOAD_CELL_PERIOD_US - 1;
+        }
+        last_load_device = ready;
+        load_readings++;
+
+        load_record load;
+        load.device_us = ready - LOAD_CELL_PERIOD_US / 2;
+        /* The aligner needs readings in order, the offset estimate moves */
+        load.timestamp_us = std::max(clock.to_host_us(load.device_us), last_load_us);
+        last_load_us = load.timestamp_us;
+        load.counts = reading.counts;
+        load.thrust = NAN;
+        if (tare_count < load_config.tare_readings) {
+          tare_sum += reading.counts;
+          tare_count++;
+          load_tare = (double) tare_sum / tare_count;
+        }
+        else if (load_config.counts_per_gram != 0) {
+          load.thrust = (reading.counts - load_tare) / load_config.counts_per_gram;
+          if (load_cell) {
+            aligner.add_reading(load.timestamp_us, load.thrust);
+            settle.add_thrust(load.timestamp_us, load.thrust);
+          }
+        }
+        if (load_queue.try_push(load)) {
+          notify(log_event);
+        }
+        continue;
+      }
+      if (kind == TELEMETRY_SUMMARY) {
+        summary_record summary;
+        summary.timestamp_us = line.timestamp_us;
+        summary.summary = message.summary;
+        summaries++;
+        if (summary_queue.try_push(summary)) {
+          notify(log_event);
+        }
+        continue;
+      }
+      if (kind == TELEMETRY_CURRENT_BATCH) {
+        current_record current;
+        current.batch = message.batch;
+        current.voltage = voltage_counts;
+        current.temperature = temperature_counts;
+        const current_batch &batch = current.batch;
+        current_batches++;
+        uint16_t missing = have_seq ? (uint16_t) (batch.seq - next_seq) : 0;
+        current_batches_lost += batch.lost + missing;
+        have_seq = true;
+        next_seq = (uint16_t) (batch.seq + 1);
+
+        /* The last sample was taken right before the batch went out */
+        current.device_us = clock.unwrap(batch.start_us);
+        int64_t span = batch.count ? (int64_t) (batch.count - 1) * batch.interval_us : 0;
+        clock.observe(current.device_us + span, line.timestamp_us);
+        current.timestamp_us = clock.to_host_us(current.device_us);
+        if (batch.count) {
+          uint32_t sum = 0;
+          for (uint8_t i = 0; i < batch.count; i++) {
+            sum += batch.samples[i];
+          }
+          settle.add_current(current.timestamp_us + span, (double) sum / batch.count);
+        }
+        if (current_queue.try_push(current)) {
+          notify(log_event);
+        }
+        continue;
+      }
+      if (kind == TELEMETRY_INVALID) {
+        if (line.framing == FRAMING_JSON) {
+          std::cerr << "Could not parse: " << std::string(line.text, line.length)
+                    << std::endl;
+        }
+        parse_errors++;
+        continue;
+      }
+      sample_record record;
+      record.timestamp_us  = line.timestamp_us;
+      const telemetry_sample &telemetry = message.sample;
+      /* The report ends one step's dwell and starts the next one's */
+      if (last_report) {
+        step_sum += line.timestamp_us - last_report;
+        step_count++;
+        mean_step = (double) step_sum / step_count;
+      }
+      last_report = line.timestamp_us;
+      step = telemetry.sample_no + 1;
+      steps_done = telemetry.test_finished;
+      settle.reset(line.timestamp_us);
+      last_advance = 0;
+      record.sample_no     = telemetry.sample_no;
+      record.pwm           = telemetry.pwm;
+      record.current       = telemetry.current;
+      record.rpm           = (telemetry.fields & TELEMETRY_RPM) ? telemetry.rpm : 0.0;
+      record.test_finished = telemetry.test_finished;
+      aligner.add_sample(record.timestamp_us);
+      pending.push_back(record);
+    }
+  });
+
+  while (loop.is_running()) {
+    int timeout_ms = aligner.next_deadline_ms(monotonic_us());
+    if (adaptive_dwell && (timeout_ms < 0 || timeout_ms > ADVANCE_RESEND_US / 1000)) {
+      /* Settling is judged on the clock too, not only when data comes in */
+      timeout_ms = ADVANCE_RESEND_US / 1000;
+    }
+    loop.run_once(timeout_ms);
+
+    sample_aligner::aligned thrust;
+    while (aligner.pop_aligned(monotonic_us(), thrust)) {
+      sample_record record = pending.front();
+      pending.pop_front();
+      record.thrust = thrust.value;
+      record.thrust_error_us = thrust.error_us;
+      bool pushed = record.test_finished ? push_final(log_queue, record, stopping)
+                                         : log_queue.try_push(record);
+      if (pushed) {
+        notify(log_event);
+      }
+    }
+    max_alignment_error  = aligner.max_error_us();
+    mean_alignment_error = aligner.mean_error_us();
+
+    int64_t now = monotonic_us();
+    if (adaptive_dwell && !steps_done && now - last_advance >= ADVANCE_RESEND_US &&
+        settle.settled(now)) {
+      send_advance(step);
+      last_advance = now;
+    }
+  }
+}
+
+void acquisition_pipeline::logger() {
+  event_loop loop;
+  loop.add_fd(stop_event, EPOLLIN, [&](uint32_t) { loop.stop(); });
+  loop.add_fd(log_event, EPOLLIN, [&](uint32_t) {
+    clear(log_event);
+    /* Batches skip the aligner, so they are never behind the samples */
+    current_record current;
+    while (current_queue.try_pop(current)) {
+      log_current(current);
+    }
+    /* A step's summary goes out ahead of its report */
+    summary_record summary;
+    while (summary_queue.try_pop(summary)) {
+      log_summary(summary);
+    }
+    load_record load;
+    while (load_queue.try_pop(load)) {
+      log_load(load);
+    }
+    sample_record record;
+    while (log_queue.try_pop(record)) {
+      /* Log Data */
+      log.set<int64_t>(SAMPLE_TIMESTAMP_US, record.timestamp_us);
+      log.set<uint32_t>(SAMPLE_NO, record.sample_no);
+      log.set<double>(SAMPLE_PWM, record.pwm);
+      log.set<double>(SAMPLE_CURRENT, record.current);
+      log.set<double>(SAMPLE_RPM, record.rpm);
+      log.set<double>(SAMPLE_THRUST, record.thrust);
+      log.set<int64_t>(SAMPLE_THRUST_ERROR_US, record.thrust_error_us);
+      log.set<uint8_t>(SAMPLE_TEST_FINISHED, record.test_finished);
+      log.end_row();
+      store.append(record);
+      store_bytes = store.bytes();
+
+      std::cout << record.sample_no << "\t";
+      std::cout << record.pwm << "\t";
+      std::cout << record.current << "\t";
+      std::cout << record.rpm << "\t";
+      std::cout << record.thrust << "\t";
+      std::cout << record.thrust_error_us << "\t";
+      std::cout << (record.test_finished ? "true" : "false") << "\n";
+      samples_logged++;
+
+      if (record.test_finished) {
+        log.flush();
+        if (current_log.is_open()) {
+          current_log.flush();
+        }
+        if (summary_log.is_open()) {
+          summary_log.flush();
+        }
+        if (load_log.is_open()) {
+          load_log.flush();
+        }
+        std::cout.flush();
+        notify(done_event);
+        loop.stop();
+        break;
+      }
+    }
+  });
+  while (loop.is_running()) {
+    loop.run_once(-1);
+  }
+}
+
+void acquisition_pipeline::log_current(const current_record &record) {
+  const current_batch &batch = record.batch;
+  if (current_log.is_open()) {
+    for (uint8_t i = 0; i < batch.count; i++) {
+      int64_t offset_us = (int64_t) i * batch.interval_us;
+      current_log.set<int64_t>(CURRENT_TIMESTAMP_US, record.timestamp_us + offset_us);
+      current_log.set<int64_t>(CURRENT_DEVICE_US, record.device_us + offset_us);
+      current_log.set<uint32_t>(CURRENT_SEQ, batch.seq);
+      current_log.set<uint32_t>(CURRENT_COUNTS, batch.samples[i]);
+      current_log.set<uint32_t>(CURRENT_VOLTAGE, record.voltage);
+      current_log.set<uint32_t>(CURRENT_TEMPERATURE, record.temperature);
+      current_log.end_row();
+    }
+  }
+  current_samples_logged += batch.count;
+}
+
+void acquisition_pipeline::log_summary(const summary_record &record) {
+  const channel_summary &summary = record.summary;
+  if (!summary_log.is_open()) {
+    return;
+  }
+  summary_log.set<int64_t>(SUMMARY_TIMESTAMP_US, record.timestamp_us);
+  summary_log.set<uint32_t>(SUMMARY_SAMPLE_NO, summary.sample_no);
+  summary_log.set<uint8_t>(SUMMARY_CHANNEL, summary.channel);
+  summary_log.set<uint32_t>(SUMMARY_COUNT, summary.count);
+  summary_log.set<double>(SUMMARY_MEAN, summary.mean);
+  summary_log.set<uint32_t>(SUMMARY_MIN, summary.min);
+  summary_log.set<uint32_t>(SUMMARY_MAX, summary.max);
+  summary_log.set<double>(SUMMARY_VARIANCE, summary.variance);
+  summary_log.set<double>(SUMMARY_RMS, summary.rms);
+  summary_log.end_row();
+}
+
+void acquisition_pipeline::log_load(const load_record &record) {
+  if (!load_log.is_open()) {
+    return;
+  }
+  load_log.set<int64_t>(LOAD_TIMESTAMP_US, record.timestamp_us);
+  load_log.set<int64_t>(LOAD_DEVICE_US, record.device_us);
+  load_log.set<int64_t>(LOAD_COUNTS, record.counts);
+  load_log.set<double>(LOAD_THRUST, record.thrust);
+  load_log.end_row();
+}
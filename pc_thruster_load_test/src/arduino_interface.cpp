@@ -35,7 +35,17 @@
  * @author Ali AlSaibie
  */
 #include "arduino_interface.h"
-arduino_interface::arduino_interface() {
+#include "monotonic_clock.h"
+#include "json.hpp"
+#include <poll.h>
+#include <algorithm>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+arduino_interface::arduino_interface(const std::string &port):
+        port_name(port)
+{
 
   if(!configure_serial()){
     exit(1);
@@ -44,94 +54,54 @@ arduino_interface::arduino_interface() {
 }
 
 bool arduino_interface::configure_serial() {
-  // Instantiate the SerialStream object then open the serial port.
-  serial_stream.Open("/dev/ttyACM0");
-
-  if (!serial_stream.good()) {
+  // Raw 8N1 at 115200 without flow control, see serial_port::open.
+  if (!serial.open(port_name, B115200)) {
     std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
               << "Error: Could not open serial port."
               << std::endl;
     return false;
   }
 
-  // Set the baud rate of the serial port.
-  serial_stream.SetBaudRate(SerialStreamBuf::BAUD_115200);
-
-  if (!serial_stream.good()) {
-    std::cerr << "Error: Could not set the baud rate." << std::endl;
-    return false;
-  }
-
-  // Set the number of data bits.
-  serial_stream.SetCharSize(SerialStreamBuf::CHAR_SIZE_8);
-
-  if (!serial_stream.good()) {
-    std::cerr << "Error: Could not set the character size." << std::endl;
-    return false;
-  }
-
-  // Disable parity.
-  serial_stream.SetParity(SerialStreamBuf::PARITY_NONE);
-
-  if (!serial_stream.good()) {
-    std::cerr << "Error: Could not disable the parity." << std::endl;
-    return false;
-  }
-
-  // Set the number of stop bits.
-  serial_stream.SetNumOfStopBits(1);
-
-  if (!serial_stream.good()) {
-    std::cerr << "Error: Could not set the number of stop bits."
-              << std::endl;
-    return false;
-  }
-
-  // Turn off hardware flow control.
-  serial_stream.SetFlowControl(SerialStreamBuf::FLOW_CONTROL_NONE);
-  if (!serial_stream.good()) {
-    std::cerr << "Error: Could not use hardware flow control."
-              << std::endl;
-    return false;
-  }
-
   std::cout<<"Serial Port Opened Successfully. Mabrook! " << std::endl;
   return true;
 }
 
 arduino_interface::~arduino_interface() {
-  serial_stream.Close();
+  serial.close();
 }
 
 int arduino_interface::send_command(arduino_interface::COMMANDS com) {
   char c[2] = {33,0};
+  std::lock_guard<std::mutex> lock(write_lock);
   switch (com){
     case P:
       c[1] = 1;
-      serial_stream.write(c, 2);
+      serial.write(c, 2);
       break;
     case S:
       c[1] = 2;
-      serial_stream.write(c, 2);
+      serial.write(c, 2);
       break;
   }
   return 0;
 }
 
 int arduino_interface::receive_data(char * data_buffer) {
-  while (serial_stream.rdbuf()->in_avail() > 0) {
-    serial_stream.get(*data_buffer);
-    std::cerr << static_cast<int>( *data_buffer ) << " ";
-    data_buffer++;
-    usleep(100);
+  ssize_t n;
+  while ((n = serial.read(data_buffer, 64)) > 0) {
+    for (ssize_t i = 0; i < n; i++) {
+      std::cerr << static_cast<int>( data_buffer[i] ) << " ";
+    }
+    data_buffer += n;
   }
   return 0;
 }
 
 int arduino_interface::receive_string(std::string &string) {
 
-  if(serial_stream.rdbuf()->in_avail() > 0){
-    string = readStringUntil('\n');
+  frame_view frame;
+  if(receive_frame(frame) == 1){
+    string.assign(frame.data, frame.length);
     return 1;
   }
   else{
@@ -140,36 +110,98 @@ int arduino_interface::receive_string(std::string &string) {
 
 }
 
-/* The following two function are adopted from arduino's library: Stream.cpp */
-std::string arduino_interface::readStringUntil(char terminator) {
-  std::string ret;
-  int c = timedRead();
-  while (c >= 0 && c != terminator)
-  {
-    ret += (char)c;
-    c = timedRead();
+int arduino_interface::receive_frame(frame_view &frame) {
+  if (framer.next_frame(frame)) {
+    return 1;
   }
-  return ret;
+  int n = fill();
+  if (n > 0 && framer.next_frame(frame)) {
+    return 1;
+  }
+  return n < 0 ? -1 : 0;
 }
 
-int arduino_interface::timedRead() {
-  int c;
-  int time_out_seconds = 1;
-  std::time_t t1 = std::time(0);
-  std::time_t t2;
-  do {
-    char character;
-    serial_stream.get(character);
-    c = (int)character;
-    if (c >= 0) return c;
-    t2 = std::time(0);
-  } while(t2 - t1 > time_out_seconds);
-  return -1;     // -1 indicates timeout
+int arduino_interface::read_frame(frame_view &frame, int64_t timeout_us) {
+  int64_t deadline = monotonic_us() + timeout_us;
+  while (receive_frame(frame) != 1) {
+    int64_t remaining = deadline - monotonic_us();
+    if (remaining <= 0) {
+      return -1;     // -1 indicates timeout
+    }
+    struct pollfd pfd = {serial.native_handle(), POLLIN, 0};
+    struct timespec ts = {(time_t) (remaining / 1000000),
+                          (long) (remaining % 1000000) * 1000};
+    ppoll(&pfd, 1, &ts, NULL);
+  }
+  return 1;
+}
+
+FRAMING arduino_interface::negotiate_framing(FRAMING requested, int64_t timeout_us) {
+  json handshake;
+  handshake["Event"] = "Handshake";
+  handshake["Framing"] = requested == FRAMING_COBS ? "COBS" : "JSON";
+
+  int64_t deadline = monotonic_us() + timeout_us;
+  int64_t resend = 0;
+  uint16_t id = 0;
+  frame_view frame;
+  while (monotonic_us() < deadline) {
+    /* A board that resets on open is not listening yet, there is no
+     * telling how long it takes, so ask until it answers */
+    if (monotonic_us() >= resend) {
+      handshake["Id"] = ++id;
+      std::string s_out = handshake.dump();
+      send_string(s_out);
+      resend = monotonic_us() + HANDSHAKE_RETRY_US;
+    }
+    if (read_frame(frame, std::min(resend, deadline) - monotonic_us()) != 1) {
+      continue;
+    }
+    try {
+      json ack = json::parse(std::string(frame.data, frame.length));
+      if (ack.at("Event") != "HandshakeAck") {
+        continue;
+      }
+      // Every resend gets its own ack, only the last one is followed by
+      // nothing but the agreed framing. Firmware without Ids acks the last
+      if (ack.value("Id", (unsigned) id) != id) {
+        // It is listening, give the answer to the last resend time to come
+        resend = monotonic_us() + HANDSHAKE_RETRY_US;
+        continue;
+      }
+      rx_framing = ack.at("Framing") == "COBS" ? FRAMING_COBS : FRAMING_JSON;
+      // Everything after the ack line comes in the agreed framing
+      framer.set_terminator(rx_framing == FRAMING_COBS ? FRAME_DELIMITER : '\n');
+      return rx_framing;
+    }
+    catch (std::exception &) {
+      // Leftover output from before the handshake
+    }
+  }
+
+  std::cerr << "No handshake from the arduino, staying with JSON" << std::endl;
+  return rx_framing;
+}
+
+int arduino_interface::fill() {
+  size_t space = framer.write_space();
+  if (space == 0) {
+    return 0;
+  }
+  ssize_t n = serial.read(framer.write_ptr(), space);
+  if (n > 0) {
+    framer.commit((size_t) n);
+  }
+  return (int) n;
 }
 
 int arduino_interface::send_string(std::string &string) {
-//  serial_stream.write(string.c_str(), string.length());
-  serial_stream << string << "\n";
+  // One write for the line and its terminator
+  std::string line = string + "\n";
+  std::lock_guard<std::mutex> lock(write_lock);
+  if (serial.write(line.data(), line.size()) < 0) {
+    return -1;
+  }
   return 1;
 }
 
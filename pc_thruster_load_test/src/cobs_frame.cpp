@@ -0,0 +1,246 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file cobs_frame.cpp
+ * COBS delimited, CRC16 checked binary frames shared with the firmware.
+ *
+ * @author Ali AlSaibie
+ */
+#include "cobs_frame.h"
+
+uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t cobs_encode(const uint8_t* in, size_t length, uint8_t* out, size_t out_size) {
+  size_t code_index = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (o >= out_size) {
+      return 0;
+    }
+    if (in[i] != 0) {
+      out[o++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[code_index] = code;
+      code = 1;
+      code_index = o;
+      if (in[i] == 0 || i + 1 < length) {
+        if (o >= out_size) {
+          return 0;
+        }
+        o++;
+      }
+    }
+  }
+  if (code_index >= out_size) {
+    return 0;
+  }
+  out[code_index] = code;
+  return o;
+}
+
+size_t cobs_decode(const uint8_t* in, size_t length, uint8_t* out, size_t out_size) {
+  size_t i = 0;
+  size_t o = 0;
+  while (i < length) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > length) {
+      return 0;
+    }
+    for (uint8_t k = 1; k < code; k++) {
+      if (o >= out_size) {
+        return 0;
+      }
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < length) {
+      if (o >= out_size) {
+        return 0;
+      }
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+int decode_frame(const uint8_t* in, size_t length, uint8_t &type,
+                 uint8_t* payload, size_t payload_size) {
+  uint8_t raw[1 + FRAME_MAX_PAYLOAD + 2];
+  size_t n = cobs_decode(in, length, raw, sizeof(raw));
+  if (n < 3) {
+    return -1;
+  }
+  uint16_t crc = (uint16_t) (raw[n - 2] | raw[n - 1] << 8);
+  if (crc16_ccitt(raw, n - 2) != crc) {
+    return -1;
+  }
+  size_t payload_length = n - 3;
+  if (payload_length > payload_size) {
+    return -1;
+  }
+  type = raw[0];
+  for (size_t i = 0; i < payload_length; i++) {
+    payload[i] = raw[1 + i];
+  }
+  return (int) payload_length;
+}
+
+bool decode_telemetry_frame(const uint8_t* in, size_t length, telemetry_sample &sample) {
+  uint8_t type = 0;
+  uint8_t payload[TELEMETRY_RPM_PAYLOAD_SIZE];
+  int n = decode_frame(in, length, type, payload, sizeof(payload));
+  /* type is only set on a well formed frame */
+  if (n < 0 || type != FRAME_TELEMETRY || n < TELEMETRY_PAYLOAD_SIZE) {
+    return false;
+  }
+  bool with_rpm = (payload[6] & TELEMETRY_FLAG_RPM) != 0;
+  if (n != (with_rpm ? TELEMETRY_RPM_PAYLOAD_SIZE : TELEMETRY_PAYLOAD_SIZE)) {
+    return false;
+  }
+  sample.sample_no     = (unsigned int) (payload[0] | payload[1] << 8);
+  sample.pwm           = (double) (payload[2] | payload[3] << 8);
+  sample.current       = (double) (payload[4] | payload[5] << 8);
+  sample.test_finished = (payload[6] & TELEMETRY_FLAG_FINISHED) != 0;
+  sample.fields        = TELEMETRY_REQUIRED;
+  if (with_rpm) {
+    sample.rpm     = (double) (payload[7] | payload[8] << 8);
+    sample.fields |= TELEMETRY_RPM;
+  }
+  return true;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+  return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+TELEMETRY_KIND decode_telemetry_frame(const uint8_t* in, size_t length, telemetry_message &message) {
+  uint8_t type = 0;
+  uint8_t payload[CURRENT_BATCH_HEADER_SIZE + 2 * CURRENT_BATCH_MAX];
+  message.kind = TELEMETRY_INVALID;
+  int n = decode_frame(in, length, type, payload, sizeof(payload));
+  if (n < 0) {
+    return TELEMETRY_INVALID;
+  }
+  if (type == FRAME_TELEMETRY) {
+    if (!decode_telemetry_frame(in, length, message.sample)) {
+      return TELEMETRY_INVALID;
+    }
+    return message.kind = TELEMETRY_STEP;
+  }
+  if (type == FRAME_STOP_ACK) {
+    if (n != STOP_ACK_PAYLOAD_SIZE) {
+      return TELEMETRY_INVALID;
+    }
+    message.ack.id          = (uint16_t) (payload[0] | payload[1] << 8);
+    message.ack.source      = payload[2];
+    message.ack.latency_us  = get_u32(&payload[3]);
+    message.ack.loop_max_us = get_u32(&payload[7]);
+    return message.kind = TELEMETRY_STOP_ACK;
+  }
+  if (type == FRAME_BUFFER_STATUS) {
+    if (n != BUFFER_STATUS_PAYLOAD_SIZE) {
+      return TELEMETRY_INVALID;
+    }
+    message.buffer.consumed  = get_u32(&payload[0]);
+    message.buffer.level     = (uint16_t) (payload[4] | payload[5] << 8);
+    message.buffer.size      = (uint16_t) (payload[6] | payload[7] << 8);
+    message.buffer.underruns = (uint16_t) (payload[8] | payload[9] << 8);
+    message.buffer.overflows = (uint16_t) (payload[10] | payload[11] << 8);
+    return message.kind = TELEMETRY_BUFFER_STATUS;
+  }
+  if (type == FRAME_TX_STATS) {
+    if (n != TX_STATS_PAYLOAD_SIZE) {
+      return TELEMETRY_INVALID;
+    }
+    message.tx.dropped       = get_u32(&payload[0]);
+    message.tx.dropped_bytes = get_u32(&payload[4]);
+    message.tx.peak          = (uint16_t) (payload[8] | payload[9] << 8);
+    message.tx.blocked_us    = get_u32(&payload[10]);
+    return message.kind = TELEMETRY_TX_STATS;
+  }
+  if (type == FRAME_ANALOG) {
+    if (n != ANALOG_PAYLOAD_SIZE) {
+      return TELEMETRY_INVALID;
+    }
+    message.analog.start_us    = get_u32(&payload[0]);
+    message.analog.count       = (uint16_t) (payload[4] | payload[5] << 8);
+    message.analog.voltage     = (uint16_t) (payload[6] | payload[7] << 8);
+    message.analog.temperature = (uint16_t) (payload[8] | payload[9] << 8);
+    return message.kind = TELEMETRY_ANALOG;
+  }
+  if (type == FRAME_LOAD) {
+    if (n != LOAD_PAYLOAD_SIZE) {
+      return TELEMETRY_INVALID;
+    }
+    message.load.ready_us = get_u32(&payload[0]);
+    message.load.counts   = (int32_t) get_u32(&payload[4]);
+    return message.kind = TELEMETRY_LOAD;
+  }
+  if (type == FRAME_SUMMARY) {
+    if (n != SUMMARY_PAYLOAD_SIZE || payload[2] >= SUMMARY_CHANNELS) {
+      return TELEMETRY_INVALID;
+    }
+    message.summary.sample_no = (uint16_t) (payload[0] | payload[1] << 8);
+    message.summary.channel   = payload[2];
+    message.summary.count     = get_u32(&payload[3]);
+    message.summary.min       = (uint16_t) (payload[7] | payload[8] << 8);
+    message.summary.max       = (uint16_t) (payload[9] | payload[10] << 8);
+    message.summary.mean      = (uint16_t) (payload[11] | payload[12] << 8) / 16.0;
+    message.summary.variance  = get_u32(&payload[13]) / 16.0;
+    message.summary.rms       = (uint16_t) (payload[17] | payload[18] << 8) / 16.0;
+    return message.kind = TELEMETRY_SUMMARY;
+  }
+  if (type != FRAME_CURRENT_BATCH || n < CURRENT_BATCH_HEADER_SIZE ||
+      payload[9] > CURRENT_BATCH_MAX || n != CURRENT_BATCH_HEADER_SIZE + 2 * payload[9]) {
+    return TELEMETRY_INVALID;
+  }
+  current_batch &batch = message.batch;
+  batch.start_us    = get_u32(&payload[0]);
+  batch.interval_us = (uint16_t) (payload[4] | payload[5] << 8);
+  batch.seq         = (uint16_t) (payload[6] | payload[7] << 8);
+  batch.lost        = payload[8];
+  batch.count       = payload[9];
+  for (uint8_t i = 0; i < batch.count; i++) {
+    const uint8_t* p = &payload[CURRENT_BATCH_HEADER_SIZE + 2 * i];
+    batch.samples[i] = (uint16_t) (p[0] | p[1] << 8);
+  }
+  return message.kind = TELEMETRY_CURRENT_BATCH;
+}
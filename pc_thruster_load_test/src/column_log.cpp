@@ -0,0 +1,344 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file column_log.cpp
+ * Append-only columnar binary log, written in aligned chunks, read by mmap.
+ *
+ * @author Ali AlSaibie
+ */
+#include "column_log.h"
+#include "monotonic_clock.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <iostream>
+
+static const uint8_t COLUMN_SIZES[] = {1, 4, 8, 8};
+
+static size_t round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+//
+// Slicing-by-8: eight tables let the loop take eight bytes per step, which
+// keeps verifying a column close to the speed of just reading it.
+//
+static uint32_t crc_tables[8][256];
+
+static bool init_crc_tables() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int bit = 0; bit < 8; bit++) {
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    crc_tables[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int t = 1; t < 8; t++) {
+      uint32_t c = crc_tables[t - 1][i];
+      crc_tables[t][i] = crc_tables[0][c & 0xFF] ^ (c >> 8);
+    }
+  }
+  return true;
+}
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+  static const bool tables_ready = init_crc_tables();
+  (void) tables_ready;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  while (length >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = crc_tables[7][lo & 0xFF] ^ crc_tables[6][(lo >> 8) & 0xFF] ^
+          crc_tables[5][(lo >> 16) & 0xFF] ^ crc_tables[4][lo >> 24] ^
+          crc_tables[3][hi & 0xFF] ^ crc_tables[2][(hi >> 8) & 0xFF] ^
+          crc_tables[1][(hi >> 16) & 0xFF] ^ crc_tables[0][hi >> 24];
+    p += 8;
+    length -= 8;
+  }
+  while (length--) {
+    crc = crc_tables[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/* write(2) until everything is out */
+static int write_all(int fd, const unsigned char* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error: Could not write log: " << strerror(errno) << std::endl;
+      return -1;
+    }
+    data += n;
+    length -= n;
+  }
+  return 0;
+}
+
+//
+// Writer
+// ------
+//
+column_log_writer::column_log_writer() {
+  memset(&header, 0, sizeof(header));
+}
+
+column_log_writer::~column_log_writer() {
+  close();
+}
+
+int column_log_writer::open(const std::string &path,
+                            const std::vector<column_spec> &columns,
+                            const column_log_info &info, uint32_t chunk_rows) {
+  if (columns.empty() || columns.size() > COLUMN_LOG_MAX_COLUMNS || chunk_rows == 0) {
+    std::cerr << "Error: Bad log layout for " << path << std::endl;
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COLUMN_LOG_MAGIC, sizeof(header.magic));
+  header.version     = COLUMN_LOG_VERSION;
+  header.header_size = COLUMN_LOG_HEADER_SIZE;
+  header.chunk_rows  = chunk_rows;
+  header.n_columns   = (uint32_t) columns.size();
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  header.created_unix_us = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+  header.created_monotonic_us = monotonic_us();
+  header.info = info;
+
+  /* Each column a contiguous array, cache line aligned within the chunk */
+  size_t offset = COLUMN_LOG_CHUNK_HEADER_SIZE;
+  for (size_t i = 0; i < columns.size(); i++) {
+    column_desc &desc = header.columns[i];
+    strncpy(desc.name, columns[i].name, sizeof(desc.name) - 1);
+    desc.type   = columns[i].type;
+    desc.size   = COLUMN_SIZES[columns[i].type];
+    desc.offset = (uint32_t) offset;
+    offset = round_up(offset + (size_t) desc.size * chunk_rows, 64);
+  }
+  header.chunk_size = (uint32_t) round_up(offset, COLUMN_LOG_ALIGN);
+  header.crc = crc32(&header, offsetof(column_log_header, crc));
+
+  void* buffer = NULL;
+  if (posix_memalign(&buffer, COLUMN_LOG_ALIGN, header.chunk_size) != 0) {
+    std::cerr << "Error: Could not allocate log chunk" << std::endl;
+    return -1;
+  }
+  chunk = static_cast<unsigned char*>(buffer);
+  memset(chunk, 0, header.chunk_size);
+
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "Error: Could not open log " << path << ": " << strerror(errno)
+              << std::endl;
+    free(chunk);
+    chunk = NULL;
+    return -1;
+  }
+
+  /* The header takes a whole page so chunks start aligned. The chunk buffer
+   * is at least a page and still empty, stage it there */
+  memcpy(chunk, &header, sizeof(header));
+  int r = write_all(fd, chunk, COLUMN_LOG_HEADER_SIZE);
+  memset(chunk, 0, COLUMN_LOG_HEADER_SIZE);
+  row = 0;
+  chunk_index = 0;
+  rows_total = 0;
+  if (r != 0) {
+    close();
+  }
+  return r;
+}
+
+int column_log_writer::end_row() {
+  row++;
+  rows_total++;
+  if (row == header.chunk_rows) {
+    return write_chunk();
+  }
+  return 0;
+}
+
+int column_log_writer::flush() {
+  if (fd < 0 || row == 0) {
+    return 0;
+  }
+  return write_chunk();
+}
+
+int column_log_writer::write_chunk() {
+  column_log_chunk chunk_header;
+  memset(&chunk_header, 0, sizeof(chunk_header));
+  chunk_header.magic = COLUMN_LOG_CHUNK_MAGIC;
+  chunk_header.rows  = row;
+  chunk_header.index = chunk_index;
+  for (uint32_t i = 0; i < header.n_columns; i++) {
+    const column_desc &desc = header.columns[i];
+    chunk_header.column_crc[i] = crc32(chunk + desc.offset, (size_t) desc.size * row);
+  }
+  chunk_header.crc = crc32(&chunk_header, offsetof(column_log_chunk, crc));
+  memcpy(chunk, &chunk_header, sizeof(chunk_header));
+
+  int r = write_all(fd, chunk, header.chunk_size);
+  memset(chunk, 0, header.chunk_size);
+  row = 0;
+  chunk_index++;
+  return r;
+}
+
+int column_log_writer::close() {
+  int r = flush();
+  if (fd >= 0) {
+    if (::close(fd) != 0) {
+      r = -1;
+    }
+    fd = -1;
+  }
+  free(chunk);
+  chunk = NULL;
+  return r;
+}
+
+//
+// Reader
+// ------
+//
+column_log_reader::column_log_reader() {
+}
+
+column_log_reader::~column_log_reader() {
+  close();
+}
+
+int column_log_reader::open(const std::string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Error: Could not open log " << path << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(column_log_header)) {
+    std::cerr << "Error: " << path << " is not a column log" << std::endl;
+    ::close(fd);
+    return -1;
+  }
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "Error: Could not map log " << path << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+  map = static_cast<const unsigned char*>(mapped);
+  map_size = st.st_size;
+  header = reinterpret_cast<const column_log_header*>(map);
+
+  if (memcmp(header->magic, COLUMN_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != COLUMN_LOG_VERSION ||
+      header->crc != crc32(header, offsetof(column_log_header, crc)) ||
+      header->n_columns > COLUMN_LOG_MAX_COLUMNS ||
+      header->header_size < sizeof(column_log_header) || header->chunk_size == 0) {
+    std::cerr << "Error: " << path << " has a bad log header" << std::endl;
+    close();
+    return -1;
+  }
+  n_chunks = map_size < header->header_size
+      ? 0 : (map_size - header->header_size) / header->chunk_size;
+  return 0;
+}
+
+void column_log_reader::close() {
+  if (map != NULL) {
+    munmap(const_cast<unsigned char*>(map), map_size);
+  }
+  map = NULL;
+  map_size = 0;
+  header = NULL;
+  n_chunks = 0;
+}
+
+int column_log_reader::find_column(const std::string &name) const {
+  for (uint32_t i = 0; i < header->n_columns; i++) {
+    if (name == header->columns[i].name) {
+      return (int) i;
+    }
+  }
+  return -1;
+}
+
+uint32_t column_log_reader::chunk_rows(size_t chunk) const {
+  const column_log_chunk* c = reinterpret_cast<const column_log_chunk*>(chunk_base(chunk));
+  if (c->magic != COLUMN_LOG_CHUNK_MAGIC || c->rows > header->chunk_rows) {
+    return 0;
+  }
+  return c->rows;
+}
+
+uint64_t column_log_reader::rows() const {
+  uint64_t total = 0;
+  for (size_t k = 0; k < n_chunks; k++) {
+    total += chunk_rows(k);
+  }
+  return total;
+}
+
+bool column_log_reader::verify(size_t chunk, int column) const {
+  const column_log_chunk* c = reinterpret_cast<const column_log_chunk*>(chunk_base(chunk));
+  if (c->magic != COLUMN_LOG_CHUNK_MAGIC || c->rows > header->chunk_rows ||
+      c->crc != crc32(c, offsetof(column_log_chunk, crc))) {
+    return false;
+  }
+  uint32_t first = column < 0 ? 0 : (uint32_t) column;
+  uint32_t last  = column < 0 ? header->n_columns : (uint32_t) column + 1;
+  for (uint32_t i = first; i < last && i < header->n_columns; i++) {
+    const column_desc &desc = header->columns[i];
+    if (c->column_crc[i] != crc32(chunk_base(chunk) + desc.offset,
+                                  (size_t) desc.size * c->rows)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file event_loop.cpp
+ * epoll based reactor that dispatches fd readiness to callbacks.
+ *
+ * @author Ali AlSaibie
+ */
+#include "event_loop.h"
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+
+event_loop::event_loop(): epoll_fd(-1),
+                          running(true)
+{
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
+              << "Error: Could not create epoll instance: "
+              << strerror(errno) << std::endl;
+  }
+}
+
+event_loop::~event_loop() {
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+  }
+}
+
+int event_loop::add_fd(int fd, uint32_t events, fd_callback callback) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    std::cerr << "Error: Could not add fd " << fd << " to epoll: "
+              << strerror(errno) << std::endl;
+    return -1;
+  }
+  callbacks[fd] = callback;
+  return 0;
+}
+
+int event_loop::modify_fd(int fd, uint32_t events) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int event_loop::remove_fd(int fd) {
+  callbacks.erase(fd);
+  return epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int event_loop::run_once(int timeout_ms) {
+  struct epoll_event events[MAX_EVENTS];
+  int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+  if (n < 0) {
+    /* A signal is not an error, just nothing to dispatch */
+    return errno == EINTR ? 0 : -1;
+  }
+  for (int i = 0; i < n; i++) {
+    /* A callback may have removed a later fd from the set */
+    std::map<int, fd_callback>::iterator it = callbacks.find(events[i].data.fd);
+    if (it != callbacks.end()) {
+      fd_callback callback = it->second;
+      callback(events[i].events);
+    }
+  }
+  return n;
+}
+
+void event_loop::stop() {
+  running = false;
+}
@@ -0,0 +1,429 @@
+/****
+    usbscale
+
+    CPP utility to read weight from a USB scale.
+    Copyright (C) 2011 Eric Jiang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ - Modified by Ali AlSaibie from C to CPP and to suit <alsaibie@gatech.edu>
+
+*/
+
+#include "libusb_scale_device.h"
+#include "monotonic_clock.h"
+#include <poll.h>
+
+libusb_scale_device::libusb_scale_device() {
+
+}
+
+int libusb_scale_device::open() {
+
+  //
+  // We first try to init libusb.
+  //
+  r = libusb_init(NULL);
+  //
+  // If `libusb_init` errored, then we quit immediately.
+  //
+  if (r < 0)
+    return r;
+
+  #ifdef DEBUG
+    libusb_set_debug(NULL, 3);
+  #endif
+
+  //
+  // Next, we try to get a list of USB devices on this computer.
+  cnt = libusb_get_device_list(NULL, &devs);
+  if (cnt < 0)
+    return (int) cnt;
+
+  //
+  // Once we have the list, we use **find_scale** to loop through and match
+  // every device against the scales.h list. **find_scale** will return the
+  // first device that matches, or 0 if none of them matched.
+  //
+  dev = find_scale(devs);
+  if(dev == 0) {
+    std::cerr<<"No USB scale found on this computer."<<std::endl;
+    return -1;
+  }
+
+  //
+  // Once we have a pointer to the USB scale in question, we open it.
+  //
+  r = libusb_open(dev, &handle);
+  //
+  // Note that this requires that we have permission to access this device.
+  // If you get the "permission denied" error, check your udev rules.
+  //
+  if(r < 0) {
+    if(r == LIBUSB_ERROR_ACCESS) {
+      std::cerr<<"Permission denied to scale."<<std::endl;
+    }
+    else if(r == LIBUSB_ERROR_NO_DEVICE) {
+      std::cerr<<"Scale has been disconnected"<<std::endl;
+    }
+    return -1;
+  }
+  //
+  // On Linux, we typically need to detach the kernel driver so that we can
+  // handle this USB device. We are a userspace tool, after all.
+  //
+#ifdef __linux__
+  libusb_detach_kernel_driver(handle, 0);
+#endif
+  //
+  // Finally, we can claim the interface to this device and begin I/O.
+  //
+  libusb_claim_interface(handle, 0);
+  endpoint = get_first_endpoint_address(dev);
+  opened = true;
+
+  //
+  // For some reason, we get old data the first time, so let's just get that
+  // out of the way now. It can't hurt to grab another packet from the scale.
+  //
+  unsigned char stale[WEIGH_REPORT_SIZE];
+  int len;
+  r = libusb_interrupt_transfer(
+          handle,
+          //bmRequestType => direction: in, type: class,
+          //    recipient: interface
+          LIBUSB_ENDPOINT_IN | //LIBUSB_REQUEST_TYPE_CLASS |
+          LIBUSB_RECIPIENT_INTERFACE,
+          stale,
+          WEIGH_REPORT_SIZE, // length of data
+          &len,
+          10000 //timeout => 10 sec
+  );
+
+  return r;
+
+
+}
+
+int libusb_scale_device::read_report(unsigned char* report, int length,
+                                     int* transferred, unsigned int timeout_ms) {
+  //
+  // A `libusb_interrupt_transfer` of 6 bytes from the scale is the
+  // typical scale data packet, and the usage is laid out in *HID Point
+  // of Sale Usage Tables*, version 1.02.
+  //
+  return libusb_interrupt_transfer(handle, endpoint, report, length,
+                                   transferred, timeout_ms);
+}
+
+//
+// Event driven capture
+// --------------------
+//
+// libusb exposes the descriptors it waits on internally. We hand them to the
+// caller's `event_loop`, so that a completed interrupt transfer is serviced
+// as soon as the kernel reports it instead of on the next poll of the scale.
+// Without a loop, **start_reports** runs libusb's event handling on its own
+// thread.
+//
+int libusb_scale_device::attach(event_loop &event_loop_) {
+  loop = &event_loop_;
+
+  const libusb_pollfd** pollfds = libusb_get_pollfds(NULL);
+  if (pollfds == NULL) {
+    std::cerr << "Could not get libusb pollfds" << std::endl;
+    return -1;
+  }
+  for (int i = 0; pollfds[i] != NULL; i++) {
+    pollfd_added(pollfds[i]->fd, pollfds[i]->events, this);
+  }
+  libusb_free_pollfds(pollfds);
+
+  //
+  // libusb may open or close descriptors later on, keep the loop in sync.
+  //
+  libusb_set_pollfd_notifiers(NULL, &libusb_scale_device::pollfd_added,
+                              &libusb_scale_device::pollfd_removed, this);
+  return 0;
+}
+
+void libusb_scale_device::pollfd_added(int fd, short events, void* user_data) {
+  libusb_scale_device* self = static_cast<libusb_scale_device*>(user_data);
+  uint32_t epoll_events = 0;
+  if (events & POLLIN)  epoll_events |= EPOLLIN;
+  if (events & POLLOUT) epoll_events |= EPOLLOUT;
+  self->loop->add_fd(fd, epoll_events, [self](uint32_t) {
+    self->handle_events();
+  });
+}
+
+void libusb_scale_device::pollfd_removed(int fd, void* user_data) {
+  libusb_scale_device* self = static_cast<libusb_scale_device*>(user_data);
+  self->loop->remove_fd(fd);
+}
+
+void libusb_scale_device::handle_events() {
+  //
+  // Only called once epoll says a descriptor is ready, so never wait here.
+  //
+  struct timeval zero_tv = {0, 0};
+  libusb_handle_events_timeout_completed(NULL, &zero_tv, NULL);
+}
+
+int libusb_scale_device::next_timeout_ms() {
+  struct timeval tv;
+  int r = libusb_get_next_timeout(NULL, &tv);
+  if (r <= 0) {
+    // No pending libusb timeout, sleep until something is ready
+    return -1;
+  }
+  return (int) (tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+}
+
+int libusb_scale_device::start_reports(report_callback callback, int n_transfers) {
+  on_report = callback;
+  capturing = true;
+  transfer_errors = 0;
+
+  transfer_data.assign(n_transfers * WEIGH_REPORT_SIZE, 0);
+  for (int i = 0; i < n_transfers; i++) {
+    libusb_transfer* transfer = libusb_alloc_transfer(0);
+    if (transfer == NULL) {
+      stop_reports();
+      return LIBUSB_ERROR_NO_MEM;
+    }
+    transfers.push_back(transfer);
+    libusb_fill_interrupt_transfer(
+            transfer,
+            handle,
+            endpoint,
+            &transfer_data[i * WEIGH_REPORT_SIZE],
+            WEIGH_REPORT_SIZE,
+            &libusb_scale_device::transfer_complete,
+            this,
+            0 // no timeout, the scale reports when it has something
+    );
+    int r = libusb_submit_transfer(transfer);
+    if (r != 0) {
+      std::cerr << "Could not submit scale transfer: "
+                << libusb_error_name(r) << std::endl;
+      stop_reports();
+      return r;
+    }
+    transfers_in_flight++;
+  }
+
+  //
+  // Nobody else is servicing libusb, so give it a thread of its own.
+  //
+  if (loop == NULL) {
+    event_thread = std::thread(&libusb_scale_device::run_event_thread, this);
+  }
+  return 0;
+}
+
+void libusb_scale_device::run_event_thread() {
+  struct timeval tv = {0, 100000};
+  while (transfers_in_flight > 0) {
+    if (libusb_handle_events_timeout_completed(NULL, &tv, NULL) < 0) {
+      break;
+    }
+  }
+}
+
+void libusb_scale_device::stop_reports() {
+  capturing = false;
+  for (size_t i = 0; i < transfers.size(); i++) {
+    libusb_cancel_transfer(transfers[i]);
+  }
+
+  //
+  // Transfers may only be freed once libusb delivered their cancellation.
+  //
+  if (event_thread.joinable()) {
+    event_thread.join();
+  }
+  else {
+    struct timeval tv = {0, 100000};
+    while (transfers_in_flight > 0) {
+      if (libusb_handle_events_timeout_completed(NULL, &tv, NULL) < 0) {
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < transfers.size(); i++) {
+    libusb_free_transfer(transfers[i]);
+  }
+  transfers.clear();
+}
+
+void libusb_scale_device::transfer_complete(libusb_transfer* transfer) {
+  libusb_scale_device* self = static_cast<libusb_scale_device*>(transfer->user_data);
+  int64_t now = monotonic_us();
+
+  if (transfer->status == LIBUSB_TRANSFER_CANCELLED ||
+      transfer->status == LIBUSB_TRANSFER_NO_DEVICE ||
+      !self->capturing) {
+    self->transfers_in_flight--;
+    return;
+  }
+
+  if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+    self->transfer_errors = 0;
+    self->on_report(transfer->buffer, transfer->actual_length, now);
+  }
+  else {
+    int errors = ++self->transfer_errors;
+    if (errors == 1) {
+      std::cerr << "Error in USB transfer" << std::endl;
+    }
+    if (errors >= SCALE_TRANSFER_RETRIES) {
+      //
+      // Let this one lapse, the others follow as they fail in turn.
+      //
+      if (errors == SCALE_TRANSFER_RETRIES) {
+        std::cerr << "USB transfers keep failing, no more scale readings"
+                  << std::endl;
+      }
+      self->transfers_in_flight--;
+      return;
+    }
+  }
+
+  //
+  // Put the transfer straight back in flight, the others cover the gap.
+  //
+  if (libusb_submit_transfer(transfer) != 0) {
+    self->transfers_in_flight--;
+  }
+}
+
+libusb_scale_device::~libusb_scale_device() {
+
+  //
+  // The loop may be gone by now, stop telling it about libusb's descriptors.
+  //
+  if (loop != NULL) {
+    libusb_set_pollfd_notifiers(NULL, NULL, NULL, NULL);
+  }
+
+  stop_reports();
+
+  if (!opened) {
+    if (devs != NULL) {
+      libusb_free_device_list(devs, 1);
+    }
+    libusb_exit(NULL);
+    return;
+  }
+
+  //
+  // At the end, we make sure that we reattach the kernel driver that we
+  // detached earlier, close the handle to the device, free the device list
+  // that we retrieved, and exit libusb.
+  //
+  #ifdef __linux__
+    libusb_attach_kernel_driver(handle, 0);
+  #endif
+    libusb_close(handle);
+    libusb_free_device_list(devs, 1);
+    libusb_exit(NULL);
+}
+
+
+//
+// find_scale
+// ----------
+// 
+// **find_scale** takes a `libusb_device\*\*` list and loop through it,
+// matching each device's vendor and product IDs to the scales.h list. It
+// return the first matching `libusb_device\*` or 0 if no matching device is
+// found.
+//
+libusb_device * libusb_scale_device::find_scale(libusb_device **devs)
+{
+
+    int i = 0;
+    libusb_device* dev = 0;
+
+    //
+    // Loop through each USB device, and for each device, loop through the
+    // scales list to see if it's one of our listed scales.
+    //
+    while ((dev = devs[i++]) != NULL) {
+        struct libusb_device_descriptor desc;
+        int r = libusb_get_device_descriptor(dev, &desc);
+        if (r < 0) {
+          std::cerr<<"failed to get device descriptor"<<std::endl;
+            return NULL;
+        }
+        int i;
+        for (i = 0; i < NSCALES; i++) {
+            if(desc.idVendor  == scales[i][0] && 
+               desc.idProduct == scales[i][1]) {
+                /*
+                 * Debugging data about found scale
+                 */
+#ifdef DEBUG
+
+              std::cerr<<"Found scale "<<desc.idVendor<<":"<<desc.idProduct<<" bus "
+                       << static_cast<unsigned>(libusb_get_bus_number(dev))
+                       <<" device "<< static_cast<unsigned>(libusb_get_device_address(dev))<<std::endl;
+              std::cerr<<"It has descriptors:\n"
+                       <<"manufc: "    << static_cast<unsigned>(desc.iManufacturer)   <<"\n"
+                       <<"tprodct: "   << static_cast<unsigned>(desc.iProduct)        <<"\n"
+                       <<"serial: "    << static_cast<unsigned>(desc.iSerialNumber)   <<"\n"
+                       <<"class: "     << static_cast<unsigned>(desc.bDeviceClass)    <<"\n"
+                       <<"subclass: "  << static_cast<unsigned>(desc.bDeviceSubClass) <<std::endl;
+
+                    /*
+                     * A char buffer to pull string descriptors in from the device
+                     */
+                    unsigned char string[256];
+                    libusb_device_handle* hand;
+                    libusb_open(dev, &hand);
+
+                    r = libusb_get_string_descriptor_ascii(hand, desc.iManufacturer,
+                            string, 256);
+              std::cerr<<"Manufacturer: "<<string<<std::endl;
+                    libusb_close(hand);
+#endif
+                    return dev;
+
+            }
+        }
+    }
+    return NULL;
+}
+
+uint8_t libusb_scale_device::get_first_endpoint_address(libusb_device* dev)
+{
+    // default value
+    uint8_t endpoint_address = LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_INTERFACE; //| LIBUSB_RECIPIENT_ENDPOINT;
+
+    struct libusb_config_descriptor *config;
+    int r = libusb_get_config_descriptor(dev, 0, &config);
+    if (r == 0) {
+        // assuming we have only one endpoint
+        endpoint_address = config->interface[0].altsetting[0].endpoint[0].bEndpointAddress;
+        libusb_free_config_descriptor(config);
+    }
+
+    #ifdef DEBUG
+    printf("bEndpointAddress 0x%02x\n", endpoint_address);
+    #endif
+
+    return endpoint_address;
+}
@@ -0,0 +1,108 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file line_framer.cpp
+ * Splits a byte stream into terminator delimited frames without copying.
+ *
+ * @author Ali AlSaibie
+ */
+#include "line_framer.h"
+#include <string.h>
+
+line_framer::line_framer(size_t capacity, char terminator_):
+        buffer(capacity),
+        terminator(terminator_)
+{
+
+}
+
+char* line_framer::write_ptr() {
+  compact();
+  return buffer.data() + end;
+}
+
+size_t line_framer::write_space() {
+  compact();
+  if (end == buffer.size() && begin == 0) {
+    /* One frame bigger than the buffer, it can never complete. Drop it */
+    overflow_count++;
+    clear();
+    discarding = true;
+  }
+  return buffer.size() - end;
+}
+
+void line_framer::commit(size_t n) {
+  end += n;
+}
+
+bool line_framer::next_frame(frame_view &frame) {
+  const char* found = (const char*) memchr(buffer.data() + scan, terminator, end - scan);
+  if (found == NULL) {
+    /* Do not search these bytes again on the next commit */
+    scan = end;
+    return false;
+  }
+
+  size_t stop = found - buffer.data();
+  frame.data = buffer.data() + begin;
+  frame.length = stop - begin;
+  if (terminator == '\n' && frame.length > 0 && frame.data[frame.length - 1] == '\r') {
+    frame.length--;
+  }
+  begin = scan = stop + 1;
+
+  if (discarding) {
+    /* Tail of the frame that overflowed */
+    discarding = false;
+    return next_frame(frame);
+  }
+  return true;
+}
+
+void line_framer::compact() {
+  if (begin == 0) {
+    return;
+  }
+  if (begin == end) {
+    begin = scan = end = 0;
+    return;
+  }
+  /* Only worth moving once the tail is getting close to the end */
+  if (buffer.size() - end >= buffer.size() / 4) {
+    return;
+  }
+  size_t remaining = end - begin;
+  memmove(buffer.data(), buffer.data() + begin, remaining);
+  scan -= begin;
+  end = remaining;
+  begin = 0;
+}
@@ -1,19 +1,155 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
 #include <unistd.h>
 #include <cstdlib>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 #include "arduino_interface.h"
 #include "json.hpp"
 #include "usbscale.h"
+#include "libusb_scale_device.h"
+#include "sim_scale_device.h"
+#include "acquisition_pipeline.h"
 #define DEBUG
 #define wait_a_sec 1000000L
+/* Telemetry reports per second while streaming setpoints */
+#define STREAM_REPORT_HZ 50
 
 using json = nlohmann::json;
 using namespace std;
 
-int main()
+int main(int argc, char** argv)
 {
+  /* [--sim-scale] [--current-rate Hz] [--current-mode mode]
+   * [--oversample n] [--decimate n]
+   * [--stop-after s] [--stop-bound-ms ms]
+   * [--fixed-dwell] [--max-dwell-ms ms] [--waveform type] [--amplitude %]
+   * [--cycles n] [--cycles-end n] [--levels n] [--table file]
+   * [--stream Hz] [--stream-seconds s] [--tx-policy policy]
+   * [--load-cell counts_per_gram] [--rpm-pulses n] [serial port]
+   *
+   * type is Ramp, Step, Staircase, Sine, Chirp or Table, the firmware runs
+   * it over the test's samples, --cycles and --cycles-end at most half of
+   * them. --table reads one percent value per entry, up to WAVE_TABLE_SIZE
+   * of them, and implies --waveform Table. --stream has this side generate
+   * the setpoints instead and stream them at `Hz`, a sine of --amplitude
+   * over --cycles periods. policy is what the firmware does with telemetry
+   * it has no room to send while this side falls behind: DropNewest,
+   * DropOldest or Block. Each current reading averages --oversample
+   * conversions in the ADC (1, 4, 8, 16 or 32) times --decimate in the
+   * firmware, 0 leaves the firmware's default. mode is Raw (every current
+   * reading), Summary (per step statistics of current, voltage and
+   * temperature, computed on the firmware) or Both. With --load-cell thrust
+   * comes from the firmware's HX711 instead of the USB scale, zeroed while
+   * the ESC arms. --rpm-pulses has the firmware report rotor speed with each
+   * step, off a tachometer giving n pulses a turn */
+  bool sim_scale = false;
+  unsigned long current_rate = 2000;
+  unsigned long oversample = 0;
+  unsigned long decimate = 0;
+  /* Empty for Both while steps settle on current, Summary otherwise */
+  string current_mode;
+  /* Send a Stop this far into the test, 0 to let it run out */
+  double stop_after = 0;
+  /* Fail the run if a stop, from serial or the e-stop pin, took longer */
+  double stop_bound_ms = 0;
+  /* Steps end once thrust and current settle, or after max_dwell_ms */
+  bool adaptive_dwell = true;
+  unsigned long max_dwell_ms = 3500;
+  /* Test profile, zero leaves the firmware's default */
+  string waveform = "Ramp";
+  unsigned long amplitude = 0;
+  unsigned long cycles = 0;
+  unsigned long cycles_end = 0;
+  unsigned long levels = 0;
+  string table_file;
+  /* Setpoints per second when streaming them, 0 to let the firmware run
+   * the waveform */
+  unsigned long stream_rate = 0;
+  double stream_seconds = 10;
+  /* Empty leaves the firmware's default, DropNewest */
+  string tx_policy;
+  /* 0 weighs thrust on the USB scale */
+  double load_cell_scale = 0;
+  /* 0 leaves the rpm column at zero */
+  unsigned long rpm_pulses = 0;
+  string port = "/dev/ttyACM0";
+  for (int i = 1; i < argc; i++) {
+    if (string(argv[i]) == "--sim-scale") {
+      sim_scale = true;
+    } else if (string(argv[i]) == "--current-rate" && i + 1 < argc) {
+      current_rate = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--current-mode" && i + 1 < argc) {
+      current_mode = argv[++i];
+    } else if (string(argv[i]) == "--oversample" && i + 1 < argc) {
+      oversample = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--decimate" && i + 1 < argc) {
+      decimate = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--stop-after" && i + 1 < argc) {
+      stop_after = strtod(argv[++i], NULL);
+    } else if (string(argv[i]) == "--stop-bound-ms" && i + 1 < argc) {
+      stop_bound_ms = strtod(argv[++i], NULL);
+    } else if (string(argv[i]) == "--fixed-dwell") {
+      adaptive_dwell = false;
+    } else if (string(argv[i]) == "--max-dwell-ms" && i + 1 < argc) {
+      max_dwell_ms = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--waveform" && i + 1 < argc) {
+      waveform = argv[++i];
+    } else if (string(argv[i]) == "--amplitude" && i + 1 < argc) {
+      amplitude = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--cycles" && i + 1 < argc) {
+      cycles = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--cycles-end" && i + 1 < argc) {
+      cycles_end = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--levels" && i + 1 < argc) {
+      levels = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--table" && i + 1 < argc) {
+      table_file = argv[++i];
+      waveform = "Table";
+    } else if (string(argv[i]) == "--stream" && i + 1 < argc) {
+      stream_rate = strtoul(argv[++i], NULL, 10);
+    } else if (string(argv[i]) == "--stream-seconds" && i + 1 < argc) {
+      stream_seconds = strtod(argv[++i], NULL);
+    } else if (string(argv[i]) == "--tx-policy" && i + 1 < argc) {
+      tx_policy = argv[++i];
+    } else if (string(argv[i]) == "--load-cell" && i + 1 < argc) {
+      load_cell_scale = strtod(argv[++i], NULL);
+    } else if (string(argv[i]) == "--rpm-pulses" && i + 1 < argc) {
+      rpm_pulses = min(255ul, strtoul(argv[++i], NULL, 10));
+    } else {
+      port = argv[i];
+    }
+  }
+  /* Streamed setpoints, reported at about STREAM_REPORT_HZ */
+  uint32_t stream_total = (uint32_t) (stream_rate * stream_seconds);
+  unsigned long report_every = max(1ul, stream_rate / STREAM_REPORT_HZ);
+  if (stream_rate > 0) {
+    waveform = "Stream";
+    /* No steps to settle */
+    adaptive_dwell = false;
+  }
+  if (current_mode.empty()) {
+    /* Settling needs the raw current, summaries only come at a step's end */
+    current_mode = adaptive_dwell ? "Both" : "Summary";
+  }
+  bool current_raw = current_rate > 0 && current_mode != "Summary";
+  bool current_summary = current_rate > 0 && current_mode != "Raw";
+  vector<int> table;
+  if (!table_file.empty()) {
+    ifstream table_in(table_file);
+    int percent;
+    while (table_in >> percent) {
+      table.push_back(percent);
+    }
+    if (table.empty() || table.size() > WAVE_TABLE_SIZE) {
+      cerr << "Need 1 to " << WAVE_TABLE_SIZE << " values in " << table_file << endl;
+      return -1;
+    }
+  }
+
   /*Get user inputs*/
   bool user_input_sucess = false;
   string sampleno_input = "";
@@ -31,65 +167,265 @@ int main()
   }
 
 
-  string out_file_name_ = "../data/test_output" + sampleno_input + ".txt";
-  ofstream out_file_(out_file_name_.c_str(), ofstream::out);
-  if (!out_file_.is_open()) {
-    cerr << "Cannot open input file: " << out_file_name_ << endl;
+  /* just a convenient serial interface, the port can be overridden, e.g.
+   * with the pty of arduino_thruster_load_test/sim's firmware_sim */
+  arduino_interface arduino(port);
+  /* Binary telemetry if the firmware speaks it, JSON otherwise. It answers
+   * as soon as it is up, an Uno style board takes a couple of seconds */
+  if(arduino.negotiate_framing(FRAMING_COBS, 3 * wait_a_sec) == FRAMING_COBS){
+    cout << "Using binary telemetry frames" << endl;
+  }
+  if (!tx_policy.empty()) {
+    json policyJson;
+    policyJson["Event"] = "TxPolicy";
+    policyJson["Policy"] = tx_policy;
+    std::string policy_out = policyJson.dump();
+    arduino.send_string(policy_out);
+  }
+  unsigned int number_of_samples = 180;
+  if (stream_rate > 0) {
+    number_of_samples = stream_total / report_every;
+  }
+
+  /* Columnar log, read back with tlog_dump */
+  column_log_info info;
+  memset(&info, 0, sizeof(info));
+  gethostname(info.rig, sizeof(info.rig) - 1);
+  strncpy(info.test_id, sampleno_input.c_str(), sizeof(info.test_id) - 1);
+  strncpy(info.test_type, waveform.c_str(), sizeof(info.test_type) - 1);
+  strncpy(info.serial_port, port.c_str(), sizeof(info.serial_port) - 1);
+  strncpy(info.scale, load_cell_scale != 0 ? "hx711" : (sim_scale ? "sim" : "usb"),
+          sizeof(info.scale) - 1);
+  info.planned_samples = number_of_samples;
+  info.framing = arduino.framing();
+  info.rpm_pulses = (uint8_t) rpm_pulses;
+  string out_file_name_ = "../data/test_output" + sampleno_input + ".tlog";
+  column_log_writer out_log_;
+  if (out_log_.open(out_file_name_, sample_log_columns(), info) != 0) {
+    cerr << "Cannot open output file: " << out_file_name_ << endl;
     return -1;
   }
+  /* Every sample of the current stream, at full rate */
+  column_log_writer current_log_;
+  if (current_raw) {
+    string current_file_name_ = "../data/test_output" + sampleno_input + "_current.tlog";
+    if (current_log_.open(current_file_name_, current_log_columns(), info) != 0) {
+      cerr << "Cannot open output file: " << current_file_name_ << endl;
+      return -1;
+    }
+  }
+  /* A row per channel per step, from the firmware's own statistics */
+  column_log_writer summary_log_;
+  if (current_summary) {
+    string summary_file_name_ = "../data/test_output" + sampleno_input + "_summary.tlog";
+    if (summary_log_.open(summary_file_name_, summary_log_columns(), info) != 0) {
+      cerr << "Cannot open output file: " << summary_file_name_ << endl;
+      return -1;
+    }
+  }
+
+  /* Every load cell reading, the thrust channel when there is one */
+  column_log_writer load_log_;
+  if (load_cell_scale != 0) {
+    string load_file_name_ = "../data/test_output" + sampleno_input + "_load.tlog";
+    if (load_log_.open(load_file_name_, load_log_columns(), info) != 0) {
+      cerr << "Cannot open output file: " << load_file_name_ << endl;
+      return -1;
+    }
+  }
+
+  /* The table goes ahead of the start command, a line's worth at a time */
+  for (size_t offset = 0; offset < table.size(); offset += WAVE_TABLE_CHUNK) {
+    size_t end = min(table.size(), offset + WAVE_TABLE_CHUNK);
+    json chunk;
+    chunk["Event"] = "Table";
+    chunk["Offset"] = offset;
+    chunk["Length"] = table.size();
+    chunk["V"] = vector<int>(table.begin() + offset, table.begin() + end);
+    std::string s_chunk = chunk.dump();
+    arduino.send_string(s_chunk);
+  }
 
-  /* just a convenient serial interface */
-  arduino_interface arduino;
-  usleep(2*wait_a_sec);
-  bool test_finished = false;
-  unsigned int number_of_samples = 180;
   json msgJson;
   msgJson["Event"] = "Command";
   msgJson["StartCommand"] = 'S';
   msgJson["SNo"] = number_of_samples;
-  msgJson["Type"] = "Ramp";
+  msgJson["Type"] = waveform;
+  if (amplitude > 0) msgJson["Amp"] = amplitude;
+  if (cycles > 0) msgJson["Cycles"] = cycles;
+  if (cycles_end > 0) msgJson["CyclesEnd"] = cycles_end;
+  if (levels > 0) msgJson["Levels"] = levels;
+  if (stream_rate > 0) {
+    msgJson["Rate"] = stream_rate;
+    msgJson["ReportEvery"] = report_every;
+  }
+  if (current_rate > 0) {
+    msgJson["CurrentRate"] = current_rate;
+    msgJson["CurrentMode"] = current_mode;
+    if (oversample > 0) msgJson["Oversample"] = oversample;
+    if (decimate > 0) msgJson["Decimate"] = decimate;
+    msgJson["CurrentBatch"] = CURRENT_BATCH_MAX;
+  }
+  if (load_cell_scale != 0) {
+    msgJson["LoadCell"] = 1;
+  }
+  if (rpm_pulses > 0) {
+    msgJson["RpmPulses"] = rpm_pulses;
+  }
+  settling_config settling;
+  msgJson["MaxDwell"] = max_dwell_ms;
+  if (adaptive_dwell) {
+    /* The firmware ignores an Advance earlier than this into the step */
+    msgJson["MinDwell"] = settling.min_dwell_us / 1000;
+  }
   std::string s_out = msgJson.dump();
   arduino.send_string(s_out);
   cout<<"outgoing: " << s_out <<endl;
 
 
-  /* Setup scale */
-  USBScale myscale;
+  /* Setup scale, or a simulated one reading a steady 500 g */
+  sim_scale_config sim_config;
+  sim_config.noise = 0.5;
+  sim_config.weight = [](int64_t) { return 500.0; };
+  if (load_cell_scale != 0 && !sim_scale) {
+    /* The stand needs no USB scale, an idle stand-in takes its place */
+    sim_scale = true;
+    sim_config.report_interval_us = 1000000;
+  }
+  USBScale myscale(sim_scale ? static_cast<scale_device*>(new sim_scale_device(sim_config))
+                             : new libusb_scale_device());
   if(myscale.open_scale_device() == -1){
     cerr << "Cannot Open Scale Device" << std::endl;
     return -1;
   }
-  while(!test_finished){
-
-    usleep(wait_a_sec);
-    string incomingString;
-    auto measurement = myscale.get_measurement();
-    if(arduino.receive_string(incomingString) && incomingString !="") {
-      cout<<"incoming: " << incomingString <<endl;
-      auto msgJsonIncoming = json::parse(incomingString);
-      /* Log Data */
-
 
-      out_file_ << msgJsonIncoming["SampleNo"] << "\t";
-      out_file_ << msgJsonIncoming["PWM"] << "\t";
-      out_file_ << msgJsonIncoming["Current"] << "\t";
-      out_file_ << measurement << "\n";
-      test_finished = msgJsonIncoming["TestFinished"];
+  /* Acquisition runs on its own threads, logging never holds it up */
+  acquisition_pipeline pipeline(arduino, myscale, out_log_, current_log_, summary_log_,
+                                load_log_);
+  if (load_cell_scale != 0) {
+    load_cell_config load_cell;
+    load_cell.counts_per_gram = load_cell_scale;
+    pipeline.use_load_cell(load_cell);
+  }
+  if (adaptive_dwell) {
+    pipeline.advance_when_settled(settling);
+  }
+  if (stream_rate > 0) {
+    /* Generated as it goes, any function of the index will do */
+    double stream_amplitude = (amplitude > 0 ? amplitude : 100) / 100.0;
+    double stream_cycles = cycles > 0 ? cycles : 1;
+    pipeline.stream_setpoints([=](uint32_t index, uint8_t &pwm) {
+      if (index >= stream_total) {
+        return false;
+      }
+      double level = stream_amplitude * sin(2 * M_PI * stream_cycles * index / stream_total);
+      pwm = (uint8_t) lround(255 / 2 + 127 * level);
+      return true;
+    });
+  }
+  if(pipeline.start() != 0){
+    cerr << "Cannot Start Acquisition" << std::endl;
+    return -1;
+  }
+  bool stop_sent = false;
+  if (stop_after > 0 && !pipeline.wait_for((int) (stop_after * 1000))) {
+    cout << "Stopping the test" << endl;
+    stop_sent = pipeline.request_stop() > 0;
+    /* The final report follows the ack, a silent firmware must not hang us */
+    if (!pipeline.wait_for(2000)) {
+      cerr << "No final report after Stop" << endl;
+      pipeline.stop();
+    }
+  }
+  /* A report comes at least every dwell, give a silent firmware a few */
+  bool finished = pipeline.wait(std::max<int>(PIPELINE_IDLE_TIMEOUT_MS, 3 * max_dwell_ms));
 
-      cout << msgJsonIncoming["SampleNo"] << "\t";
-      cout << msgJsonIncoming["PWM"] << "\t";
-      cout << msgJsonIncoming["Current"] << "\t";
-      cout << measurement << "\t";
-      cout << msgJsonIncoming["TestFinished"] << "\n";
+  pipeline_stats stats = pipeline.stats();
+  cout << "Lines received: " << stats.lines_received
+       << ", samples logged: " << stats.samples_logged
+       << ", parse errors: " << stats.parse_errors << endl;
+  cout << "Drops serial/scale/log: " << stats.serial_drops << "/"
+       << stats.scale_drops << "/" << stats.log_drops
+       << ", max depth serial/log: " << stats.serial_max_depth << "/"
+       << stats.log_max_depth << endl;
+  cout << "Mean step [ms]: " << stats.mean_step_us / 1000.0
+       << ", advances sent: " << stats.advances_sent << endl;
+  if (stream_rate > 0) {
+    cout << "Setpoints sent: " << stats.setpoints_sent << "/" << stream_total
+         << ", buffer reports: " << stats.buffer_reports
+         << ", min level: " << stats.setpoint_min_level
+         << ", underruns: " << stats.setpoint_underruns
+         << ", overflows: " << stats.setpoint_overflows << endl;
+  }
+  if (stats.tx_stats_reports > 0) {
+    cout << "Firmware tx dropped: " << stats.tx_dropped
+         << " (" << stats.tx_dropped_bytes << " bytes)"
+         << ", peak queued: " << stats.tx_peak
+         << ", blocked [us]: " << stats.tx_blocked_us << endl;
+  }
+  cout << "Thrust alignment error mean/max [us]: "
+       << stats.mean_alignment_error_us << "/"
+       << stats.max_alignment_error_us << endl;
+  if (current_raw) {
+    cout << "Current batches: " << stats.current_batches
+         << ", samples logged: " << stats.current_samples_logged
+         << ", lost: " << stats.current_batches_lost
+         << ", drops: " << stats.current_drops
+         << ", max depth: " << stats.current_max_depth << endl;
+    cout << "Analog reports: " << stats.analog_reports
+         << ", last voltage/temperature [counts]: " << stats.voltage_counts
+         << "/" << stats.temperature_counts << endl;
+  }
+  if (current_summary) {
+    cout << "Step summaries: " << stats.summaries
+         << ", drops: " << stats.summary_drops << endl;
+  }
+  if (load_cell_scale != 0) {
+    cout << "Load cell readings: " << stats.load_readings
+         << ", missed: " << stats.load_missed
+         << ", tare [counts]: " << stats.load_tare << endl;
+  }
 
+  int result = finished ? 0 : 1;
+  if (stats.stop_acks > 0 || stop_sent) {
+    /* Round trip when we sent the Stop, firmware side for the pin */
+    double worst_ms = max((double) stats.stop_round_trip_max_us,
+                          (double) stats.stop_firmware_max_us) / 1000.0;
+    cout << "Stop acks: " << stats.stop_acks << " (" << stats.stop_acks_pin << " from the pin)"
+         << ", round trip max [us]: " << stats.stop_round_trip_max_us
+         << ", firmware max [us]: " << stats.stop_firmware_max_us
+         << ", firmware loop max [us]: " << stats.firmware_loop_max_us << endl;
+    if (stop_bound_ms > 0 && (stats.stop_acks == 0 || worst_ms > stop_bound_ms)) {
+      cerr << "Stop latency " << (stats.stop_acks ? worst_ms : -1.0)
+           << " ms exceeds the bound of " << stop_bound_ms << " ms" << endl;
+      result = 2;
     }
-    /* Send a heartbeat */
   }
+
+  /* Straight from memory, the log file is not read back */
+  sample_store::cursor all_samples = pipeline.samples().all();
+  sample_record record;
+  double peak_thrust = 0;
+  while (all_samples.next(record)) {
+    peak_thrust = std::max(peak_thrust, record.thrust);
+  }
+  cout << "Sample store: " << pipeline.samples().size() << " samples in "
+       << stats.store_bytes << " bytes, peak thrust " << peak_thrust << endl;
+
   // close files
-  if (out_file_.is_open()) {
-    out_file_.close();
+  if (out_log_.is_open()) {
+    out_log_.close();
+  }
+  if (current_log_.is_open()) {
+    current_log_.close();
+  }
+  if (summary_log_.is_open()) {
+    summary_log_.close();
+  }
+  if (load_log_.is_open()) {
+    load_log_.close();
   }
 
-  return 0;
+  return result;
 
 }
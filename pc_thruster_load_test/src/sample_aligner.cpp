@@ -0,0 +1,146 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sample_aligner.cpp
+ * Streaming interpolation of scale readings onto telemetry timestamps, and
+ * the firmware's clock mapped onto ours.
+ *
+ * @author Ali AlSaibie
+ */
+#include "sample_aligner.h"
+#include <algorithm>
+
+sample_aligner::sample_aligner(int64_t max_wait_us): max_wait(max_wait_us) {
+
+}
+
+void sample_aligner::add_reading(int64_t timestamp_us, double value) {
+  point p = {timestamp_us, value};
+  readings.push_back(p);
+
+  /* Only the reading right before the oldest pending sample is still needed */
+  int64_t oldest = pending.empty() ? timestamp_us : pending.front();
+  while (readings.size() > 2 && readings[1].timestamp_us <= oldest) {
+    readings.pop_front();
+  }
+}
+
+void sample_aligner::add_sample(int64_t timestamp_us) {
+  pending.push_back(timestamp_us);
+}
+
+bool sample_aligner::pop_aligned(int64_t now_us, aligned &out) {
+  if (pending.empty()) {
+    return false;
+  }
+  int64_t t = pending.front();
+  bool bracketed = !readings.empty() && readings.back().timestamp_us >= t;
+  if (!bracketed && now_us - t < max_wait) {
+    return false;
+  }
+
+  interpolate(t, out);
+  pending.pop_front();
+
+  if (out.error_us >= 0) {
+    max_error = std::max(max_error, out.error_us);
+    error_sum += out.error_us;
+    aligned_count++;
+  }
+  return true;
+}
+
+int sample_aligner::next_deadline_ms(int64_t now_us) const {
+  if (pending.empty()) {
+    return -1;
+  }
+  int64_t remaining = pending.front() + max_wait - now_us;
+  return remaining <= 0 ? 0 : (int) ((remaining + 999) / 1000);
+}
+
+void sample_aligner::interpolate(int64_t t, aligned &out) {
+  out.timestamp_us = t;
+  if (readings.empty()) {
+    out.value = -1;
+    out.error_us = -1;
+    return;
+  }
+
+  /* First reading at or after t */
+  std::deque<point>::const_iterator after = readings.begin();
+  while (after != readings.end() && after->timestamp_us < t) {
+    ++after;
+  }
+
+  if (after == readings.end()) {
+    /* Timed out, hold the last reading */
+    out.value = readings.back().value;
+    out.error_us = t - readings.back().timestamp_us;
+  }
+  else if (after == readings.begin()) {
+    out.value = after->value;
+    out.error_us = after->timestamp_us - t;
+  }
+  else {
+    std::deque<point>::const_iterator before = after - 1;
+    int64_t span = after->timestamp_us - before->timestamp_us;
+    double w = span > 0 ? (double) (t - before->timestamp_us) / span : 0;
+    out.value = before->value + w * (after->value - before->value);
+    out.error_us = std::min(t - before->timestamp_us, after->timestamp_us - t);
+  }
+}
+
+int64_t device_clock::unwrap(uint32_t device_us) {
+  if (!started) {
+    unwrapped = device_us;
+    started = true;
+  } else {
+    /* Signed, a stream stamped further back may follow another */
+    unwrapped += (int32_t) (device_us - last_raw);
+  }
+  last_raw = device_us;
+  return unwrapped;
+}
+
+void device_clock::observe(int64_t device_us, int64_t arrival_us) {
+  int64_t difference = arrival_us - device_us;
+  if (!have_offset || difference < offset) {
+    offset = difference;
+    have_offset = true;
+  }
+  if (window_count == 0 || difference < window_min) {
+    window_min = difference;
+  }
+  if (++window_count == DEVICE_CLOCK_WINDOW) {
+    offset = window_min;
+    window_count = 0;
+  }
+}
@@ -0,0 +1,332 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file sample_store.cpp
+ * Compressed in-memory time series of logged samples.
+ *
+ * @author Ali AlSaibie
+ */
+#include "sample_store.h"
+#include <string.h>
+#include <math.h>
+
+static uint64_t low_bits(int n) {
+  return n >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+}
+
+static uint64_t double_bits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static double bits_double(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* Whole numbers that survive a round trip through int64_t, -0 does not */
+static bool is_whole(double value) {
+  return value >= -4.0e18 && value <= 4.0e18 && value == (double) (int64_t) value &&
+         !(value == 0 && signbit(value));
+}
+
+/* Prefix and width of each delta bucket, the last one is raw */
+static const int DELTA_WIDTHS[] = {7, 14, 22, 64};
+
+sample_store::sample_store() {
+  memset(&previous, 0, sizeof(previous));
+}
+
+void sample_store::write_bits(uint64_t value, int n) {
+  block &b = blocks.back();
+  while (n > 0) {
+    size_t word = b.bit_length / 64;
+    int space = 64 - (int) (b.bit_length % 64);
+    if (word == b.bits.size()) {
+      b.bits.push_back(0);
+    }
+    int take = n < space ? n : space;
+    uint64_t chunk = (value >> (n - take)) & low_bits(take);
+    b.bits[word] |= chunk << (space - take);
+    n -= take;
+    b.bit_length += take;
+  }
+}
+
+void sample_store::write_delta(int64_t value) {
+  if (value == 0) {
+    write_bits(0, 1);
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    int width = DELTA_WIDTHS[i];
+    int64_t limit = width >= 64 ? INT64_MAX : (int64_t) 1 << (width - 1);
+    if (width >= 64 || (value >= -limit && value < limit)) {
+      /* i+1 ones, then a zero unless this is the last bucket */
+      write_bits(i < 3 ? low_bits(i + 1) << 1 : low_bits(4), i < 3 ? i + 2 : 4);
+      write_bits((uint64_t) value & low_bits(width), width);
+      return;
+    }
+  }
+}
+
+void sample_store::write_xor(double value, xor_state &state) {
+  uint64_t bits = double_bits(value);
+  uint64_t x = bits ^ state.previous;
+  state.previous = bits;
+  if (x == 0) {
+    write_bits(0, 1);
+    return;
+  }
+  int leading = __builtin_clzll(x);
+  int trailing = __builtin_ctzll(x);
+  if (leading > 31) {
+    leading = 31;
+  }
+  if (state.leading >= 0 && leading >= state.leading && trailing >= state.trailing) {
+    /* Fits the previous window */
+    write_bits(2, 2);
+    write_bits(x >> state.trailing, 64 - state.leading - state.trailing);
+    return;
+  }
+  int meaningful = 64 - leading - trailing;
+  write_bits(3, 2);
+  write_bits(leading, 5);
+  write_bits(meaningful - 1, 6);
+  write_bits(x >> trailing, meaningful);
+  state.leading = leading;
+  state.trailing = trailing;
+}
+
+/* '0' and the delta while both are whole numbers, else '1' and the raw double */
+void sample_store::write_whole(double value, double previous) {
+  if (is_whole(value) && is_whole(previous)) {
+    write_bits(0, 1);
+    write_delta((int64_t) value - (int64_t) previous);
+  } else {
+    write_bits(1, 1);
+    write_bits(double_bits(value), 64);
+  }
+}
+
+void sample_store::append(const sample_record &record) {
+  if (blocks.empty() || blocks.back().count == SAMPLE_STORE_BLOCK) {
+    if (!blocks.empty()) {
+      blocks.back().bits.shrink_to_fit();
+    }
+    blocks.push_back(block());
+    block &b = blocks.back();
+    b.first_us = record.timestamp_us;
+    b.count = 0;
+    b.bit_length = 0;
+
+    /* Blocks start over with raw values so a query can begin at any of them */
+    write_bits((uint64_t) record.timestamp_us, 64);
+    write_bits(record.sample_no, 32);
+    write_bits(double_bits(record.pwm), 64);
+    write_bits(double_bits(record.current), 64);
+    write_bits(double_bits(record.rpm), 64);
+    write_bits(double_bits(record.thrust), 64);
+    write_bits((uint64_t) record.thrust_error_us, 64);
+    previous_delta = 0;
+    current_state = {double_bits(record.current), -1, 0};
+    thrust_state  = {double_bits(record.thrust), -1, 0};
+  }
+  else {
+    int64_t delta = record.timestamp_us - previous.timestamp_us;
+    write_delta(delta - previous_delta);
+    previous_delta = delta;
+
+    if (record.sample_no == previous.sample_no + 1) {
+      write_bits(0, 1);
+    } else {
+      write_bits(1, 1);
+      write_bits(record.sample_no, 32);
+    }
+
+    write_whole(record.pwm, previous.pwm);
+
+    write_xor(record.current, current_state);
+    write_whole(record.rpm, previous.rpm);
+    write_xor(record.thrust, thrust_state);
+    write_delta(record.thrust_error_us - previous.thrust_error_us);
+  }
+  write_bits(record.test_finished ? 1 : 0, 1);
+
+  block &b = blocks.back();
+  b.last_us = record.timestamp_us;
+  b.count++;
+  previous = record;
+  samples++;
+}
+
+sample_store::cursor sample_store::range(int64_t first_us, int64_t last_us) const {
+  return cursor(*this, first_us, last_us);
+}
+
+size_t sample_store::bytes() const {
+  size_t total = blocks.capacity() * sizeof(block);
+  for (size_t i = 0; i < blocks.size(); i++) {
+    total += blocks[i].bits.capacity() * sizeof(uint64_t);
+  }
+  return total;
+}
+
+//
+// Reading back
+// ------------
+//
+sample_store::cursor::cursor(const sample_store &store_, int64_t first_us_, int64_t last_us_):
+        bits(NULL),
+        store(store_),
+        first_us(first_us_),
+        last_us(last_us_),
+        block_index(0)
+{
+  memset(&previous, 0, sizeof(previous));
+  /* Skip whole blocks that end before the range */
+  size_t low = 0, high = store.blocks.size();
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (store.blocks[mid].last_us < first_us) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  block_index = low;
+}
+
+uint64_t sample_store::cursor::read_bits(int n) {
+  uint64_t value = 0;
+  while (n > 0) {
+    size_t word = bit_position / 64;
+    int space = 64 - (int) (bit_position % 64);
+    int take = n < space ? n : space;
+    uint64_t chunk = (bits[word] >> (space - take)) & low_bits(take);
+    value = take >= 64 ? chunk : (value << take) | chunk;
+    n -= take;
+    bit_position += take;
+  }
+  return value;
+}
+
+int64_t sample_store::cursor::read_delta() {
+  int bucket = 0;
+  while (bucket < 4 && read_bits(1) == 1) {
+    bucket++;
+  }
+  if (bucket == 0) {
+    return 0;
+  }
+  int width = DELTA_WIDTHS[bucket - 1];
+  uint64_t raw = read_bits(width);
+  if (width < 64 && (raw >> (width - 1)) & 1) {
+    raw |= ~low_bits(width);  // sign extend
+  }
+  return (int64_t) raw;
+}
+
+double sample_store::cursor::read_xor(xor_state &state) {
+  if (read_bits(1) == 0) {
+    return bits_double(state.previous);
+  }
+  if (read_bits(1) == 1) {
+    state.leading = (int) read_bits(5);
+    int meaningful = (int) read_bits(6) + 1;
+    state.trailing = 64 - state.leading - meaningful;
+  }
+  uint64_t x = read_bits(64 - state.leading - state.trailing) << state.trailing;
+  state.previous ^= x;
+  return bits_double(state.previous);
+}
+
+double sample_store::cursor::read_whole(double previous) {
+  if (read_bits(1) == 0) {
+    return (double) ((int64_t) previous + read_delta());
+  }
+  return bits_double(read_bits(64));
+}
+
+void sample_store::cursor::decode(sample_record &record) {
+  if (position == 0) {
+    record.timestamp_us    = (int64_t) read_bits(64);
+    record.sample_no       = (unsigned int) read_bits(32);
+    record.pwm             = bits_double(read_bits(64));
+    record.current         = bits_double(read_bits(64));
+    record.rpm             = bits_double(read_bits(64));
+    record.thrust          = bits_double(read_bits(64));
+    record.thrust_error_us = (int64_t) read_bits(64);
+    previous_delta = 0;
+    current_state = {double_bits(record.current), -1, 0};
+    thrust_state  = {double_bits(record.thrust), -1, 0};
+  }
+  else {
+    previous_delta += read_delta();
+    record.timestamp_us = previous.timestamp_us + previous_delta;
+    record.sample_no = read_bits(1) == 0 ? previous.sample_no + 1
+                                         : (unsigned int) read_bits(32);
+    record.pwm     = read_whole(previous.pwm);
+    record.current = read_xor(current_state);
+    record.rpm     = read_whole(previous.rpm);
+    record.thrust  = read_xor(thrust_state);
+    record.thrust_error_us = previous.thrust_error_us + read_delta();
+  }
+  record.test_finished = read_bits(1) == 1;
+  previous = record;
+}
+
+bool sample_store::cursor::next(sample_record &record) {
+  while (block_index < store.blocks.size()) {
+    const block &b = store.blocks[block_index];
+    if (b.first_us > last_us) {
+      return false;
+    }
+    if (position == b.count) {
+      block_index++;
+      position = 0;
+      bit_position = 0;
+      continue;
+    }
+    bits = b.bits.data();
+    decode(record);
+    position++;
+    if (record.timestamp_us > last_us) {
+      block_index = store.blocks.size();
+      return false;
+    }
+    if (record.timestamp_us >= first_us) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,157 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file serial_port.cpp
+ * Raw POSIX termios serial port with batched, non-blocking I/O.
+ *
+ * @author Ali AlSaibie
+ */
+#include "serial_port.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <iostream>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+serial_port::serial_port() {
+
+}
+
+serial_port::~serial_port() {
+  close();
+}
+
+bool serial_port::open(const std::string &path, speed_t baud, cc_t vmin, cc_t vtime) {
+  fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
+              << "Error: Could not open " << path << ": " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+
+  struct termios options;
+  if (tcgetattr(fd, &options) < 0) {
+    std::cerr << "Error: Could not read the port settings." << std::endl;
+    close();
+    return false;
+  }
+  saved_options = options;
+  restore_options = true;
+
+  // Raw mode: no echo, no line editing, no translation of \r or \n, 8 data
+  // bits, no parity.
+  cfmakeraw(&options);
+  // One stop bit, ignore modem control lines, enable the receiver.
+  options.c_cflag &= ~CSTOPB;
+  options.c_cflag |= CLOCAL | CREAD;
+  // Turn off hardware and software flow control.
+  options.c_cflag &= ~CRTSCTS;
+  options.c_iflag &= ~(IXON | IXOFF | IXANY);
+  options.c_cc[VMIN]  = vmin;
+  options.c_cc[VTIME] = vtime;
+
+  if (cfsetispeed(&options, baud) < 0 || cfsetospeed(&options, baud) < 0) {
+    std::cerr << "Error: Could not set the baud rate." << std::endl;
+    close();
+    return false;
+  }
+  if (tcsetattr(fd, TCSANOW, &options) < 0) {
+    std::cerr << "Error: Could not apply the port settings." << std::endl;
+    close();
+    return false;
+  }
+
+#ifdef __linux__
+  // Ask the driver to push received bytes up right away instead of batching
+  // them on a timer. Not every driver supports it, which is fine.
+  struct serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &serial);
+  }
+#endif
+
+  // Drop whatever was sitting in the buffers before we opened the port.
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+void serial_port::close() {
+  if (fd < 0) {
+    return;
+  }
+  if (restore_options) {
+    tcsetattr(fd, TCSANOW, &saved_options);
+    restore_options = false;
+  }
+  ::close(fd);
+  fd = -1;
+}
+
+ssize_t serial_port::read(char* data, size_t n) {
+  ssize_t r = ::read(fd, data, n);
+  if (r < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  return r;
+}
+
+ssize_t serial_port::write(const char* data, size_t n) {
+  size_t written = 0;
+  while (written < n) {
+    ssize_t r = ::write(fd, data + written, n - written);
+    if (r > 0) {
+      written += r;
+    }
+    else if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      poll(&pfd, 1, -1);
+    }
+    else if (r < 0 && errno != EINTR) {
+      return -1;
+    }
+  }
+  return (ssize_t) written;
+}
+
+int serial_port::available() const {
+  int n = 0;
+  if (ioctl(fd, FIONREAD, &n) < 0) {
+    return -1;
+  }
+  return n;
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file settling_detector.cpp
+ * Decides when a test step's thrust and current have stopped moving.
+ *
+ * @author Ali AlSaibie
+ */
+#include "settling_detector.h"
+#include <math.h>
+
+settling_detector::settling_detector(const settling_config &config_):
+        config(config_)
+{
+}
+
+void settling_detector::reset(int64_t now_us) {
+  step_start = now_us;
+  thrust.clear();
+  current.clear();
+}
+
+void settling_detector::add_thrust(int64_t timestamp_us, double grams) {
+  if (timestamp_us >= step_start) {
+    thrust.add(timestamp_us, grams);
+  }
+}
+
+void settling_detector::add_current(int64_t timestamp_us, double counts) {
+  if (timestamp_us >= step_start) {
+    current.add(timestamp_us, counts);
+  }
+}
+
+bool settling_detector::settled(int64_t now_us) {
+  if (now_us - step_start < config.min_dwell_us) {
+    return false;
+  }
+  thrust.evict(now_us - config.window_us);
+  current.evict(now_us - config.window_us);
+  if (thrust.times.size() < config.min_readings) {
+    return false;
+  }
+  if (thrust.stddev() > config.thrust_tolerance) {
+    return false;
+  }
+  return current.times.empty() || current.stddev() <= config.current_tolerance;
+}
+
+void settling_detector::window::add(int64_t t, double v) {
+  times.push_back(t);
+  values.push_back(v);
+  sum += v;
+  sum_sq += v * v;
+}
+
+void settling_detector::window::evict(int64_t before_us) {
+  while (!times.empty() && times.front() < before_us) {
+    double v = values.front();
+    sum -= v;
+    sum_sq -= v * v;
+    times.pop_front();
+    values.pop_front();
+  }
+  if (times.empty()) {
+    /* Let rounding errors go with the last value */
+    sum = sum_sq = 0;
+  }
+}
+
+void settling_detector::window::clear() {
+  times.clear();
+  values.clear();
+  sum = sum_sq = 0;
+}
+
+double settling_detector::window::stddev() const {
+  size_t n = times.size();
+  if (n < 2) {
+    return 0;
+  }
+  double mean = sum / n;
+  double var = sum_sq / n - mean * mean;
+  return var > 0 ? sqrt(var) : 0;
+}
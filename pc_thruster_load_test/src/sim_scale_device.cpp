@@ -0,0 +1,200 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file sim_scale_device.cpp
+ * Simulated HID POS scale, so USBScale runs without a scale plugged in.
+ *
+ * @author Ali AlSaibie
+ */
+#include "sim_scale_device.h"
+#include "monotonic_clock.h"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+
+/* Return codes a libusb scale would give, without pulling in libusb */
+#define SIM_ERROR_IO      -1
+#define SIM_ERROR_TIMEOUT -7
+
+static void sleep_until_us(int64_t deadline_us) {
+  struct timespec ts;
+  ts.tv_sec = deadline_us / 1000000;
+  ts.tv_nsec = (deadline_us % 1000000) * 1000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+sim_scale_device::sim_scale_device(const sim_scale_config &config_): config(config_),
+                                                                     rng(std::random_device()())
+{
+  if (config.status_sequence.empty()) {
+    config.status_sequence.push_back(0x04);
+  }
+}
+
+sim_scale_device::~sim_scale_device() {
+  stop_reports();
+}
+
+int sim_scale_device::open() {
+  opened = true;
+  next_report_us = monotonic_us();
+  return 0;
+}
+
+void sim_scale_device::make_report(unsigned char* report, int64_t now_us) {
+  double weight = config.weight ? config.weight(now_us - config.latency_us) : 0.0;
+  if (config.noise > 0) {
+    weight += config.noise * gaussian(rng);
+  }
+  uint8_t status = config.status_sequence[status_index];
+  status_index = (status_index + 1) % config.status_sequence.size();
+
+  // the scale's integer count, weight = raw * 10^exponent
+  double raw = round(weight / pow(10, config.exponent));
+  if (raw < 0) {
+    raw = 0;
+    status = 0x05;
+  }
+  else if (raw > 0xFFFF) {
+    raw = 0xFFFF;
+    status = 0x06;
+  }
+  uint16_t count = (uint16_t) raw;
+
+  report[0] = config.report_id;
+  report[1] = status;
+  report[2] = config.unit;
+  report[3] = (unsigned char) config.exponent;
+  report[4] = count & 0xFF;
+  report[5] = count >> 8;
+  reports++;
+}
+
+//
+// Blocking reads follow the report schedule, a read that comes in late gets
+// its report right away, like one the scale had already queued.
+//
+int sim_scale_device::read_report(unsigned char* report, int length, int* transferred,
+                                  unsigned int timeout_ms) {
+  if (!opened || length < WEIGH_REPORT_SIZE) {
+    return SIM_ERROR_IO;
+  }
+  int64_t now = monotonic_us();
+  int64_t due = next_report_us > now ? next_report_us : now;
+  if (timeout_ms > 0 && due - now > (int64_t) timeout_ms * 1000) {
+    sleep_until_us(now + (int64_t) timeout_ms * 1000);
+    *transferred = 0;
+    return SIM_ERROR_TIMEOUT;
+  }
+  sleep_until_us(due);
+  make_report(report, monotonic_us());
+  next_report_us = due + config.report_interval_us;
+  *transferred = WEIGH_REPORT_SIZE;
+  return 0;
+}
+
+int sim_scale_device::attach(event_loop &event_loop_) {
+  loop = &event_loop_;
+  return 0;
+}
+
+void sim_scale_device::emit() {
+  unsigned char report[WEIGH_REPORT_SIZE];
+  int64_t now = monotonic_us();
+  make_report(report, now);
+  on_report(report, WEIGH_REPORT_SIZE, now);
+}
+
+int sim_scale_device::start_reports(report_callback callback, int n_transfers) {
+  (void) n_transfers;
+  if (!opened) {
+    return SIM_ERROR_IO;
+  }
+  on_report = callback;
+  capturing = true;
+
+  if (loop == NULL) {
+    generator = std::thread(&sim_scale_device::run_generator, this);
+    return 0;
+  }
+
+  //
+  // On a loop every timer expiration is a report, expirations that piled up
+  // while the loop was busy are delivered back to back.
+  //
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd < 0) {
+    std::cerr << "Could not create scale timer: " << strerror(errno) << std::endl;
+    capturing = false;
+    return SIM_ERROR_IO;
+  }
+  int64_t interval_us = config.report_interval_us > 0 ? config.report_interval_us : 1;
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = interval_us / 1000000;
+  spec.it_interval.tv_nsec = (interval_us % 1000000) * 1000;
+  spec.it_value = spec.it_interval;
+  timerfd_settime(timer_fd, 0, &spec, NULL);
+  return loop->add_fd(timer_fd, EPOLLIN, [this](uint32_t) {
+    uint64_t expirations = 0;
+    if (::read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+      return;
+    }
+    for (uint64_t i = 0; i < expirations && capturing; i++) {
+      emit();
+    }
+  });
+}
+
+void sim_scale_device::run_generator() {
+  int64_t next_us = monotonic_us();
+  while (capturing) {
+    if (config.report_interval_us > 0) {
+      sleep_until_us(next_us);
+      next_us += config.report_interval_us;
+    }
+    emit();
+  }
+}
+
+void sim_scale_device::stop_reports() {
+  capturing = false;
+  if (generator.joinable()) {
+    generator.join();
+  }
+  if (timer_fd >= 0) {
+    loop->remove_fd(timer_fd);
+    close(timer_fd);
+    timer_fd = -1;
+  }
+}
@@ -0,0 +1,423 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file telemetry_parser.cpp
+ * Decoder for the arduino's fixed telemetry line.
+ *
+ * @author Ali AlSaibie
+ */
+#include "telemetry_parser.h"
+#include "json.hpp"
+#include <limits.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+using json = nlohmann::json;
+
+namespace {
+
+struct cursor{
+  const char* p;
+  const char* end;
+};
+
+inline void skip_space(cursor &c) {
+  while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r' || *c.p == '\n')) {
+    c.p++;
+  }
+}
+
+inline bool expect(cursor &c, char ch) {
+  skip_space(c);
+  if (c.p < c.end && *c.p == ch) {
+    c.p++;
+    return true;
+  }
+  return false;
+}
+
+const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+/* JSON number grammar, accumulated in an integer and scaled once. Plenty for
+ * ADC counts and PWM values, gives up on anything needing more than 18
+ * significant digits */
+bool parse_number(cursor &c, double &value) {
+  skip_space(c);
+  bool negative = false;
+  if (c.p < c.end && *c.p == '-') {
+    negative = true;
+    c.p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int scale = 0;
+  const char* start = c.p;
+  while (c.p < c.end && *c.p >= '0' && *c.p <= '9') {
+    mantissa = mantissa * 10 + (*c.p++ - '0');
+    digits++;
+  }
+  if (c.p == start) {
+    return false;
+  }
+  if (c.p < c.end && *c.p == '.') {
+    c.p++;
+    const char* fraction = c.p;
+    while (c.p < c.end && *c.p >= '0' && *c.p <= '9') {
+      mantissa = mantissa * 10 + (*c.p++ - '0');
+      digits++;
+      scale--;
+    }
+    if (c.p == fraction) {
+      return false;
+    }
+  }
+  if (c.p < c.end && (*c.p == 'e' || *c.p == 'E')) {
+    c.p++;
+    bool negative_exponent = false;
+    if (c.p < c.end && (*c.p == '+' || *c.p == '-')) {
+      negative_exponent = *c.p++ == '-';
+    }
+    int exponent = 0;
+    const char* exp_start = c.p;
+    while (c.p < c.end && *c.p >= '0' && *c.p <= '9' && exponent < 1000) {
+      exponent = exponent * 10 + (*c.p++ - '0');
+    }
+    if (c.p == exp_start) {
+      return false;
+    }
+    scale += negative_exponent ? -exponent : exponent;
+  }
+  if (digits > 18 || scale < -18 || scale > 18) {
+    return false;
+  }
+  value = (double) mantissa;
+  value = scale < 0 ? value / POW10[-scale] : value * POW10[scale];
+  if (negative) {
+    value = -value;
+  }
+  return true;
+}
+
+bool parse_bool(cursor &c, bool &value) {
+  skip_space(c);
+  size_t left = c.end - c.p;
+  if (left >= 4 && memcmp(c.p, "true", 4) == 0) {
+    c.p += 4;
+    value = true;
+    return true;
+  }
+  if (left >= 5 && memcmp(c.p, "false", 5) == 0) {
+    c.p += 5;
+    value = false;
+    return true;
+  }
+  return false;
+}
+
+/* Keys are plain ASCII, an escape means it is not one of ours */
+bool parse_key(cursor &c, const char* &key, size_t &length) {
+  if (!expect(c, '"')) {
+    return false;
+  }
+  key = c.p;
+  while (c.p < c.end && *c.p != '"') {
+    if (*c.p == '\\') {
+      return false;
+    }
+    c.p++;
+  }
+  if (c.p == c.end) {
+    return false;
+  }
+  length = c.p - key;
+  c.p++;
+  return true;
+}
+
+/* Only the plain ASCII values the firmware prints */
+bool parse_string(cursor &c, const char* &value, size_t &length) {
+  return parse_key(c, value, length);
+}
+
+inline bool key_is(const char* key, size_t length, const char* name, size_t name_length) {
+  return length == name_length && memcmp(key, name, length) == 0;
+}
+
+}
+
+bool parse_telemetry_fast(const char* data, size_t length, telemetry_sample &sample) {
+  cursor c = {data, data + length};
+  sample.fields = 0;
+
+  if (!expect(c, '{')) {
+    return false;
+  }
+  if (expect(c, '}')) {
+    return false;
+  }
+  do {
+    const char* key;
+    size_t key_length;
+    if (!parse_key(c, key, key_length) || !expect(c, ':')) {
+      return false;
+    }
+    double number;
+    if (key_is(key, key_length, "SampleNo", 8)) {
+      if (!parse_number(c, number) || number < 0 || number > UINT_MAX) return false;
+      sample.sample_no = (unsigned int) number;
+      sample.fields |= TELEMETRY_SAMPLE_NO;
+    }
+    else if (key_is(key, key_length, "PWM", 3)) {
+      if (!parse_number(c, sample.pwm)) return false;
+      sample.fields |= TELEMETRY_PWM;
+    }
+    else if (key_is(key, key_length, "RPM", 3)) {
+      if (!parse_number(c, sample.rpm)) return false;
+      sample.fields |= TELEMETRY_RPM;
+    }
+    else if (key_is(key, key_length, "Current", 7)) {
+      if (!parse_number(c, sample.current)) return false;
+      sample.fields |= TELEMETRY_CURRENT;
+    }
+    else if (key_is(key, key_length, "TestFinished", 12)) {
+      if (!parse_bool(c, sample.test_finished)) return false;
+      sample.fields |= TELEMETRY_TEST_FINISHED;
+    }
+    else {
+      return false;
+    }
+  } while (expect(c, ','));
+
+  if (!expect(c, '}')) {
+    return false;
+  }
+  skip_space(c);
+  return c.p == c.end && (sample.fields & TELEMETRY_REQUIRED) == TELEMETRY_REQUIRED;
+}
+
+/* nlohmann converts a float to an integer unchecked, out of range is
+ * undefined, so it is checked here and thrown like a missing key */
+static unsigned int json_sample_no(const json &j) {
+  double number = j.at("SampleNo").get<double>();
+  if (!(number >= 0 && number <= UINT_MAX)) {
+    throw std::out_of_range("SampleNo");
+  }
+  return (unsigned int) number;
+}
+
+bool parse_telemetry(const char* data, size_t length, telemetry_sample &sample) {
+  if (parse_telemetry_fast(data, length, sample)) {
+    return true;
+  }
+
+  try {
+    auto msgJsonIncoming = json::parse(std::string(data, length));
+    sample.sample_no     = json_sample_no(msgJsonIncoming);
+    sample.pwm           = msgJsonIncoming.at("PWM");
+    sample.current       = msgJsonIncoming.at("Current");
+    sample.test_finished = msgJsonIncoming.at("TestFinished");
+    sample.fields        = TELEMETRY_REQUIRED;
+    if (msgJsonIncoming.count("RPM")) {
+      sample.rpm     = msgJsonIncoming.at("RPM");
+      sample.fields |= TELEMETRY_RPM;
+    }
+  }
+  catch (std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+bool parse_current_batch_fast(const char* data, size_t length, current_batch &batch) {
+  cursor c = {data, data + length};
+  bool is_current = false;
+  uint32_t fields = 0;
+
+  if (!expect(c, '{')) {
+    return false;
+  }
+  do {
+    const char* key;
+    size_t key_length;
+    if (!parse_key(c, key, key_length) || !expect(c, ':')) {
+      return false;
+    }
+    double number;
+    if (key_is(key, key_length, "Event", 5)) {
+      const char* value;
+      size_t value_length;
+      if (!parse_string(c, value, value_length)) return false;
+      is_current = key_is(value, value_length, "Current", 7);
+    }
+    else if (key_is(key, key_length, "T0", 2)) {
+      if (!parse_number(c, number) || number < 0 || number > 4294967295.0) return false;
+      batch.start_us = (uint32_t) number;
+      fields |= 1;
+    }
+    else if (key_is(key, key_length, "Dt", 2)) {
+      if (!parse_number(c, number) || number < 0 || number > 65535) return false;
+      batch.interval_us = (uint16_t) number;
+      fields |= 2;
+    }
+    else if (key_is(key, key_length, "Seq", 3)) {
+      if (!parse_number(c, number) || number < 0 || number > 65535) return false;
+      batch.seq = (uint16_t) number;
+      fields |= 4;
+    }
+    else if (key_is(key, key_length, "Lost", 4)) {
+      if (!parse_number(c, number) || number < 0 || number > 255) return false;
+      batch.lost = (uint8_t) number;
+    }
+    else if (key_is(key, key_length, "Current", 7)) {
+      if (!expect(c, '[')) return false;
+      batch.count = 0;
+      if (!expect(c, ']')) {
+        do {
+          if (batch.count == CURRENT_BATCH_MAX || !parse_number(c, number) ||
+              number < 0 || number > 65535) {
+            return false;
+          }
+          batch.samples[batch.count++] = (uint16_t) number;
+        } while (expect(c, ','));
+        if (!expect(c, ']')) return false;
+      }
+      fields |= 8;
+    }
+    else {
+      return false;
+    }
+  } while (expect(c, ','));
+
+  if (!expect(c, '}')) {
+    return false;
+  }
+  skip_space(c);
+  return c.p == c.end && is_current && fields == 15;
+}
+
+TELEMETRY_KIND parse_telemetry_line(const char* data, size_t length, telemetry_message &message) {
+  message.kind = TELEMETRY_INVALID;
+  if (parse_telemetry_fast(data, length, message.sample)) {
+    return message.kind = TELEMETRY_STEP;
+  }
+  if (parse_current_batch_fast(data, length, message.batch)) {
+    return message.kind = TELEMETRY_CURRENT_BATCH;
+  }
+
+  try {
+    auto msgJsonIncoming = json::parse(std::string(data, length));
+    std::string event = msgJsonIncoming.value("Event", "");
+    if (event == "Current") {
+      current_batch &batch = message.batch;
+      auto &samples     = msgJsonIncoming.at("Current");
+      batch.start_us    = msgJsonIncoming.at("T0");
+      batch.interval_us = msgJsonIncoming.at("Dt");
+      batch.seq         = msgJsonIncoming.at("Seq");
+      batch.lost        = msgJsonIncoming.value("Lost", 0);
+      if (samples.size() > CURRENT_BATCH_MAX) {
+        return TELEMETRY_INVALID;
+      }
+      batch.count = (uint8_t) samples.size();
+      for (size_t i = 0; i < samples.size(); i++) {
+        batch.samples[i] = samples[i];
+      }
+      return message.kind = TELEMETRY_CURRENT_BATCH;
+    }
+    if (event == "StopAck") {
+      message.ack.id          = msgJsonIncoming.at("Id");
+      message.ack.source      = msgJsonIncoming.value("Source", "Serial") == "Pin" ? STOP_PIN : STOP_SERIAL;
+      message.ack.latency_us  = msgJsonIncoming.value("LatencyUs", 0u);
+      message.ack.loop_max_us = msgJsonIncoming.value("LoopMaxUs", 0u);
+      return message.kind = TELEMETRY_STOP_ACK;
+    }
+    if (event == "Buffer") {
+      message.buffer.consumed  = msgJsonIncoming.at("Consumed");
+      message.buffer.level     = msgJsonIncoming.at("Level");
+      message.buffer.size      = msgJsonIncoming.at("Size");
+      message.buffer.underruns = msgJsonIncoming.value("Underruns", 0);
+      message.buffer.overflows = msgJsonIncoming.value("Overflows", 0);
+      return message.kind = TELEMETRY_BUFFER_STATUS;
+    }
+    if (event == "TxStats") {
+      message.tx.dropped       = msgJsonIncoming.at("Dropped");
+      message.tx.dropped_bytes = msgJsonIncoming.value("DroppedBytes", 0u);
+      message.tx.peak          = msgJsonIncoming.value("Peak", 0);
+      message.tx.blocked_us    = msgJsonIncoming.value("BlockedUs", 0u);
+      return message.kind = TELEMETRY_TX_STATS;
+    }
+    if (event == "Analog") {
+      message.analog.start_us    = msgJsonIncoming.at("T0");
+      message.analog.count       = msgJsonIncoming.value("N", 0);
+      message.analog.voltage     = msgJsonIncoming.at("Voltage");
+      message.analog.temperature = msgJsonIncoming.at("Temp");
+      return message.kind = TELEMETRY_ANALOG;
+    }
+    if (event == "Load") {
+      message.load.ready_us = msgJsonIncoming.at("T");
+      message.load.counts   = msgJsonIncoming.at("Counts");
+      return message.kind = TELEMETRY_LOAD;
+    }
+    if (event == "Summary") {
+      const std::string channel = msgJsonIncoming.at("Ch");
+      channel_summary &summary = message.summary;
+      summary.sample_no = json_sample_no(msgJsonIncoming);
+      summary.channel   = channel == "Current" ? SUMMARY_CURRENT
+                          : channel == "Voltage" ? SUMMARY_VOLTAGE
+                          : channel == "Temp" ? SUMMARY_TEMPERATURE : SUMMARY_CHANNELS;
+      summary.count     = msgJsonIncoming.at("N");
+      summary.min       = msgJsonIncoming.at("Min");
+      summary.max       = msgJsonIncoming.at("Max");
+      summary.mean      = msgJsonIncoming.at("Mean");
+      summary.variance  = msgJsonIncoming.at("Var");
+      summary.rms       = msgJsonIncoming.at("Rms");
+      if (summary.channel == SUMMARY_CHANNELS) {
+        return TELEMETRY_INVALID;
+      }
+      return message.kind = TELEMETRY_SUMMARY;
+    }
+    telemetry_sample &sample = message.sample;
+    sample.sample_no     = json_sample_no(msgJsonIncoming);
+    sample.pwm           = msgJsonIncoming.at("PWM");
+    sample.current       = msgJsonIncoming.at("Current");
+    sample.test_finished = msgJsonIncoming.at("TestFinished");
+    sample.fields        = TELEMETRY_REQUIRED;
+    if (msgJsonIncoming.count("RPM")) {
+      sample.rpm     = msgJsonIncoming.at("RPM");
+      sample.fields |= TELEMETRY_RPM;
+    }
+  }
+  catch (std::exception &) {
+    return TELEMETRY_INVALID;
+  }
+  return message.kind = TELEMETRY_STEP;
+}
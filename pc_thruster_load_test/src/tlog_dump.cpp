@@ -0,0 +1,125 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+/**
+ * @file tlog_dump.cpp
+ * Prints a column log as tab separated text, e.g. for plotting tools.
+ *
+ * usage: tlog_dump file.tlog [column ...]
+ *
+ * @author Ali AlSaibie
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include "column_log.h"
+
+static void print_value(const column_log_reader &log, size_t chunk, int column, uint32_t row) {
+  switch (log.info().columns[column].type) {
+    case COLUMN_U8:
+      printf("%u", (unsigned) log.column<uint8_t>(chunk, column)[row]);
+      break;
+    case COLUMN_U32:
+      printf("%" PRIu32, log.column<uint32_t>(chunk, column)[row]);
+      break;
+    case COLUMN_I64:
+      printf("%" PRId64, log.column<int64_t>(chunk, column)[row]);
+      break;
+    case COLUMN_F64:
+      printf("%.15g", log.column<double>(chunk, column)[row]);
+      break;
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s file.tlog [column ...]\n", argv[0]);
+    return 1;
+  }
+  column_log_reader log;
+  if (log.open(argv[1]) != 0) {
+    return 1;
+  }
+
+  const column_log_header &header = log.info();
+  std::vector<int> columns;
+  for (int i = 2; i < argc; i++) {
+    int column = log.find_column(argv[i]);
+    if (column < 0) {
+      fprintf(stderr, "No column %s in %s\n", argv[i], argv[1]);
+      return 1;
+    }
+    columns.push_back(column);
+  }
+  if (columns.empty()) {
+    for (uint32_t i = 0; i < header.n_columns; i++) {
+      columns.push_back((int) i);
+    }
+  }
+
+  printf("# rig: %s\n", header.info.rig);
+  printf("# test: %s (%s, %u samples)\n", header.info.test_id, header.info.test_type,
+         header.info.planned_samples);
+  printf("# serial: %s (%s), scale: %s\n", header.info.serial_port,
+         header.info.framing ? "cobs" : "json", header.info.scale);
+  if (header.info.rpm_pulses) {
+    printf("# rpm pulses per turn: %u\n", header.info.rpm_pulses);
+  }
+  printf("# created_unix_us: %" PRId64 ", created_monotonic_us: %" PRId64 "\n",
+         header.created_unix_us, header.created_monotonic_us);
+  for (size_t i = 0; i < columns.size(); i++) {
+    printf("%s%s", i ? "\t" : "", header.columns[columns[i]].name);
+  }
+  printf("\n");
+
+  int bad_chunks = 0;
+  for (size_t chunk = 0; chunk < log.chunks(); chunk++) {
+    bool ok = true;
+    for (size_t i = 0; i < columns.size(); i++) {
+      ok = ok && log.verify(chunk, columns[i]);
+    }
+    if (!ok) {
+      fprintf(stderr, "Skipping chunk %zu, checksum mismatch\n", chunk);
+      bad_chunks++;
+      continue;
+    }
+    uint32_t rows = log.chunk_rows(chunk);
+    for (uint32_t row = 0; row < rows; row++) {
+      for (size_t i = 0; i < columns.size(); i++) {
+        if (i) {
+          printf("\t");
+        }
+        print_value(log, chunk, columns[i], row);
+      }
+      printf("\n");
+    }
+  }
+  return bad_chunks ? 2 : 0;
+}
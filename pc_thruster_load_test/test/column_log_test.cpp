@@ -0,0 +1,190 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file column_log_test.cpp
+ * Round trip of the column log, its short chunks, CRCs and torn tails.
+ *
+ * @author Ali AlSaibie
+ */
+#include "test_check.h"
+#include "column_log.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#define TEST_CHUNK_ROWS 100
+
+static const std::vector<column_spec> test_columns = {
+    {"sample", COLUMN_U32},
+    {"t_us", COLUMN_I64},
+    {"thrust", COLUMN_F64},
+    {"status", COLUMN_U8},
+};
+
+/* Row i's values, a mix of edges and ordinary numbers */
+static uint32_t sample_of(uint64_t i) { return (uint32_t) (i * 2654435761u); }
+static int64_t t_of(uint64_t i) { return (int64_t) i * 1000 - 500000; }
+static double thrust_of(uint64_t i) {
+  return i == 7 ? -0.0 : i == 11 ? 1e300 : sin((double) i) * 123.456;
+}
+static uint8_t status_of(uint64_t i) { return (uint8_t) (i % 7); }
+
+static column_log_info test_info() {
+  column_log_info info;
+  memset(&info, 0, sizeof(info));
+  strcpy(info.rig, "bench rig");
+  strcpy(info.test_id, "T-42");
+  strcpy(info.test_type, "ramp");
+  info.planned_samples = 350;
+  info.framing = 1;
+  info.rpm_pulses = 2;
+  return info;
+}
+
+/* 3 full chunks, a flushed short one, then a short one left to close */
+static bool write_log(const std::string &path) {
+  column_log_writer writer;
+  if (writer.open(path, test_columns, test_info(), TEST_CHUNK_ROWS) != 0) {
+    return false;
+  }
+  for (uint64_t i = 0; i < 350; i++) {
+    writer.set<uint32_t>(0, sample_of(i));
+    writer.set<int64_t>(1, t_of(i));
+    writer.set<double>(2, thrust_of(i));
+    writer.set<uint8_t>(3, status_of(i));
+    CHECK(writer.end_row() == 0);
+    if (i == 329) {
+      CHECK(writer.flush() == 0);
+    }
+  }
+  CHECK(writer.rows_written() == 350);
+  return writer.close() == 0;
+}
+
+static void test_crc32() {
+  CHECK(crc32("123456789", 9) == 0xCBF43926);
+  CHECK(crc32("", 0) == 0);
+}
+
+static void test_round_trip(const std::string &path) {
+  column_log_reader reader;
+  CHECK(reader.open(path) == 0);
+  CHECK(reader.chunks() == 5);
+  CHECK(reader.rows() == 350);
+  CHECK(reader.chunk_rows(0) == TEST_CHUNK_ROWS);
+  CHECK(reader.chunk_rows(3) == 30);
+  CHECK(reader.chunk_rows(4) == 20);
+
+  const column_log_header &header = reader.info();
+  CHECK(header.n_columns == test_columns.size());
+  CHECK(strcmp(header.info.rig, "bench rig") == 0);
+  CHECK(strcmp(header.info.test_id, "T-42") == 0);
+  CHECK(header.info.planned_samples == 350);
+  CHECK(header.info.rpm_pulses == 2);
+  CHECK(reader.find_column("thrust") == 2);
+  CHECK(reader.find_column("nothing") == -1);
+
+  uint64_t i = 0;
+  bool equal = true;
+  for (size_t k = 0; k < reader.chunks(); k++) {
+    CHECK(reader.verify(k));
+    const uint32_t* sample = reader.column<uint32_t>(k, 0);
+    const int64_t* t = reader.column<int64_t>(k, 1);
+    const double* thrust = reader.column<double>(k, 2);
+    const uint8_t* status = reader.column<uint8_t>(k, 3);
+    for (uint32_t r = 0; r < reader.chunk_rows(k); r++, i++) {
+      double expected = thrust_of(i);
+      equal = equal && sample[r] == sample_of(i) && t[r] == t_of(i) &&
+              memcmp(&thrust[r], &expected, sizeof(double)) == 0 &&
+              status[r] == status_of(i);
+    }
+  }
+  CHECK(i == 350);
+  CHECK(equal);
+}
+
+static void test_corruption(const std::string &path) {
+  size_t chunk_size, thrust_offset;
+  {
+    column_log_reader reader;
+    CHECK(reader.open(path) == 0);
+    chunk_size = reader.info().chunk_size;
+    thrust_offset = reader.info().columns[2].offset;
+  }
+
+  // flip one thrust value in chunk 1, only that column should fail
+  int fd = open(path.c_str(), O_RDWR);
+  CHECK(fd >= 0);
+  off_t at = COLUMN_LOG_HEADER_SIZE + chunk_size + thrust_offset + 5 * sizeof(double);
+  unsigned char byte = 0;
+  CHECK(pread(fd, &byte, 1, at) == 1);
+  byte ^= 0x10;
+  CHECK(pwrite(fd, &byte, 1, at) == 1);
+  {
+    column_log_reader reader;
+    CHECK(reader.open(path) == 0);
+    CHECK(reader.verify(0));
+    CHECK(!reader.verify(1));
+    CHECK(!reader.verify(1, 2));
+    CHECK(reader.verify(1, 0));
+    CHECK(reader.verify(1, 3));
+  }
+
+  // a torn last chunk is left out
+  struct stat st;
+  CHECK(fstat(fd, &st) == 0);
+  CHECK(ftruncate(fd, st.st_size - chunk_size / 2) == 0);
+  {
+    column_log_reader reader;
+    CHECK(reader.open(path) == 0);
+    CHECK(reader.chunks() == 4);
+    CHECK(reader.rows() == 330);
+  }
+
+  // a damaged header is refused
+  byte = 'X';
+  CHECK(pwrite(fd, &byte, 1, offsetof(column_log_header, info)) == 1);
+  close(fd);
+  column_log_reader reader;
+  CHECK(reader.open(path) != 0);
+}
+
+int main() {
+  std::string path = "/tmp/column_log_test_" + std::to_string(getpid()) + ".tlog";
+  test_crc32();
+  CHECK(write_log(path));
+  test_round_trip(path);
+  test_corruption(path);
+  unlink(path.c_str());
+  return check_result("column_log_test");
+}
@@ -0,0 +1,182 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sample_store_test.cpp
+ * The Gorilla store reads back every sample bit for bit, and its ranges.
+ *
+ * @author Ali AlSaibie
+ */
+#include "test_check.h"
+#include "sample_store.h"
+#include <string.h>
+#include <math.h>
+#include <limits>
+#include <random>
+
+static bool same_bits(double a, double b) {
+  return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+static bool same_record(const sample_record &a, const sample_record &b) {
+  return a.timestamp_us == b.timestamp_us && a.sample_no == b.sample_no &&
+         same_bits(a.pwm, b.pwm) && same_bits(a.current, b.current) &&
+         same_bits(a.rpm, b.rpm) && same_bits(a.thrust, b.thrust) &&
+         a.thrust_error_us == b.thrust_error_us && a.test_finished == b.test_finished;
+}
+
+/*
+ * A steady ramp, then everything the encoders have a special case for:
+ * odd rates and sample numbers, half steps of pwm, NaN, infinities, -0,
+ * denormals and deltas too wide for any bucket.
+ */
+static std::vector<sample_record> make_samples(size_t n) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int64_t> jitter(-3000, 3000);
+  const double specials[] = {std::numeric_limits<double>::quiet_NaN(),
+                             std::numeric_limits<double>::infinity(),
+                             -std::numeric_limits<double>::infinity(),
+                             -0.0, 0.0, 4.9e-324, -1e308, 1e308};
+  const double wholes[] = {-4.0e18, 4.0e18, 0, -1, 1e15, -0.0, 12.5};
+
+  std::vector<sample_record> samples;
+  sample_record record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp_us = -1000000;
+  for (size_t i = 0; i < n; i++) {
+    if (i < 1500) {
+      record.timestamp_us += 10000;
+      record.sample_no++;
+      record.pwm = (double) (i / 50);
+      record.current = 100 + (double) (i / 30) * 0.5;
+      record.rpm = (double) (i / 50) * 40;
+      record.thrust = 12.25 + (double) (i / 40);
+      record.thrust_error_us = 150;
+    }
+    else {
+      switch (i % 5) {
+        case 0: record.timestamp_us += 10000 + jitter(rng); break;
+        case 1: record.timestamp_us += 1; break;
+        case 2: record.timestamp_us += (int64_t) 1 << 40; break;
+        default: record.timestamp_us += 10000; break;
+      }
+      record.sample_no = i % 3 ? record.sample_no + 1 : (unsigned int) rng();
+      record.pwm = i % 4 ? (double) (int64_t) (rng() % 256) : (double) (rng() % 512) / 2;
+      record.current = i % 6 ? std::ldexp((double) (rng() >> 11), -40) : specials[i % 8];
+      record.rpm = wholes[i % 7];
+      record.thrust = i % 2 ? specials[i % 8] : -record.thrust / 3;
+      record.thrust_error_us = i % 9 ? jitter(rng) : INT64_MIN / 2 + (int64_t) i;
+    }
+    record.test_finished = i == n - 1;
+    samples.push_back(record);
+  }
+  return samples;
+}
+
+static void test_empty() {
+  sample_store store;
+  sample_record record;
+  CHECK(store.size() == 0);
+  CHECK(!store.all().next(record));
+}
+
+static void test_round_trip(const std::vector<sample_record> &samples) {
+  sample_store store;
+  for (size_t i = 0; i < samples.size(); i++) {
+    store.append(samples[i]);
+  }
+  CHECK(store.size() == samples.size());
+  CHECK(store.first_timestamp_us() == samples.front().timestamp_us);
+  CHECK(store.last_timestamp_us() == samples.back().timestamp_us);
+
+  sample_store::cursor cursor = store.all();
+  sample_record record;
+  size_t i = 0, mismatches = 0;
+  while (cursor.next(record)) {
+    if (i >= samples.size() || !same_record(record, samples[i])) {
+      if (mismatches++ < 5) {
+        std::cerr << "sample " << i << " differs" << std::endl;
+      }
+    }
+    i++;
+  }
+  CHECK(i == samples.size());
+  CHECK(mismatches == 0);
+}
+
+static void test_steady_size(const std::vector<sample_record> &samples) {
+  sample_store store;
+  for (size_t i = 0; i < 1500; i++) {
+    store.append(samples[i]);
+  }
+  // the ramp compresses to a few bytes a sample, raw it is 64
+  CHECK(store.bytes() < 1500 * 6);
+}
+
+static void test_ranges(const std::vector<sample_record> &samples) {
+  sample_store store;
+  for (size_t i = 0; i < samples.size(); i++) {
+    store.append(samples[i]);
+  }
+  // inside one block, across block boundaries, at the ends and outside
+  const size_t bounds[][2] = {{10, 20}, {1000, 1100}, {0, SAMPLE_STORE_BLOCK},
+                              {SAMPLE_STORE_BLOCK - 1, 3 * SAMPLE_STORE_BLOCK + 1},
+                              {samples.size() - 3, samples.size() - 1}};
+  for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+    int64_t first_us = samples[bounds[b][0]].timestamp_us;
+    int64_t last_us = samples[bounds[b][1]].timestamp_us;
+    sample_store::cursor cursor = store.range(first_us, last_us);
+    sample_record record;
+    size_t i = bounds[b][0];
+    bool equal = true;
+    while (cursor.next(record)) {
+      equal = equal && i < samples.size() && same_record(record, samples[i]);
+      i++;
+    }
+    CHECK(equal);
+    CHECK(i == bounds[b][1] + 1);
+  }
+
+  sample_record record;
+  CHECK(!store.range(samples.back().timestamp_us + 1, INT64_MAX).next(record));
+  CHECK(!store.range(INT64_MIN, samples.front().timestamp_us - 1).next(record));
+  // between two samples
+  CHECK(!store.range(samples[100].timestamp_us + 1, samples[101].timestamp_us - 1)
+             .next(record));
+}
+
+int main() {
+  std::vector<sample_record> samples = make_samples(5 * SAMPLE_STORE_BLOCK + 17);
+  test_empty();
+  test_round_trip(samples);
+  test_steady_size(samples);
+  test_ranges(samples);
+  return check_result("sample_store_test");
+}
@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file settling_detector_test.cpp
+ * When a step counts as settled, checked against a brute force reference.
+ *
+ * @author Ali AlSaibie
+ */
+#include "test_check.h"
+#include "settling_detector.h"
+#include <math.h>
+#include <random>
+#include <vector>
+
+#define MS 1000
+
+/* Thrust every `period_us` from `from_us` to `to_us`, `value(t)` in grams */
+template<typename F>
+static void feed_thrust(settling_detector &detector, int64_t from_us, int64_t to_us,
+                        int64_t period_us, F value) {
+  for (int64_t t = from_us; t <= to_us; t += period_us) {
+    detector.add_thrust(t, value(t));
+  }
+}
+
+static void test_min_dwell() {
+  settling_detector detector;
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 50 * MS, [](int64_t) { return 500.0; });
+  CHECK(!detector.settled(700 * MS));
+  CHECK(detector.settled(800 * MS));
+}
+
+static void test_noise() {
+  settling_detector detector;
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 50 * MS,
+              [](int64_t t) { return 500.0 + ((t / (50 * MS)) % 2 ? 0.5 : -0.5); });
+  CHECK(detector.settled(2000 * MS));
+
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 50 * MS,
+              [](int64_t t) { return 500.0 + ((t / (50 * MS)) % 2 ? 5.0 : -5.0); });
+  CHECK(!detector.settled(2000 * MS));
+}
+
+static void test_slow_scale() {
+  // three readings in a window is too few to judge
+  settling_detector detector;
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 250 * MS, [](int64_t) { return 500.0; });
+  CHECK(!detector.settled(2000 * MS));
+}
+
+static void test_transient() {
+  // the spin up has to leave the window before the step counts as settled
+  settling_detector detector;
+  detector.reset(0);
+  auto ramp = [](int64_t t) { return t < 1000 * MS ? t / 2000.0 : 500.0; };
+  feed_thrust(detector, 0, 1400 * MS, 50 * MS, ramp);
+  CHECK(!detector.settled(1400 * MS));
+  feed_thrust(detector, 1450 * MS, 1700 * MS, 50 * MS, ramp);
+  CHECK(detector.settled(1700 * MS));
+}
+
+static void test_current() {
+  settling_detector detector;
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 50 * MS, [](int64_t) { return 500.0; });
+  for (int64_t t = 0; t <= 2000 * MS; t += 20 * MS) {
+    detector.add_current(t, 300 + ((t / (20 * MS)) % 2 ? 20 : -20));
+  }
+  CHECK(!detector.settled(2000 * MS));
+
+  for (int64_t t = 2020 * MS; t <= 2800 * MS; t += 20 * MS) {
+    detector.add_thrust(t, 500.0);
+    detector.add_current(t, 300 + ((t / (20 * MS)) % 2 ? 1 : -1));
+  }
+  CHECK(detector.settled(2800 * MS));
+}
+
+static void test_reset() {
+  settling_detector detector;
+  detector.reset(0);
+  feed_thrust(detector, 0, 2000 * MS, 50 * MS, [](int64_t) { return 500.0; });
+  CHECK(detector.settled(2000 * MS));
+
+  // a new step waits out its own dwell, and ignores readings from before it
+  detector.reset(2000 * MS);
+  CHECK(!detector.settled(2000 * MS));
+  detector.add_thrust(1990 * MS, 0.0);
+  feed_thrust(detector, 2000 * MS, 2900 * MS, 50 * MS, [](int64_t) { return 800.0; });
+  CHECK(detector.settled(2800 * MS));
+}
+
+/* The standard deviation of the window, summed from scratch */
+static double reference_stddev(const std::vector<std::pair<int64_t, double> > &readings,
+                               int64_t from_us, size_t &n) {
+  double sum = 0;
+  n = 0;
+  for (size_t i = 0; i < readings.size(); i++) {
+    if (readings[i].first >= from_us) {
+      sum += readings[i].second;
+      n++;
+    }
+  }
+  if (n < 2) {
+    return 0;
+  }
+  double mean = sum / n, var = 0;
+  for (size_t i = 0; i < readings.size(); i++) {
+    if (readings[i].first >= from_us) {
+      var += (readings[i].second - mean) * (readings[i].second - mean);
+    }
+  }
+  return sqrt(var / n);
+}
+
+static void test_long_run() {
+  // hours of heavy thrust, the running sums must not drift from the truth
+  settling_config config;
+  settling_detector detector(config);
+  std::mt19937 rng(7);
+  std::normal_distribution<double> noise(0.0, 0.9);
+  std::vector<std::pair<int64_t, double> > readings;
+
+  detector.reset(0);
+  int disagreements = 0, settled_count = 0;
+  for (int64_t t = 0; t < 3600LL * 1000 * MS; t += 40 * MS) {
+    double grams = 4000.0 + noise(rng);
+    detector.add_thrust(t, grams);
+    readings.push_back(std::make_pair(t, grams));
+    if (readings.size() > 64) {
+      readings.erase(readings.begin());
+    }
+    size_t n;
+    double stddev = reference_stddev(readings, t - config.window_us, n);
+    // leave out near ties, either answer is right there
+    if (n >= config.min_readings && fabs(stddev - config.thrust_tolerance) < 1e-6) {
+      continue;
+    }
+    bool expected = t >= config.min_dwell_us && n >= config.min_readings &&
+                    stddev <= config.thrust_tolerance;
+    bool settled = detector.settled(t);
+    disagreements += settled != expected;
+    settled_count += settled;
+  }
+  CHECK(disagreements == 0);
+  CHECK(settled_count > 0);
+}
+
+int main() {
+  test_min_dwell();
+  test_noise();
+  test_slow_scale();
+  test_transient();
+  test_current();
+  test_reset();
+  test_long_run();
+  return check_result("settling_detector_test");
+}
@@ -0,0 +1,153 @@
+/****************************************************************************
+ *
+ *   Copyright (c) 2017 Ali AlSaibie. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/**
+ * @file sim_scale_device_test.cpp
+ * Report layout and pacing of the simulated scale, and USBScale decoding it.
+ *
+ * @author Ali AlSaibie
+ */
+#include "test_check.h"
+#include "sim_scale_device.h"
+#include "usbscale.h"
+#include "monotonic_clock.h"
+#include <math.h>
+#include <unistd.h>
+
+static void test_report_layout() {
+  sim_scale_config config;
+  config.weight = [](int64_t) { return 123.4; };
+  sim_scale_device device(config);
+  CHECK(device.open() == 0);
+
+  unsigned char report[WEIGH_REPORT_SIZE];
+  int transferred = 0;
+  CHECK(device.read_report(report, WEIGH_REPORT_SIZE, &transferred, 200) == 0);
+  CHECK(transferred == WEIGH_REPORT_SIZE);
+  CHECK(report[0] == 0x03);
+  CHECK(report[1] == 0x04);
+  CHECK(report[2] == 0x02);
+  CHECK((int8_t) report[3] == -1);
+  CHECK((report[4] | report[5] << 8) == 1234);
+}
+
+static void test_out_of_range() {
+  sim_scale_config config;
+  double weight = -5;
+  config.weight = [&weight](int64_t) { return weight; };
+  config.report_interval_us = 0;
+  sim_scale_device device(config);
+  device.open();
+
+  unsigned char report[WEIGH_REPORT_SIZE];
+  int transferred = 0;
+  device.read_report(report, WEIGH_REPORT_SIZE, &transferred, 200);
+  CHECK(report[1] == 0x05);
+  CHECK(report[4] == 0 && report[5] == 0);
+
+  weight = 1e5;
+  device.read_report(report, WEIGH_REPORT_SIZE, &transferred, 200);
+  CHECK(report[1] == 0x06);
+  CHECK(report[4] == 0xFF && report[5] == 0xFF);
+}
+
+static void test_read_pacing() {
+  sim_scale_config config;
+  config.report_interval_us = 2000;
+  sim_scale_device device(config);
+  device.open();
+
+  unsigned char report[WEIGH_REPORT_SIZE];
+  int transferred = 0;
+  const int n = 50;
+  int64_t start = monotonic_us();
+  for (int i = 0; i < n; i++) {
+    CHECK(device.read_report(report, WEIGH_REPORT_SIZE, &transferred, 200) == 0);
+  }
+  int64_t elapsed = monotonic_us() - start;
+  // the first report is due right away, the rest one interval apart
+  CHECK(elapsed >= (n - 1) * config.report_interval_us - 1000);
+  CHECK(elapsed < (n - 1) * config.report_interval_us + 50000);
+  CHECK(device.reports_sent() == (uint64_t) n);
+
+  // a timeout shorter than the wait for the next report
+  config.report_interval_us = 500000;
+  sim_scale_device slow(config);
+  slow.open();
+  slow.read_report(report, WEIGH_REPORT_SIZE, &transferred, 200);
+  CHECK(slow.read_report(report, WEIGH_REPORT_SIZE, &transferred, 10) != 0);
+  CHECK(transferred == 0);
+}
+
+static void test_get_measurement() {
+  sim_scale_config config;
+  config.weight = [](int64_t) { return 250.0; };
+  config.report_interval_us = 1000;
+  config.status_sequence = {0x03, 0x04};
+  USBScale scale(new sim_scale_device(config));
+  CHECK(scale.open_scale_device() == 0);
+  CHECK(fabs(scale.get_measurement() - 250.0) < 1e-9);
+}
+
+static void test_capture() {
+  sim_scale_config config;
+  config.weight = [](int64_t) { return 10.0; };
+  config.report_interval_us = 1000;
+  USBScale scale(new sim_scale_device(config));
+  scale.open_scale_device();
+  CHECK(scale.start_capture() == 0);
+  usleep(200000);
+  scale.stop_capture();
+
+  scale_measurement measurement;
+  int count = 0;
+  int64_t last_us = 0;
+  bool ordered = true;
+  while (scale.poll_measurement(measurement)) {
+    ordered = ordered && measurement.timestamp_us > last_us;
+    last_us = measurement.timestamp_us;
+    CHECK(measurement.stable());
+    CHECK(fabs(measurement.weight - 10.0) < 1e-9);
+    count++;
+  }
+  // one report per millisecond, with room for a slow scheduler
+  CHECK(count >= 150 && count <= 210);
+  CHECK(ordered);
+  CHECK(scale.dropped_measurements() == 0);
+}
+
+int main() {
+  test_report_layout();
+  test_out_of_range();
+  test_read_pacing();
+  test_get_measurement();
+  test_capture();
+  return check_result("sim_scale_device_test");
+}